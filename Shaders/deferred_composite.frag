@@ -0,0 +1,18 @@
+#version 330
+
+// Copy the pixels shaded by deferred_tiled.comp over the skybox, the background has a 0 alpha
+in vec2 TexCoord;
+
+out vec4 colour;
+
+uniform sampler2D theTexture;
+
+void main()
+{
+	vec4 lit = texture(theTexture, TexCoord);
+	if (lit.a == 0.0)
+	{
+		discard;
+	}
+	colour = lit;
+}
@@ -1,11 +1,15 @@
 #version 330
 
-layout (location = 0) in vec3 pos;
+layout (location = 0) in vec3 inPos;
+// Constant attributes set by Mesh::RenderMesh to decode quantised positions
+layout (location = 3) in vec4 positionScale;
+layout (location = 4) in vec3 positionOffset;
 
 uniform mat4 model;
 uniform mat4 directionalLightTransform;
 
 void main()
 {
+	vec3 pos = inPos * positionScale.xyz + positionOffset;
 	gl_Position = directionalLightTransform * model * vec4(pos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+// Texture of a draw of the geometry pool, included by shader_indirect.frag and gbuffer.frag.
+// The includer declares the TexCoord and DrawTexture inputs of shader_indirect.vert first
+
+// w of DrawTexture, must match TextureArray::DrawTextureType
+const uint DRAW_TEXTURE_ARRAY = 0u;
+const uint DRAW_TEXTURE_BINDLESS = 1u;
+
+uniform sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS];
+
+vec4 SampleDrawTexture()
+{
+#ifdef GL_ARB_bindless_texture
+	if (DrawTexture.w == DRAW_TEXTURE_BINDLESS)
+	{
+		return texture(sampler2D(DrawTexture.xy), TexCoord);
+	}
+#endif
+	// x is the same for the whole draw so it's fine to index the samplers with it
+	return textureLod(textureArrays[DrawTexture.x], vec3(TexCoord, float(DrawTexture.y)), float(DrawTexture.z));
+}
@@ -0,0 +1,58 @@
+#version 430
+#extension GL_ARB_bindless_texture : enable
+
+// G-buffer of the deferred path, drawn after shader.vert or after shader_indirect.vert when INDIRECT is defined.
+// Nothing is lit here, deferred_tiled.comp does it from what is written:
+// albedo and specular intensity in RGBA8, octahedral normal and log2 of the shininess in RGB10_A2
+
+in vec2 TexCoord;
+in vec3 Normal;
+#ifdef INDIRECT
+flat in uvec4 DrawTexture;
+flat in vec2 DrawMaterial;
+#endif
+
+layout (location = 0) out vec4 albedoSpecular;
+layout (location = 1) out vec4 normalShininess;
+
+#ifdef INDIRECT
+#include "draw_texture.glsl"
+#else
+struct Material
+{
+	float specularIntensity;
+	float shininess;
+};
+
+uniform sampler2D theTexture;
+uniform Material material;
+#endif
+
+// The inverse of DecodeOctahedral in shader.vert, in [-1, 1]
+vec2 EncodeOctahedral(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 oct = n.xy;
+	if (n.z < 0.0)
+	{
+		oct = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return oct;
+}
+
+void main()
+{
+#ifdef INDIRECT
+	vec4 albedo = SampleDrawTexture();
+	float specularIntensity = DrawMaterial.x;
+	float shininess = DrawMaterial.y;
+#else
+	vec4 albedo = texture(theTexture, TexCoord);
+	float specularIntensity = material.specularIntensity;
+	float shininess = material.shininess;
+#endif
+
+	// The specular intensity is clamped to 1 and the shininess kept between 1 and 1024
+	albedoSpecular = vec4(albedo.rgb, clamp(specularIntensity, 0.0, 1.0));
+	normalShininess = vec4(EncodeOctahedral(normalize(Normal)) * 0.5 + 0.5, clamp(log2(max(shininess, 1.0)) / 10.0, 0.0, 1.0), 0.0);
+}
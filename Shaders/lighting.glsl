@@ -0,0 +1,262 @@
+// Lighting of the main pass, included by shader.frag, shader_indirect.frag and deferred_tiled.comp.
+// The includer declares the FragPos, Normal and DirectionalLightSpacePos inputs (globals filled from the G-buffer
+// in deferred_tiled.comp), the Material struct and a material variable first. The defines come from ShaderVariants:
+// MAX_POINT_LIGHTS, MAX_SPOT_LIGHTS and the features SHADOWS, SOFT_SHADOWS (3x3 PCF and 20 cube map samples),
+// POINT_LIGHTS, SPOT_LIGHTS, SPECULAR
+
+struct Light
+{
+	vec3 colour;
+	float ambientIntensity;
+	float diffuseIntensity;
+};
+
+struct DirectionalLight 
+{
+	Light base;
+	vec3 direction;
+};
+
+struct PointLight
+{
+	Light base;
+	vec3 position;
+	float constant;
+	float linear;
+	float exponent;	
+};
+
+struct SpotLight
+{
+	PointLight base;
+	vec3 direction;
+	float edge;
+};
+
+struct OmniShadowMap
+{
+	samplerCube shadowMap;
+	float farPlane;
+};
+
+uniform int pointLightCount;
+uniform int spotLightCount;
+
+uniform DirectionalLight directionalLight;
+uniform PointLight pointLights[MAX_POINT_LIGHTS];
+uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
+
+uniform sampler2D directionalShadowMap;
+uniform OmniShadowMap omniShadowMaps[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+
+uniform vec3 eyePosition;
+
+#ifdef SOFT_SHADOWS
+const int PCF_RADIUS = 1;
+const int OMNI_SHADOW_SAMPLES = 20;
+#else
+const int PCF_RADIUS = 0;
+const int OMNI_SHADOW_SAMPLES = 1;
+#endif
+
+vec3 sampleOffsetDirections[20] = vec3[]
+(
+	vec3( 1,  1,  1), vec3( 1, -1,  1), vec3( -1, -1,  1), vec3( -1,  1,  1),
+	vec3( 1,  1, -1), vec3( 1, -1, -1), vec3( -1, -1, -1), vec3( -1,  1, -1),
+	vec3( 1,  1,  0), vec3( 1, -1,  0), vec3( -1, -1,  0), vec3( -1,  1,  0),
+	vec3( 1,  0,  1), vec3(-1,  0,  1), vec3(  1,  0, -1), vec3( -1,  0, -1),
+	vec3( 0,  1,  1), vec3( 0, -1,  1), vec3(  0, -1, -1), vec3(  0,  1, -1)
+);
+
+float CalcDirectionalShadowFactor(DirectionalLight light)
+{
+#ifndef SHADOWS
+	return 0.0;
+#else
+	vec3 projCoords = DirectionalLightSpacePos.xyz / DirectionalLightSpacePos.w; // Convert value to range [-1; 1]
+	projCoords = (projCoords * 0.5) + 0.5; // Convert value to range [0; 1]
+	
+	float closestDepth = texture(directionalShadowMap, projCoords.xy).r;
+	float currentDepth = projCoords.z; // depth value of the current fragment
+	
+	vec3 normal = normalize(Normal);
+	vec3 lightDir = normalize(light.direction);
+	
+	float bias = max(0.002 * (1 - dot(normal, lightDir)), 0.001);
+	
+	float shadow = 0.0;
+	vec2 texelSize = 1.0 / textureSize(directionalShadowMap, 0);
+	for (int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
+	{
+		for (int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
+		{
+			float pcfDepth = texture(directionalShadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
+			shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+		}
+	}
+	shadow /= float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1)); // because we compared with that many pixels
+		
+	if (projCoords.z > 1.0)
+	{
+		shadow = 0.0;
+	}
+	
+	return shadow;
+#endif
+}
+
+float CalcOmniShadowFactor(PointLight light, int shadowIndex)
+{
+#ifndef SHADOWS
+	return 0.0;
+#else
+	vec3 fragToLight = FragPos - light.position;
+	float currentDepth = length(fragToLight);
+	
+	float shadow = 0.0;
+	float bias = 0.05;
+	int samples = OMNI_SHADOW_SAMPLES;
+	
+	float viewDistance = length(eyePosition - FragPos);
+	float diskRadius = (1.0 + (viewDistance / omniShadowMaps[shadowIndex].farPlane)) / 25.0; // 25 is arbitrary
+	if (samples == 1)
+	{
+		diskRadius = 0.0; // a single sample right on the fragment direction
+	}
+	
+	for (int i = 0; i < samples; i++)
+	{
+		// Get the depthValue from the shadowMap
+		float closestDepth = texture(omniShadowMaps[shadowIndex].shadowMap, fragToLight + sampleOffsetDirections[i] * diskRadius).r;
+		// We divided by farPlane in the omni_shadow_map.frag to get a value between [0-1]. so now we multiply by farPlane to get the real value; 
+		closestDepth *= omniShadowMaps[shadowIndex].farPlane;
+		
+		if (currentDepth - bias > closestDepth)
+		{ 	
+			shadow += 1.0;
+		}
+	}
+	
+	shadow /= float(samples);
+	
+	return shadow;
+#endif
+}
+
+// Ce code est utilisé autant pour la directional light que pour la pointLigth.
+// On calcule l'éclairage du fragment selon une lumière et une direction donnée.
+vec4 CalcLightByDirection(Light light, vec3 direction, float shadowFactor)
+{
+	vec4 ambientColour = vec4(light.colour, 1.0f) * light.ambientIntensity;
+	
+	// Rappel on normalize les vecteurs pour trouver directement le cosinus de l'angle
+	// A.B = |A||B|cos(angle)
+	// On utilise max pour renvoyer la plus grande valeur et donc ne jamais être en dessous de 0;
+	// Si < 0 alors on est en dessous de la face de l'objet. "we don't want to light it up the surface if it starts going underneath it"
+	float diffuseFactor = max(dot(normalize(Normal), normalize(direction)), 0.0f);
+	//vec4 diffuseColour = vec4(light.colour * light.diffuseIntensity * diffuseFactor, 1.0f);
+	vec4 diffuseColour = vec4(light.colour * light.diffuseIntensity * diffuseFactor, 1.0f);
+	
+	vec4 specularColour = vec4(0, 0, 0, 0);
+#ifdef SPECULAR
+	// si pas affecté par la lumière diffuse alors pas affecté par la lumière specualire
+	if(diffuseFactor > 0.0f)
+	{
+		// Créer le vecteur pour la direction fragment à la camera
+		vec3 fragToEye = normalize(eyePosition - FragPos);
+		//				  reflectedVertex  \   / rayon de lumière
+		// Le rayon de lumière réfléchi    _\_/_ objet
+		vec3 reflectedVertex = normalize(reflect(direction, normalize(Normal)));
+		
+		// Produit scalaire entre la direction du fragment à la caméra et du rayon de lumière réfléchi.
+		// Si les 2 vecteurs sont identiques dans ce cas on est ébloui et toute la lumière est renvoyé vers la caméra pour ce point
+		// On utilise le produit scalaire pour avoir l'angle comme d'hab
+		float specularFactor = dot(fragToEye, reflectedVertex);
+		if (specularFactor > 0.0f)
+		{
+			specularFactor = pow(specularFactor, material.shininess);
+			specularColour = vec4(light.colour * material.specularIntensity * specularFactor, 1.0f);
+		}
+	}
+#endif
+
+	return (ambientColour + (1.0 - shadowFactor) * (diffuseColour + specularColour));
+}
+
+vec4 CalcDirectionalLight()
+{
+	float shadowFactor = CalcDirectionalShadowFactor(directionalLight);
+	return CalcLightByDirection(directionalLight.base, directionalLight.direction, shadowFactor);
+}
+
+vec4 CalcPointLight(PointLight pLight, int shadowIndex)
+{
+	vec3 direction = FragPos - pLight.position;
+	float distance = length(direction); 
+	direction = normalize(direction);
+	
+	float shadowFactor = CalcOmniShadowFactor(pLight, shadowIndex);
+
+	vec4 colour = CalcLightByDirection(pLight.base, direction, shadowFactor);
+	// ax² + bx +c
+	float attenuation = pLight.exponent * distance * distance +
+						pLight.linear * distance +
+						pLight.constant;
+	// += because we calculate for all point lights
+
+	return (colour / attenuation);
+}
+
+vec4 CalcSpotLight(SpotLight sLight, int shadowIndex)
+{
+	// The direction between fragment and the spot Light
+	vec3 rayDirection = normalize(FragPos - sLight.base.position);
+	// Calcule le produit scalaire que l'on va comparer avec le edge pour voir si le fragment est affecté par le spot
+	float slFactor = dot(rayDirection, sLight.direction);
+	
+	if (slFactor > sLight.edge)
+	{
+		vec4 colour = CalcPointLight(sLight.base, shadowIndex);
+		
+		return colour * (1.0f - (1.0f - slFactor)*(1.0f/(1.0f - sLight.edge)));
+	}
+	else
+	{
+		return vec4(0, 0, 0, 0);
+	}
+}
+
+vec4 CalcSpotLights()
+{
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for (int i = 0; i < spotLightCount; i++)
+	{
+		totalColour += CalcSpotLight(spotLights[i], i + pointLightCount); // i + pointLightCount because we setted up the pointlights before the spotlights
+	}
+	
+	return totalColour;
+}
+
+vec4 CalcPointLights()
+{
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for (int i = 0; i < pointLightCount; i++)
+	{
+		totalColour += CalcPointLight(pointLights[i], i);
+	}
+	
+	return totalColour;
+}
+
+// Sum of every light enabled in the variant
+vec4 CalcLighting()
+{
+	vec4 finalColour = CalcDirectionalLight();
+#ifdef POINT_LIGHTS
+	finalColour += CalcPointLights();
+#endif
+#ifdef SPOT_LIGHTS
+	finalColour += CalcSpotLights();
+#endif
+	return finalColour;
+}
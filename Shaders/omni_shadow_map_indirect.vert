@@ -0,0 +1,25 @@
+#version 430
+#extension GL_ARB_shader_draw_parameters : require
+
+layout (location = 0) in vec3 inPos;
+
+// Must match PerDrawData in GeometryPool.h
+struct DrawData
+{
+	mat4 model;
+	uvec4 texture;
+	vec4 material;
+	vec4 positionScale; // w is 1 when the normal is octahedral encoded
+	vec4 positionOffset;
+};
+
+layout (std430, binding = 0) readonly buffer DrawDataBuffer
+{
+	DrawData draws[];
+};
+
+void main()
+{
+	vec3 pos = inPos * draws[gl_BaseInstanceARB].positionScale.xyz + draws[gl_BaseInstanceARB].positionOffset.xyz;
+	gl_Position = draws[gl_BaseInstanceARB].model * vec4(pos, 1.0);
+}
\ No newline at end of file
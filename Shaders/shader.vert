@@ -1,8 +1,11 @@
 #version 330
 
-layout (location = 0) in vec3 pos;
+layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec2 tex;
-layout (location = 2) in vec3 norm;
+layout (location = 2) in vec3 inNorm;
+// Constant attributes set by Mesh::RenderMesh to decode quantised vertex formats
+layout (location = 3) in vec4 positionScale; // w is 1 when the normal is octahedral encoded
+layout (location = 4) in vec3 positionOffset;
 
 out vec4 vCol;
 out vec2 TexCoord;
@@ -15,8 +18,20 @@ uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 directionalLightTransform;  // Position of the fragment relative to the directional light
 
+vec3 DecodeOctahedral(vec2 oct)
+{
+	vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
 void main()
 {
+	vec3 pos = inPos * positionScale.xyz + positionOffset;
+	vec3 norm = positionScale.w > 0.5 ? DecodeOctahedral(inNorm.xy) : inNorm;
+
 	gl_Position = projection * view * model * vec4(pos, 1.0);
 	DirectionalLightSpacePos = directionalLightTransform * model * vec4(pos, 1.0);
 	vCol = vec4(clamp(pos, 0.0f, 1.0f), 1.0f);
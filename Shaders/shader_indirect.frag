@@ -0,0 +1,34 @@
+#version 430
+#extension GL_ARB_bindless_texture : enable
+
+// shader.frag for the indirect main pass: the texture and the material of each draw come from shader_indirect.vert
+
+in vec4 vCol;
+in vec2 TexCoord;
+in vec3 Normal;
+in vec3 FragPos;
+in vec4 DirectionalLightSpacePos;
+flat in uvec4 DrawTexture;
+flat in vec2 DrawMaterial;
+
+out vec4 colour;
+
+struct Material
+{
+	float specularIntensity;
+	float shininess;
+};
+
+// Filled from DrawMaterial so the lighting code is the same as shader.frag
+Material material;
+
+#include "lighting.glsl"
+#include "draw_texture.glsl"
+
+void main()	
+{
+	material.specularIntensity = DrawMaterial.x;
+	material.shininess = DrawMaterial.y;
+
+	colour = SampleDrawTexture() * CalcLighting();
+}
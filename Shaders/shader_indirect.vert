@@ -0,0 +1,63 @@
+#version 430
+#extension GL_ARB_shader_draw_parameters : require
+
+// Same as shader.vert for the geometry pool: the model matrix, the decode of the vertex format and
+// everything the fragment shader needs about the material come from the draw data
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 tex;
+layout (location = 2) in vec3 inNorm;
+
+// Must match PerDrawData in GeometryPool.h
+struct DrawData
+{
+	mat4 model;
+	uvec4 texture;
+	vec4 material;
+	vec4 positionScale; // w is 1 when the normal is octahedral encoded
+	vec4 positionOffset;
+};
+
+layout (std430, binding = 0) readonly buffer DrawDataBuffer
+{
+	DrawData draws[];
+};
+
+out vec4 vCol;
+out vec2 TexCoord;
+out vec3 Normal;
+out vec3 FragPos;
+out vec4 DirectionalLightSpacePos;
+flat out uvec4 DrawTexture;
+flat out vec2 DrawMaterial;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 directionalLightTransform;  // Position of the fragment relative to the directional light
+
+vec3 DecodeOctahedral(vec2 oct)
+{
+	vec3 n = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	mat4 model = draws[gl_BaseInstanceARB].model;
+	vec4 positionScale = draws[gl_BaseInstanceARB].positionScale;
+	vec3 pos = inPos * positionScale.xyz + draws[gl_BaseInstanceARB].positionOffset.xyz;
+	vec3 norm = positionScale.w > 0.5 ? DecodeOctahedral(inNorm.xy) : inNorm;
+
+	gl_Position = projection * view * model * vec4(pos, 1.0);
+	DirectionalLightSpacePos = directionalLightTransform * model * vec4(pos, 1.0);
+	vCol = vec4(clamp(pos, 0.0f, 1.0f), 1.0f);
+
+	TexCoord = tex;
+	Normal = mat3(transpose(inverse(model))) * norm;
+	FragPos = (model * vec4(pos, 1.0)).xyz;
+
+	DrawTexture = draws[gl_BaseInstanceARB].texture;
+	DrawMaterial = draws[gl_BaseInstanceARB].material.xy;
+}
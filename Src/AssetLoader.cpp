@@ -0,0 +1,73 @@
+#include "AssetLoader.h"
+
+AssetLoader::AssetLoader()
+{
+	threadPool = nullptr;
+	pendingLoads = 0;
+}
+
+void AssetLoader::Init(ThreadPool* threads)
+{
+	threadPool = threads;
+}
+
+void AssetLoader::LoadAsync(const std::function<void()>& load)
+{
+	if (!threadPool || threadPool->GetThreadCount() == 0)
+	{
+		load();
+		return;
+	}
+
+	pendingLoads++;
+	threadPool->Enqueue([this, load]()
+	{
+		load();
+		pendingLoads--;
+	});
+}
+
+void AssetLoader::QueueUpload(size_t byteCost, const std::function<void()>& upload)
+{
+	Upload item;
+	item.byteCost = byteCost;
+	item.upload = upload;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	uploads.push_back(item);
+}
+
+size_t AssetLoader::ProcessUploads(size_t byteBudget)
+{
+	size_t uploaded = 0;
+
+	while (true)
+	{
+		Upload item;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (uploads.empty() || (uploaded > 0 && uploaded + uploads.front().byteCost > byteBudget))
+			{
+				break;
+			}
+			item = uploads.front();
+			uploads.pop_front();
+		}
+
+		// Outside of the lock, the workers keep queueing while we upload
+		item.upload();
+		uploaded += item.byteCost;
+	}
+
+	return uploaded;
+}
+
+bool AssetLoader::IsIdle()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pendingLoads == 0 && uploads.empty();
+}
+
+AssetLoader::~AssetLoader()
+{
+}
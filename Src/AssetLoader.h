@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include "ThreadPool.h"
+
+// Background loading: file I/O and decoding run on the thread pool, then the GL part of every asset is
+// queued here and ProcessUploads runs it on the GL thread a few megabytes per frame so the frame rate holds.
+class AssetLoader
+{
+public:
+	AssetLoader();
+
+	void Init(ThreadPool* threads);
+	// For the loads that can split their work further
+	ThreadPool* GetThreadPool() { return threadPool; }
+
+	// Run load on a worker thread, or right away if there is no thread pool
+	void LoadAsync(const std::function<void()>& load);
+
+	// Can be called from any thread, upload runs on the GL thread. byteCost is about how much data it sends to the GPU
+	void QueueUpload(size_t byteCost, const std::function<void()>& upload);
+
+	// Once per frame on the GL thread: run the queued uploads until byteBudget is spent, at least one per frame
+	// so bigger assets still get in. Return the number of bytes uploaded
+	size_t ProcessUploads(size_t byteBudget);
+
+	// Nothing left to load or upload
+	bool IsIdle();
+
+	~AssetLoader();
+
+private:
+	struct Upload
+	{
+		size_t byteCost;
+		std::function<void()> upload;
+	};
+
+	ThreadPool* threadPool;
+
+	std::mutex mutex;
+	std::deque<Upload> uploads;
+	std::atomic<int> pendingLoads;
+};
@@ -2,4 +2,22 @@
 #include "stb_image.h"
 
 const int MAX_POINT_LIGHTS = 3;
-const int MAX_SPOT_LIGHTS = 3;
\ No newline at end of file
+const int MAX_SPOT_LIGHTS = 3;
+
+// x, y, z, u, v, nx, ny, nz
+const int VERTEX_LENGTH = 8;
+
+// Meshes with more vertices need 32 bits indices
+const unsigned int MAX_SHORT_INDEX_VERTICES = 65536;
+
+// Constant vertex attributes set by Mesh::RenderMesh to decode the quantised vertex formats
+const int VERTEX_ATTRIB_POSITION_SCALE = 3;
+const int VERTEX_ATTRIB_POSITION_OFFSET = 4;
+
+// Shader storage binding of the per draw data used by the indirect draws
+const int DRAW_DATA_BINDING = 0;
+// Texture arrays of the indirect main pass are bound on the units after the omni shadow maps (3 to 8)
+const int MAX_TEXTURE_ARRAYS = 7;
+const int TEXTURE_ARRAY_UNIT = 9;
+// The G-buffer of the deferred lighting takes the units of the texture arrays, the lighting pass doesn't sample them
+const int GBUFFER_UNIT = 9;
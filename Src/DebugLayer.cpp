@@ -0,0 +1,95 @@
+#include "DebugLayer.h"
+
+#include <stdio.h>
+
+#ifdef _DEBUG
+bool DebugLayer::enabled = true;
+#else
+bool DebugLayer::enabled = false;
+#endif
+bool DebugLayer::supported = false;
+
+void DebugLayer::SetEnabled(bool enabled)
+{
+	DebugLayer::enabled = enabled;
+}
+
+void DebugLayer::Init()
+{
+	supported = enabled && (GLEW_VERSION_4_3 || GLEW_KHR_debug);
+	if (!enabled)
+	{
+		return;
+	}
+	if (!supported)
+	{
+		printf("Debug layer: no KHR_debug, only the program validation is on\n");
+		return;
+	}
+
+	glEnable(GL_DEBUG_OUTPUT);
+	// The callback runs inside the faulty call so a breakpoint in it shows who made it
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(OnMessage, nullptr);
+
+	// The notifications are mostly the driver telling where it put the buffers
+	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+	// Our own push and pop are only there for the frame debuggers
+	glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+
+	printf("Debug layer: on\n");
+}
+
+void DebugLayer::Label(GLenum identifier, GLuint name, const std::string& label)
+{
+	if (!supported || name == 0)
+	{
+		return;
+	}
+
+	glObjectLabel(identifier, name, (GLsizei)label.size(), label.c_str());
+}
+
+void DebugLayer::PushGroup(const char* name)
+{
+	if (!supported)
+	{
+		return;
+	}
+
+	glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void DebugLayer::PopGroup()
+{
+	if (!supported)
+	{
+		return;
+	}
+
+	glPopDebugGroup();
+}
+
+void GLAPIENTRY DebugLayer::OnMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+									const GLchar* message, const void* userParam)
+{
+	const char* severityName = "notification";
+	switch (severity)
+	{
+	case GL_DEBUG_SEVERITY_HIGH: severityName = "high"; break;
+	case GL_DEBUG_SEVERITY_MEDIUM: severityName = "medium"; break;
+	case GL_DEBUG_SEVERITY_LOW: severityName = "low"; break;
+	}
+
+	const char* typeName = "other";
+	switch (type)
+	{
+	case GL_DEBUG_TYPE_ERROR: typeName = "error"; break;
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: typeName = "deprecated"; break;
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: typeName = "undefined behavior"; break;
+	case GL_DEBUG_TYPE_PORTABILITY: typeName = "portability"; break;
+	case GL_DEBUG_TYPE_PERFORMANCE: typeName = "performance"; break;
+	}
+
+	printf("GL %s (%s, id %u): %.*s\n", typeName, severityName, id, (int)length, message);
+}
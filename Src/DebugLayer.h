@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#include <GL/glew.h>
+
+// Debug checks of the GL calls, off by default in release builds so their frames pay nothing.
+// With KHR_debug (core in 4.3) the driver reports errors and performance warnings through a callback as they
+// happen, objects get readable names and passes show as groups in the message log and in frame debuggers.
+// Shader::Validate only runs when the layer is on
+class DebugLayer
+{
+public:
+	// Before Window::Initialise, the context is then created with the debug flag
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled() { return enabled; }
+
+	// Once the context is current and GLEW initialised
+	static void Init();
+
+	// identifier is GL_TEXTURE, GL_PROGRAM, GL_BUFFER, GL_FRAMEBUFFER...
+	static void Label(GLenum identifier, GLuint name, const std::string& label);
+	static void PushGroup(const char* name);
+	static void PopGroup();
+
+private:
+	static void GLAPIENTRY OnMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+									const GLchar* message, const void* userParam);
+
+	static bool enabled;
+	// The driver has KHR_debug
+	static bool supported;
+};
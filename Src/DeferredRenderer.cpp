@@ -0,0 +1,185 @@
+#include "DeferredRenderer.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "DebugLayer.h"
+
+DeferredRenderer::DeferredRenderer()
+{
+	width = 0;
+	height = 0;
+	FBO = 0;
+	albedoSpecular = 0;
+	normalShininess = 0;
+	depth = 0;
+	litTexture = 0;
+	emptyVAO = 0;
+}
+
+bool DeferredRenderer::IsSupported()
+{
+	return GLEW_VERSION_4_3 != 0;
+}
+
+bool DeferredRenderer::Init(int width, int height, bool indirect)
+{
+	this->width = width;
+	this->height = height;
+
+	GLuint* targets[] = { &albedoSpecular, &normalShininess, &depth, &litTexture };
+	GLenum formats[] = { GL_RGBA8, GL_RGB10_A2, GL_DEPTH_COMPONENT24, GL_RGBA8 };
+	const char* labels[] = { "G-buffer albedo and specular", "G-buffer normal and shininess", "G-buffer depth", "Deferred lighting" };
+	for (size_t i = 0; i < 4; i++)
+	{
+		glGenTextures(1, targets[i]);
+		glBindTexture(GL_TEXTURE_2D, *targets[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], width, height);
+		// Read with texelFetch, except the lit pixels that Composite stretches over the viewport
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		DebugLayer::Label(GL_TEXTURE, *targets[i], labels[i]);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &FBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalShininess, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	DebugLayer::Label(GL_FRAMEBUFFER, FBO, "G-buffer");
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("G-buffer Framebuffer Error: %i\n", status);
+		Clear();
+		return false;
+	}
+
+	glGenVertexArrays(1, &emptyVAO);
+
+	// Same vertex shaders as the forward pass, the variant defines give the sizes of the arrays
+	std::string defines = ShaderVariants::GetDefines(0);
+	if (indirect)
+	{
+		geometryShader.SetDefines(defines + "#define INDIRECT\n");
+		geometryShader.CreateFromFiles("Shaders/shader_indirect.vert", "Shaders/gbuffer.frag");
+	}
+	else
+	{
+		geometryShader.SetDefines(defines);
+		geometryShader.CreateFromFiles("Shaders/shader.vert", "Shaders/gbuffer.frag");
+	}
+	compositeShader.CreateFromFiles("Shaders/deferred_composite.vert", "Shaders/deferred_composite.frag");
+	lightingShaders.InitCompute("Shaders/deferred_tiled.comp");
+
+	return true;
+}
+
+Shader* DeferredRenderer::BeginGeometryPass()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glViewport(0, 0, width, height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	geometryShader.UseShader();
+	return &geometryShader;
+}
+
+void DeferredRenderer::EndGeometryPass()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+Shader* DeferredRenderer::GetLightingShader(unsigned int features)
+{
+	return lightingShaders.Get(features | ShaderVariants::FEATURE_SPECULAR);
+}
+
+void DeferredRenderer::ShadeTiles(Shader* lightingShader, const glm::mat4& viewProjection)
+{
+	glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+	glUniformMatrix4fv(lightingShader->GetInverseViewProjectionLocation(), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+
+	GLuint gBuffer[] = { albedoSpecular, normalShininess, depth };
+	for (size_t i = 0; i < 3; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + GBUFFER_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D, gBuffer[i]);
+	}
+	lightingShader->SetGBuffer(GBUFFER_UNIT);
+	glBindImageTexture(0, litTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+	lightingShader->Validate();
+
+	glDispatchCompute((width + TILE_SIZE - 1) / TILE_SIZE, (height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+	// Composite samples what the image stores wrote
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void DeferredRenderer::Composite()
+{
+	compositeShader.UseShader();
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, litTexture);
+	compositeShader.SetTexture(1);
+
+	compositeShader.Validate();
+
+	// Only colour, the depth of the default framebuffer isn't used after the main pass
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(emptyVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glEnable(GL_DEPTH_TEST);
+}
+
+int DeferredRenderer::Reload(const std::string& fileLocation)
+{
+	int reloaded = lightingShaders.Reload(fileLocation);
+	Shader* shaders[] = { &geometryShader, &compositeShader };
+	for (size_t i = 0; i < 2; i++)
+	{
+		if (shaders[i]->UsesFile(fileLocation) && shaders[i]->Reload())
+		{
+			reloaded++;
+		}
+	}
+	return reloaded;
+}
+
+void DeferredRenderer::Clear()
+{
+	GLuint textures[] = { albedoSpecular, normalShininess, depth, litTexture };
+	glDeleteTextures(4, textures);
+	albedoSpecular = 0;
+	normalShininess = 0;
+	depth = 0;
+	litTexture = 0;
+
+	if (FBO)
+	{
+		glDeleteFramebuffers(1, &FBO);
+		FBO = 0;
+	}
+	if (emptyVAO)
+	{
+		glDeleteVertexArrays(1, &emptyVAO);
+		emptyVAO = 0;
+	}
+
+	geometryShader.ClearShader();
+	compositeShader.ClearShader();
+	lightingShaders.Clear();
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "CommonValues.h"
+#include "Shader.h"
+#include "ShaderVariants.h"
+
+// Deferred alternative to the forward main pass, for scenes with many lights. The scene is drawn once into a
+// compact G-buffer (albedo and specular intensity in RGBA8, octahedral normal and shininess in RGB10_A2, depth),
+// then deferred_tiled.comp shades the screen by 16x16 tiles: each tile keeps the lights reaching the depth range
+// of its pixels and runs the lighting of the forward pass with them only, so every pixel is lit once whatever
+// the overdraw. The result is drawn over the skybox by Composite
+class DeferredRenderer
+{
+public:
+	DeferredRenderer();
+
+	// Compute shaders and image stores are GL 4.3
+	static bool IsSupported();
+
+	// On the GL thread. indirect picks the G-buffer program of the geometry pool draws
+	bool Init(int width, int height, bool indirect);
+
+	// Bind the G-buffer and its program, the caller sets the camera and the material uniforms and draws the scene
+	Shader* BeginGeometryPass();
+	void EndGeometryPass();
+
+	// Lighting program of the main pass features, the specular is always in
+	Shader* GetLightingShader(unsigned int features);
+	// lightingShader is in use with its lights and shadow maps set
+	void ShadeTiles(Shader* lightingShader, const glm::mat4& viewProjection);
+	// Draw the shaded pixels over the current framebuffer, the background stays as it is
+	void Composite();
+
+	// Hot reload of the programs compiled from fileLocation, return how many
+	int Reload(const std::string& fileLocation);
+
+	void Clear();
+
+	~DeferredRenderer();
+
+private:
+	// Must match the local size of deferred_tiled.comp
+	static const int TILE_SIZE = 16;
+
+	int width, height;
+
+	GLuint FBO;
+	GLuint albedoSpecular, normalShininess, depth;
+	GLuint litTexture;
+	// Composite draws without vertices but core profile needs a VAO bound
+	GLuint emptyVAO;
+
+	Shader geometryShader;
+	Shader compositeShader;
+	ShaderVariants lightingShaders;
+};
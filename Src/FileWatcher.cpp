@@ -0,0 +1,140 @@
+#include "FileWatcher.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "ImageDecoder.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher()
+{
+	inotifyFd = -1;
+}
+
+bool FileWatcher::Init()
+{
+#ifdef __linux__
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+	{
+		printf("inotify_init1 failed, watching the files by their modification time\n");
+	}
+#endif
+	lastScan = std::chrono::steady_clock::now();
+	return true;
+}
+
+bool FileWatcher::WatchDirectory(const std::string& directory)
+{
+#ifdef __linux__
+	if (inotifyFd >= 0)
+	{
+		// Written and closed, or renamed over by an editor
+		int watch = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch < 0)
+		{
+			printf("Failed to watch: %s\n", directory.c_str());
+			return false;
+		}
+		watches[watch] = directory;
+		return true;
+	}
+#endif
+
+	directories.push_back(directory);
+	std::vector<std::string> files = ImageDecoder::ListFiles(directory);
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		modificationTimes[files[i]] = GetModificationTime(files[i]);
+	}
+	return true;
+}
+
+void FileWatcher::Poll(std::vector<std::string>* changedFiles)
+{
+	changedFiles->clear();
+
+	// A save can come as several events, the set keeps one of each file
+	std::set<std::string> changed;
+
+#ifdef __linux__
+	if (inotifyFd >= 0)
+	{
+		alignas(inotify_event) char buffer[4096];
+		while (true)
+		{
+			ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+			if (length <= 0)
+			{
+				if (length < 0 && errno != EAGAIN && errno != EINTR)
+				{
+					printf("Failed to read the inotify events\n");
+				}
+				break;
+			}
+
+			for (char* event = buffer; event < buffer + length; event += sizeof(inotify_event) + ((inotify_event*)event)->len)
+			{
+				const inotify_event* notification = (const inotify_event*)event;
+				std::map<int, std::string>::iterator directory = watches.find(notification->wd);
+				if (directory != watches.end() && notification->len > 0 && !(notification->mask & IN_ISDIR))
+				{
+					changed.insert(directory->second + "/" + notification->name);
+				}
+			}
+		}
+
+		changedFiles->assign(changed.begin(), changed.end());
+		return;
+	}
+#endif
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (directories.empty() || now - lastScan < std::chrono::milliseconds(500))
+	{
+		return;
+	}
+	lastScan = now;
+
+	for (size_t i = 0; i < directories.size(); i++)
+	{
+		std::vector<std::string> files = ImageDecoder::ListFiles(directories[i]);
+		for (size_t j = 0; j < files.size(); j++)
+		{
+			long long time = GetModificationTime(files[j]);
+			std::map<std::string, long long>::iterator known = modificationTimes.find(files[j]);
+			if (known == modificationTimes.end() || known->second != time)
+			{
+				modificationTimes[files[j]] = time;
+				changed.insert(files[j]);
+			}
+		}
+	}
+
+	changedFiles->assign(changed.begin(), changed.end());
+}
+
+long long FileWatcher::GetModificationTime(const std::string& fileLocation)
+{
+	struct stat info;
+	if (stat(fileLocation.c_str(), &info) != 0)
+	{
+		return 0;
+	}
+	return (long long)info.st_mtime;
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+	if (inotifyFd >= 0)
+	{
+		close(inotifyFd);
+	}
+#endif
+}
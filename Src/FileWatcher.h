@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Tell which files of some directories were written since the last Poll, for the hot reload of the shaders
+// and the textures. On Linux the kernel reports them with inotify, the directories are watched rather than
+// the files because editors often save by renaming a new file over the old one. Elsewhere the modification
+// times are compared twice a second
+class FileWatcher
+{
+public:
+	FileWatcher();
+
+	bool Init();
+	// Not recursive. The changed files are given as directory + "/" + name
+	bool WatchDirectory(const std::string& directory);
+
+	// Non blocking, each file changed since the last call is given once
+	void Poll(std::vector<std::string>* changedFiles);
+
+	~FileWatcher();
+
+private:
+	static long long GetModificationTime(const std::string& fileLocation);
+
+	int inotifyFd;
+	// Watch descriptor to directory
+	std::map<int, std::string> watches;
+
+	// Fallback without inotify
+	std::vector<std::string> directories;
+	std::map<std::string, long long> modificationTimes;
+	std::chrono::steady_clock::time_point lastScan;
+};
@@ -0,0 +1,74 @@
+#include "FrameQueue.h"
+
+FrameQueue::FrameQueue()
+{
+	readIndex = 0;
+	writtenCount = 0;
+	closed = false;
+}
+
+void FrameQueue::Init(size_t packetCount)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	packets.assign(packetCount > 0 ? packetCount : 1, FramePacket());
+	readIndex = 0;
+	writtenCount = 0;
+	closed = false;
+}
+
+FramePacket* FrameQueue::BeginWrite()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() { return closed || writtenCount < packets.size(); });
+	if (closed)
+	{
+		return nullptr;
+	}
+
+	// Only this thread adds packets, the slot stays free until EndWrite
+	return &packets[(readIndex + writtenCount) % packets.size()];
+}
+
+void FrameQueue::EndWrite()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		writtenCount++;
+	}
+	changed.notify_all();
+}
+
+const FramePacket* FrameQueue::BeginRead()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() { return closed || writtenCount > 0; });
+	if (closed)
+	{
+		return nullptr;
+	}
+
+	return &packets[readIndex];
+}
+
+void FrameQueue::EndRead()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		readIndex = (readIndex + 1) % packets.size();
+		writtenCount--;
+	}
+	changed.notify_all();
+}
+
+void FrameQueue::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+	}
+	changed.notify_all();
+}
+
+FrameQueue::~FrameQueue()
+{
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Everything the render thread needs from the simulation to draw one frame.
+// Filled by the simulation thread, never changed once queued.
+// There is no list of visible draws: the pyramids and the floor are always drawn and the turtle is culled
+// (LOD and meshlets) by the render thread, through the job system, since its meshes and cullers are created
+// there by the uploads of the asset loader. The only light that moves is the flash light, its state is below
+struct FramePacket
+{
+	// Simulation time covered by this frame, a whole number of fixed steps
+	float deltaTime;
+	// Where the frame is between the previous step and the last one, from 0 to 1. The render thread
+	// blends the previous values with the current ones so the motion stays smooth at any frame rate
+	float interpolation;
+
+	glm::mat4 viewMatrix;
+	glm::vec3 cameraPosition;
+	glm::vec3 previousCameraPosition;
+	glm::vec3 cameraDirection;
+
+	// pyramid 1, pyramid 2, floor, turtle
+	glm::mat4 sceneTransforms[4];
+	glm::mat4 previousTransforms[4];
+
+	// The flash light follows the camera
+	bool flashLightOn;
+	glm::vec3 flashPosition;
+	// 2 soft shadows, 1 hard shadows, 0 no shadow pass at all
+	int shadowQuality;
+
+	// Key presses for the state owned by the render thread, each one is seen by a single frame
+	bool switchShading;
+	bool printStats;
+};
+
+// Fixed ring of packets between the simulation thread and the render thread. With 2 of them the simulation
+// writes the next frame while the previous one is drawn, and waits if it gets a whole frame ahead
+class FrameQueue
+{
+public:
+	FrameQueue();
+
+	void Init(size_t packetCount = 2);
+
+	// Simulation thread: the packet to fill, after waiting for a free one. nullptr once closed
+	FramePacket* BeginWrite();
+	void EndWrite();
+
+	// Render thread: the oldest packet written, after waiting for one. nullptr once closed
+	const FramePacket* BeginRead();
+	// The packet goes back to the simulation thread, it must not be read after
+	void EndRead();
+
+	// Wake up both threads for good, on exit
+	void Close();
+
+	~FrameQueue();
+
+private:
+	std::vector<FramePacket> packets;
+	// Oldest packet written, the one read between BeginRead and EndRead
+	size_t readIndex;
+	// Packets written and not given back by EndRead yet
+	size_t writtenCount;
+	bool closed;
+
+	std::mutex mutex;
+	std::condition_variable changed;
+};
@@ -0,0 +1,402 @@
+#include "GeometryPool.h"
+
+#include <string.h>
+
+#include "CommonValues.h"
+#include "DebugLayer.h"
+
+GeometryPool::GeometryPool()
+{
+	IBOs[0] = IBOs[1] = 0;
+	indexCounts[0] = indexCounts[1] = 0;
+	drawCommandBuffer = 0;
+	drawDataBuffer = 0;
+
+	vertexCapacity = 0;
+	indexCapacity = 0;
+	drawCapacity = 0;
+	commandCount = 0;
+
+	inFrame = false;
+	storageAlignment = 0;
+	droppedDrawCount = 0;
+	ringFullCount = 0;
+}
+
+bool GeometryPool::IsSupported()
+{
+	// gl_BaseInstance is core in 4.6, before that we need the ARB extension on top of 4.3 (MDI + SSBO)
+	return GLEW_VERSION_4_6 || (GLEW_VERSION_4_3 && GLEW_ARB_shader_draw_parameters);
+}
+
+bool GeometryPool::Init(GLuint maxVertices, GLuint maxIndices, GLuint maxDraws)
+{
+	vertexCapacity = maxVertices;
+	indexCapacity = maxIndices;
+	drawCapacity = maxDraws;
+
+	// Bound to the VAO of every vertex buffer as they are created. The 16 bits indices stay 16 bits,
+	// baseVertex makes them relative to their mesh so they are enough for any mesh split below 65536 vertices
+	glGenBuffers(2, IBOs);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBOs[0]);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLushort) * indexCapacity, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBOs[1]);
+	glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * indexCapacity, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glGenBuffers(1, &drawCommandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * drawCapacity, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glGenBuffers(1, &drawDataBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PerDrawData) * drawCapacity, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	DebugLayer::Label(GL_BUFFER, IBOs[0], "Geometry pool 16 bits indices");
+	DebugLayer::Label(GL_BUFFER, IBOs[1], "Geometry pool 32 bits indices");
+	DebugLayer::Label(GL_BUFFER, drawCommandBuffer, "Geometry pool draw commands");
+	DebugLayer::Label(GL_BUFFER, drawDataBuffer, "Geometry pool draw data");
+
+	drawCommands.reserve(drawCapacity);
+	drawData.reserve(drawCapacity);
+
+	if (RingBuffer::IsSupported())
+	{
+		// Room for every pass of a frame full of draws, plus the padding of the SSBO ranges
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+		size_t passSize = (sizeof(DrawElementsIndirectCommand) + sizeof(PerDrawData)) * drawCapacity + storageAlignment;
+		drawRing.Init(passSize * PASSES_PER_FRAME, "Geometry pool draw ring");
+	}
+
+	return true;
+}
+
+int GeometryPool::AddMesh(const GLfloat* vertices, const unsigned int* indices, unsigned int numVertices, unsigned int numOfIndices)
+{
+	// The full format keeps the floats as they are, it doesn't need the bounds
+	VertexFormat format = VertexFormat::Full();
+	unsigned int meshVertexCount = numVertices / VERTEX_LENGTH;
+	std::vector<unsigned char> vertexData(meshVertexCount * format.GetStride());
+	if (meshVertexCount > 0)
+	{
+		format.Encode(vertices, meshVertexCount, glm::vec3(0.0f), glm::vec3(0.0f), &vertexData[0]);
+	}
+
+	return AddMesh(vertexData.data(), meshVertexCount, format, glm::vec3(0.0f), glm::vec3(0.0f), indices, GL_UNSIGNED_INT, numOfIndices);
+}
+
+int GeometryPool::AddMesh(const void* vertexData, unsigned int meshVertexCount, const VertexFormat& format, glm::vec3 boundsMin, glm::vec3 boundsMax,
+	const void* indexData, GLenum indexType, unsigned int numOfIndices)
+{
+	int bufferIndex = FindVertexBuffer(format, indexType);
+	if (bufferIndex < 0)
+	{
+		return -1;
+	}
+
+	VertexBuffer& buffer = vertexBuffers[bufferIndex];
+	if (buffer.vertexCount + meshVertexCount > vertexCapacity || indexCounts[GetIndexSlot(indexType)] + numOfIndices > indexCapacity)
+	{
+		printf("Geometry pool is full, can't add a mesh of %u vertices and %u indices\n", meshVertexCount, numOfIndices);
+		return -1;
+	}
+
+	GLsizeiptr stride = format.GetStride();
+	glBindBuffer(GL_ARRAY_BUFFER, buffer.VBO);
+	glBufferSubData(GL_ARRAY_BUFFER, stride * buffer.vertexCount, stride * meshVertexCount, vertexData);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Indices stay local to the mesh, baseVertex moves them to the right place in the VBO of the format
+	MeshRange range;
+	range.baseVertex = buffer.vertexCount;
+	range.vertexBuffer = bufferIndex;
+	glm::vec3 scale, offset;
+	format.GetPositionDecode(boundsMin, boundsMax, &scale, &offset);
+	range.positionScale = glm::vec4(scale, format.IsNormalOctahedral() ? 1.0f : 0.0f);
+	range.positionOffset = glm::vec4(offset, 0.0f);
+	buffer.vertexCount += meshVertexCount;
+
+	return AddIndices(range, indexData, numOfIndices);
+}
+
+int GeometryPool::AddMeshLod(int meshId, const void* indexData, unsigned int numOfIndices)
+{
+	if (meshId < 0 || meshId >= (int)meshRanges.size())
+	{
+		printf("Can't add a LOD to mesh %d, it isn't in the geometry pool\n", meshId);
+		return -1;
+	}
+
+	GLenum indexType = vertexBuffers[meshRanges[meshId].vertexBuffer].indexType;
+	if (indexCounts[GetIndexSlot(indexType)] + numOfIndices > indexCapacity)
+	{
+		printf("Geometry pool is full, can't add a LOD of %u indices\n", numOfIndices);
+		return -1;
+	}
+
+	return AddIndices(meshRanges[meshId], indexData, numOfIndices);
+}
+
+int GeometryPool::FindVertexBuffer(const VertexFormat& format, GLenum indexType)
+{
+	for (size_t i = 0; i < vertexBuffers.size(); i++)
+	{
+		if (vertexBuffers[i].format.GetId() == format.GetId() && vertexBuffers[i].indexType == indexType)
+		{
+			return i;
+		}
+	}
+
+	if (IBOs[0] == 0)
+	{
+		return -1;
+	}
+
+	VertexBuffer buffer;
+	buffer.format = format;
+	buffer.indexType = indexType;
+	buffer.vertexCount = 0;
+
+	glGenVertexArrays(1, &buffer.VAO);
+	glBindVertexArray(buffer.VAO);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBOs[GetIndexSlot(indexType)]);
+
+		glGenBuffers(1, &buffer.VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer.VBO);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)format.GetStride() * vertexCapacity, nullptr, GL_STATIC_DRAW);
+
+			// Same layout as a Mesh of this format
+			format.SetupAttributes();
+
+	// Unbind the VAO first so it keeps track of the IBO
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	DebugLayer::Label(GL_VERTEX_ARRAY, buffer.VAO, "Geometry pool");
+	DebugLayer::Label(GL_BUFFER, buffer.VBO, "Geometry pool vertices");
+
+	vertexBuffers.push_back(buffer);
+	return vertexBuffers.size() - 1;
+}
+
+int GeometryPool::AddIndices(MeshRange range, const void* indexData, unsigned int numOfIndices)
+{
+	GLenum indexType = vertexBuffers[range.vertexBuffer].indexType;
+	int slot = GetIndexSlot(indexType);
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IBOs[slot]);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, indexSize * indexCounts[slot], indexSize * numOfIndices, indexData);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	range.firstIndex = indexCounts[slot];
+	range.indexCount = numOfIndices;
+	meshRanges.push_back(range);
+
+	indexCounts[slot] += numOfIndices;
+
+	return meshRanges.size() - 1;
+}
+
+void GeometryPool::BeginFrame()
+{
+	if (drawRing.IsInitialised())
+	{
+		drawRing.BeginFrame();
+		inFrame = true;
+	}
+}
+
+void GeometryPool::EndFrame()
+{
+	if (inFrame)
+	{
+		drawRing.EndFrame();
+		inFrame = false;
+	}
+}
+
+void GeometryPool::BeginDraws()
+{
+	for (size_t i = 0; i < vertexBuffers.size(); i++)
+	{
+		vertexBuffers[i].commands.clear();
+	}
+	commandCount = 0;
+	drawData.clear();
+}
+
+void GeometryPool::AddDraw(int meshId, const glm::mat4& model, const glm::uvec4& texture, const glm::vec4& material)
+{
+	// AddDrawRanges reports an invalid id
+	GLuint firstIndex = 0;
+	GLsizei indexCount = meshId >= 0 && meshId < (int)meshRanges.size() ? meshRanges[meshId].indexCount : 0;
+	AddDrawRanges(meshId, &firstIndex, &indexCount, 1, model, texture, material);
+}
+
+void GeometryPool::AddDrawRanges(int meshId, const GLuint* firstIndices, const GLsizei* indexCounts, size_t rangeCount,
+	const glm::mat4& model, const glm::uvec4& texture, const glm::vec4& material)
+{
+	if (meshId < 0 || meshId >= (int)meshRanges.size())
+	{
+		if (droppedDrawCount++ == 0)
+		{
+			printf("Draw of mesh %d dropped, it isn't in the geometry pool. The next ones are counted in the stats\n", meshId);
+		}
+		return;
+	}
+
+	if (rangeCount == 0)
+	{
+		return;
+	}
+
+	if (commandCount + rangeCount > drawCapacity)
+	{
+		if (droppedDrawCount++ == 0)
+		{
+			printf("Too many draws in the geometry pool, max is %u. The next ones dropped are counted in the stats\n", drawCapacity);
+		}
+		return;
+	}
+
+	const MeshRange& range = meshRanges[meshId];
+	std::vector<DrawElementsIndirectCommand>& commands = vertexBuffers[range.vertexBuffer].commands;
+	for (size_t i = 0; i < rangeCount; i++)
+	{
+		DrawElementsIndirectCommand command;
+		command.count = indexCounts[i];
+		command.instanceCount = 1;
+		command.firstIndex = range.firstIndex + firstIndices[i];
+		command.baseVertex = range.baseVertex;
+		command.baseInstance = drawData.size();
+		commands.push_back(command);
+	}
+	commandCount += rangeCount;
+
+	PerDrawData data;
+	data.model = model;
+	data.texture = texture;
+	data.material = material;
+	data.positionScale = range.positionScale;
+	data.positionOffset = range.positionOffset;
+	drawData.push_back(data);
+}
+
+void GeometryPool::SubmitDraws()
+{
+	if (commandCount == 0)
+	{
+		return;
+	}
+
+	// The commands of each vertex format one after the other, every draw data stays where baseInstance points
+	drawCommands.clear();
+	for (size_t i = 0; i < vertexBuffers.size(); i++)
+	{
+		drawCommands.insert(drawCommands.end(), vertexBuffers[i].commands.begin(), vertexBuffers[i].commands.end());
+	}
+
+	GLintptr commandOffset = 0;
+	if (!WriteDrawsToRing(&commandOffset))
+	{
+		// Orphan the previous content so we don't wait for the previous pass to finish reading it
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * drawCapacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * drawCommands.size(), &drawCommands[0]);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PerDrawData) * drawCapacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(PerDrawData) * drawData.size(), &drawData[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+	}
+
+	for (size_t i = 0; i < vertexBuffers.size(); i++)
+	{
+		GLsizei count = vertexBuffers[i].commands.size();
+		if (count > 0)
+		{
+			glBindVertexArray(vertexBuffers[i].VAO);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, vertexBuffers[i].indexType, (const void*)commandOffset, count, 0);
+			commandOffset += sizeof(DrawElementsIndirectCommand) * count;
+		}
+	}
+	glBindVertexArray(0);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+bool GeometryPool::WriteDrawsToRing(GLintptr* commandOffset)
+{
+	if (!inFrame)
+	{
+		return false;
+	}
+
+	size_t commandSize = sizeof(DrawElementsIndirectCommand) * drawCommands.size();
+	size_t dataSize = sizeof(PerDrawData) * drawData.size();
+
+	GLintptr dataOffset = 0;
+	void* commands = drawRing.Allocate(commandSize, sizeof(GLuint), commandOffset);
+	void* data = commands ? drawRing.Allocate(dataSize, storageAlignment, &dataOffset) : nullptr;
+	if (!data)
+	{
+		if (ringFullCount++ == 0)
+		{
+			printf("The geometry pool draw ring is full for this frame, the pass orphans its buffers instead\n");
+		}
+		return false;
+	}
+
+	// Coherent mapping, the draw below sees it
+	memcpy(commands, &drawCommands[0], commandSize);
+	memcpy(data, &drawData[0], dataSize);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawRing.GetBuffer());
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawRing.GetBuffer(), dataOffset, dataSize);
+	return true;
+}
+
+void GeometryPool::ClearPool()
+{
+	drawRing.Clear();
+	inFrame = false;
+
+	if (drawDataBuffer != 0)
+	{
+		glDeleteBuffers(1, &drawDataBuffer);
+		drawDataBuffer = 0;
+	}
+	if (drawCommandBuffer != 0)
+	{
+		glDeleteBuffers(1, &drawCommandBuffer);
+		drawCommandBuffer = 0;
+	}
+	if (IBOs[0] != 0)
+	{
+		glDeleteBuffers(2, IBOs);
+		IBOs[0] = IBOs[1] = 0;
+	}
+	for (size_t i = 0; i < vertexBuffers.size(); i++)
+	{
+		glDeleteBuffers(1, &vertexBuffers[i].VBO);
+		glDeleteVertexArrays(1, &vertexBuffers[i].VAO);
+	}
+	vertexBuffers.clear();
+
+	meshRanges.clear();
+	drawCommands.clear();
+	drawData.clear();
+	commandCount = 0;
+	indexCounts[0] = indexCounts[1] = 0;
+}
+
+GeometryPool::~GeometryPool()
+{
+	ClearPool();
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "CommonValues.h"
+#include "RingBuffer.h"
+#include "VertexFormat.h"
+
+// Layout expected by glMultiDrawElementsIndirect for each command
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Data read by the *_indirect shaders, must match the std430 DrawData struct. A draw can be split in several
+// commands (one per range of visible meshlets), they all point to its data with their baseInstance
+// (gl_BaseInstance in the shaders, the pool VAO has no instanced attribute so it changes nothing else)
+struct PerDrawData
+{
+	glm::mat4 model;
+	// Where the texture of the draw is, see TextureArray::GetDrawTexture
+	glm::uvec4 texture;
+	// x specular intensity, y shininess
+	glm::vec4 material;
+	// Decode of the vertex format of the mesh, same as the constant attributes Mesh::RenderMesh sets:
+	// pos * positionScale.xyz + positionOffset.xyz, positionScale.w is 1 when the normal is octahedral encoded
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+};
+
+// Every static mesh is sub allocated in the big IBO of its index type and in the VBO of its vertex format, with a VAO
+// per format and index type, so a whole pass can be drawn with one glMultiDrawElementsIndirect per combination in use
+class GeometryPool
+{
+public:
+	GeometryPool();
+
+	static bool IsSupported();
+
+	bool Init(GLuint maxVertices, GLuint maxIndices, GLuint maxDraws);
+
+	// Same parameters as Mesh::CreateMesh, stored as VertexFormat::Full with 32 bits indices.
+	// Return the id of the mesh in the pool or -1 if it's full
+	int AddMesh(const GLfloat* vertices, const unsigned int* indices, unsigned int numVertices, unsigned int numOfIndices);
+	// Vertices already packed with format from the bounds of the mesh and GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	// indices, as Model cooks them
+	int AddMesh(const void* vertexData, unsigned int vertexCount, const VertexFormat& format, glm::vec3 boundsMin, glm::vec3 boundsMax,
+		const void* indexData, GLenum indexType, unsigned int numOfIndices);
+	// Add other indices for the vertices of meshId (a LOD), of the same type as its own, return a new mesh id
+	int AddMeshLod(int meshId, const void* indexData, unsigned int numOfIndices);
+
+	// With ARB_buffer_storage the draws of a frame are written in a persistently mapped ring buffer between
+	// these two, once per frame around every pass using the pool. Without them the buffers are orphaned by each pass
+	void BeginFrame();
+	void EndFrame();
+	// Times a frame waited for the GPU to be done with its part of the ring buffer
+	unsigned int GetStallCount() { return drawRing.GetStallCount(); }
+	// Draws dropped for an invalid mesh id or a full pass, and passes that didn't fit in the ring.
+	// Only the first of each is printed, they happen every frame once they happen
+	unsigned int GetDroppedDrawCount() { return droppedDrawCount; }
+	unsigned int GetRingFullCount() { return ringFullCount; }
+
+	void BeginDraws();
+	// The shadow passes only read the model matrix, the main pass also its texture and material
+	void AddDraw(int meshId, const glm::mat4& model, const glm::uvec4& texture = glm::uvec4(0), const glm::vec4& material = glm::vec4(0.0f));
+	// Only some ranges of the indices of meshId, as given by MeshletCuller::Cull, one command each
+	void AddDrawRanges(int meshId, const GLuint* firstIndices, const GLsizei* indexCounts, size_t rangeCount,
+		const glm::mat4& model, const glm::uvec4& texture = glm::uvec4(0), const glm::vec4& material = glm::vec4(0.0f));
+	void SubmitDraws();
+
+	void ClearPool();
+
+	~GeometryPool();
+
+private:
+	struct MeshRange
+	{
+		GLuint firstIndex;
+		GLuint indexCount;
+		GLint baseVertex;
+		// In vertexBuffers, with the decode of its format for the draw data
+		int vertexBuffer;
+		glm::vec4 positionScale;
+		glm::vec4 positionOffset;
+	};
+
+	// The meshes of one vertex format and index type, drawn by their own glMultiDrawElementsIndirect
+	struct VertexBuffer
+	{
+		VertexFormat format;
+		GLenum indexType;
+		GLuint VAO, VBO;
+		GLuint vertexCount;
+		// Commands of the pass being built
+		std::vector<DrawElementsIndirectCommand> commands;
+	};
+
+	// Shadow pass of the directional light and of each point and spot light, then the main pass
+	static const int PASSES_PER_FRAME = 2 + MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS;
+
+	// Created on the first mesh of the format and index type, -1 if the pool isn't initialised
+	int FindVertexBuffer(const VertexFormat& format, GLenum indexType);
+	// In IBOs and indexCounts
+	static int GetIndexSlot(GLenum indexType) { return indexType == GL_UNSIGNED_SHORT ? 0 : 1; }
+	// range gives the vertices and the decode, its indices are set here
+	int AddIndices(MeshRange range, const void* indexData, unsigned int numOfIndices);
+	// Write the draws of the pass in the ring buffer and bind them, false if it's off or full for this frame
+	bool WriteDrawsToRing(GLintptr* commandOffset);
+
+	// 16 bits indices in the first, 32 bits in the second
+	GLuint IBOs[2];
+	GLuint indexCounts[2];
+	GLuint drawCommandBuffer, drawDataBuffer;
+	// vertexCapacity is for each vertex buffer, indexCapacity for each index type
+	GLuint vertexCapacity, indexCapacity, drawCapacity;
+
+	std::vector<VertexBuffer> vertexBuffers;
+	std::vector<MeshRange> meshRanges;
+	// Commands of every vertex buffer of the pass, SubmitDraws puts them one after the other in drawCommands
+	GLuint commandCount;
+	std::vector<DrawElementsIndirectCommand> drawCommands;
+	std::vector<PerDrawData> drawData;
+
+	RingBuffer drawRing;
+	bool inFrame;
+	GLint storageAlignment;
+
+	unsigned int droppedDrawCount;
+	unsigned int ringFullCount;
+};
@@ -0,0 +1,198 @@
+#include "ImageDecoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+#include "stb_image.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+bool ImageDecoder::ReadFile(const std::string& fileName, std::vector<unsigned char>* data)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data->resize(size > 0 ? (size_t)size : 0);
+	bool read = size > 0 && fread(data->data(), 1, data->size(), file) == data->size();
+	fclose(file);
+	return read;
+}
+
+bool ImageDecoder::Decode(const std::string& fileName, int channels, Image* image)
+{
+	image->width = 0;
+	image->height = 0;
+	image->channels = 0;
+	image->pixels = nullptr;
+
+	std::vector<unsigned char> data;
+	if (!ReadFile(fileName, &data))
+	{
+		printf("Failed to find: %s\n", fileName.c_str());
+		return false;
+	}
+
+	// The failure reason of stb_image is per thread
+	image->pixels = stbi_load_from_memory(data.data(), (int)data.size(), &image->width, &image->height, &image->channels, channels);
+	if (!image->pixels)
+	{
+		printf("Failed to decode: %s. %s\n", fileName.c_str(), stbi_failure_reason());
+		return false;
+	}
+
+	return true;
+}
+
+bool ImageDecoder::DecodeAll(const std::vector<std::string>& fileNames, int channels, ThreadPool* threads, std::vector<Image>* images)
+{
+	images->resize(fileNames.size());
+
+	std::vector<char> decoded(fileNames.size(), 0);
+	std::function<void(size_t)> decode = [&](size_t i)
+	{
+		decoded[i] = Decode(fileNames[i], channels, &(*images)[i]);
+	};
+
+	if (threads)
+	{
+		threads->ParallelFor(fileNames.size(), decode);
+	}
+	else
+	{
+		for (size_t i = 0; i < fileNames.size(); i++)
+		{
+			decode(i);
+		}
+	}
+
+	return std::find(decoded.begin(), decoded.end(), 0) == decoded.end();
+}
+
+void ImageDecoder::Free(Image* image)
+{
+	if (image->pixels)
+	{
+		stbi_image_free(image->pixels);
+		image->pixels = nullptr;
+	}
+}
+
+bool ImageDecoder::IsImageFile(const std::string& fileName)
+{
+	size_t dot = fileName.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return false;
+	}
+
+	std::string extension = fileName.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == "png" || extension == "jpg" || extension == "jpeg" || extension == "tga" || extension == "bmp";
+}
+
+std::vector<std::string> ImageDecoder::ListFiles(const std::string& directory)
+{
+	std::vector<std::string> files;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return files;
+	}
+	do
+	{
+		if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		{
+			files.push_back(directory + "/" + findData.cFileName);
+		}
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (!dir)
+	{
+		return files;
+	}
+	while (dirent* entry = readdir(dir))
+	{
+		if (entry->d_type != DT_DIR)
+		{
+			files.push_back(directory + "/" + entry->d_name);
+		}
+	}
+	closedir(dir);
+#endif
+
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+void ImageDecoder::Benchmark(const std::vector<std::string>& fileNames, ThreadPool* threads, int iterations)
+{
+	// Size of the files and of the decoded images, for the throughput
+	size_t fileBytes = 0;
+	size_t pixelCount = 0;
+	for (size_t i = 0; i < fileNames.size(); i++)
+	{
+		std::vector<unsigned char> data;
+		int width, height, channels;
+		if (ReadFile(fileNames[i], &data) && stbi_info_from_memory(data.data(), (int)data.size(), &width, &height, &channels))
+		{
+			fileBytes += data.size();
+			pixelCount += (size_t)width * height;
+		}
+	}
+
+	printf("Decoding %u images, %.2f MB of files, %.2f Mpixels, %d iterations, %u threads\n", (unsigned int)fileNames.size(),
+		fileBytes / (1024.0f * 1024.0f), pixelCount / 1000000.0f, iterations, threads ? threads->GetThreadCount() + 1 : 1);
+
+	for (int method = 0; method < 3; method++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool failed = false;
+
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			if (method == 0)
+			{
+				// What the textures and the skybox used before: stb_image reading through stdio, one image after the other
+				for (size_t i = 0; i < fileNames.size(); i++)
+				{
+					int width, height, channels;
+					unsigned char* pixels = stbi_load(fileNames[i].c_str(), &width, &height, &channels, 4);
+					failed |= pixels == nullptr;
+					stbi_image_free(pixels);
+				}
+				continue;
+			}
+
+			std::vector<Image> images;
+			failed |= !DecodeAll(fileNames, 4, method == 2 ? threads : nullptr, &images);
+			for (size_t i = 0; i < images.size(); i++)
+			{
+				Free(&images[i]);
+			}
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+		const char* names[] = { "stb_image stdio, serial", "from memory, serial", "from memory, parallel" };
+		printf("  %-24s %8.2f ms  %8.2f MB/s  %8.2f Mpixels/s%s\n", names[method], seconds * 1000.0,
+			fileBytes / (1024.0 * 1024.0) / seconds, pixelCount / 1000000.0 / seconds, failed ? "  (some images failed)" : "");
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Decode PNG, JPG, TGA and BMP files to 8 bits pixels with stb_image. The whole file is read in one go
+// and decoded from memory instead of through stdio callbacks, and independent images are decoded at the
+// same time on a thread pool. stb_image does the JPEG IDCT and colour conversion with SSE2 (NEON on ARM)
+class ImageDecoder
+{
+public:
+	struct Image
+	{
+		int width, height;
+		// Of the file, pixels has the channels given to Decode unless it was 0
+		int channels;
+		// Free with Free or stbi_image_free
+		unsigned char* pixels;
+	};
+
+	// channels 0 keeps the ones of the file. Can be called from any thread
+	static bool Decode(const std::string& fileName, int channels, Image* image);
+	// One task per file on threads, or everything on the calling thread without them.
+	// images gets an entry per file, the ones that failed have no pixels. Return false if any failed
+	static bool DecodeAll(const std::vector<std::string>& fileNames, int channels, ThreadPool* threads, std::vector<Image>* images);
+	static void Free(Image* image);
+
+	static bool IsImageFile(const std::string& fileName);
+	// Every regular file of directory, sorted
+	static std::vector<std::string> ListFiles(const std::string& directory);
+
+	// Decode the images of fileNames iterations times with the stdio stb_image path,
+	// from memory and from memory on threads, and print the throughput of each
+	static void Benchmark(const std::vector<std::string>& fileNames, ThreadPool* threads, int iterations);
+
+private:
+	static bool ReadFile(const std::string& fileName, std::vector<unsigned char>* data);
+};
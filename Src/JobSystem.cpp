@@ -0,0 +1,467 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+
+// Which system and queue the current thread belongs to, -1 for a thread without a queue
+static thread_local JobSystem* currentSystem = nullptr;
+static thread_local int currentQueue = -1;
+
+JobSystem::WorkQueue::WorkQueue()
+{
+	top = 0;
+	bottom = 0;
+	for (long long i = 0; i < CAPACITY; i++)
+	{
+		jobs[i] = nullptr;
+	}
+}
+
+bool JobSystem::WorkQueue::Push(Job* job)
+{
+	long long b = bottom.load(std::memory_order_relaxed);
+	long long t = top.load(std::memory_order_acquire);
+	if (b - t >= CAPACITY)
+	{
+		return false;
+	}
+
+	// Release so a thief reading the new bottom also sees the job
+	jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+JobSystem::Job* JobSystem::WorkQueue::Pop()
+{
+	long long b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last job, a thief may be taking it at the same time
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job* JobSystem::WorkQueue::Steal()
+{
+	long long t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long long b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+	{
+		return nullptr;
+	}
+
+	Job* job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		// Lost the race with the owner or another thief
+		return nullptr;
+	}
+	return job;
+}
+
+JobSystem::JobSystem()
+{
+	queuedCount = 0;
+	stopping = false;
+}
+
+void JobSystem::Start(unsigned int threadCount)
+{
+	Stop();
+
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	stopping = false;
+	for (unsigned int i = 0; i <= threadCount; i++)
+	{
+		queues.push_back(new WorkQueue());
+	}
+
+	currentSystem = this;
+	currentQueue = 0;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i + 1));
+	}
+}
+
+void JobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	workers.clear();
+
+	// Nobody waits on what is left
+	for (size_t i = 0; i < queues.size(); i++)
+	{
+		while (Job* job = queues[i]->Pop())
+		{
+			delete job;
+		}
+		delete queues[i];
+	}
+	queues.clear();
+	for (size_t i = 0; i < sharedJobs.size(); i++)
+	{
+		delete sharedJobs[i];
+	}
+	sharedJobs.clear();
+	queuedCount = 0;
+
+	if (currentSystem == this)
+	{
+		currentSystem = nullptr;
+		currentQueue = -1;
+	}
+}
+
+void JobSystem::Run(const std::function<void()>& job, Counter* counter, Counter* dependency)
+{
+	if (counter)
+	{
+		counter->value.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (queues.empty())
+	{
+		if (dependency)
+		{
+			Wait(dependency);
+		}
+		job();
+		if (counter)
+		{
+			counter->value.fetch_sub(1, std::memory_order_release);
+		}
+		return;
+	}
+
+	Job* queued = new Job();
+	queued->function = job;
+	queued->counter = counter;
+
+	if (dependency)
+	{
+		// Checked under the lock of the counter, its last job queues the waiting ones under the same lock
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (!dependency->IsDone())
+		{
+			dependency->waiting.push_back(queued);
+			return;
+		}
+	}
+
+	Queue(queued);
+}
+
+void JobSystem::Queue(Job* job)
+{
+	if (currentSystem != this || currentQueue < 0 || !queues[currentQueue]->Push(job))
+	{
+		if (currentSystem == this && currentQueue >= 0)
+		{
+			// Our queue is full, no need to go through the others
+			Execute(job);
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		sharedJobs.push_back(job);
+	}
+
+	queuedCount.fetch_add(1, std::memory_order_seq_cst);
+	// Taking the lock makes sure a worker checking queuedCount is either before its check or already waiting
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	jobAvailable.notify_one();
+}
+
+JobSystem::Job* JobSystem::FindJob()
+{
+	if (queuedCount.load(std::memory_order_acquire) == 0)
+	{
+		return nullptr;
+	}
+
+	Job* job = nullptr;
+	int own = currentSystem == this ? currentQueue : -1;
+	if (own >= 0)
+	{
+		job = queues[own]->Pop();
+	}
+
+	if (!job)
+	{
+		std::lock_guard<std::mutex> lock(sharedMutex);
+		if (!sharedJobs.empty())
+		{
+			job = sharedJobs.front();
+			sharedJobs.pop_front();
+		}
+	}
+
+	if (!job)
+	{
+		// Start from the next queue so the thieves don't all fight over the first one
+		size_t count = queues.size();
+		size_t first = own >= 0 ? own + 1 : 0;
+		for (size_t i = 0; i < count && !job; i++)
+		{
+			size_t victim = (first + i) % count;
+			if ((int)victim != own)
+			{
+				job = queues[victim]->Steal();
+			}
+		}
+	}
+
+	if (job)
+	{
+		queuedCount.fetch_sub(1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->function();
+
+	Counter* counter = job->counter;
+	delete job;
+
+	if (counter)
+	{
+		// Counted down under the lock: Wait takes it once the counter is done, so the counter (often on the
+		// stack of the waiting thread) isn't destroyed before we are done with it
+		std::vector<Job*> ready;
+		{
+			std::lock_guard<std::mutex> lock(counter->mutex);
+			if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				ready.swap(counter->waiting);
+			}
+		}
+		for (size_t i = 0; i < ready.size(); i++)
+		{
+			Queue(ready[i]);
+		}
+	}
+}
+
+void JobSystem::Wait(Counter* counter)
+{
+	while (!counter->IsDone())
+	{
+		if (Job* job = FindJob())
+		{
+			Execute(job);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	// The thread running the last job may still hold the lock of the counter
+	std::lock_guard<std::mutex> lock(counter->mutex);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t batchSize, const std::function<void(size_t)>& body)
+{
+	batchSize = std::max(batchSize, (size_t)1);
+	if (queues.empty() || count <= batchSize)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			body(i);
+		}
+		return;
+	}
+
+	// The first batch is run here, the others are queued before it so they can be stolen meanwhile
+	Counter counter;
+	for (size_t begin = batchSize; begin < count; begin += batchSize)
+	{
+		size_t end = std::min(begin + batchSize, count);
+		Run([&body, begin, end]()
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				body(i);
+			}
+		}, &counter);
+	}
+	for (size_t i = 0; i < batchSize; i++)
+	{
+		body(i);
+	}
+
+	// body stays valid since we don't return before every batch is done
+	Wait(&counter);
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+	currentSystem = this;
+	currentQueue = index;
+
+	while (true)
+	{
+		if (Job* job = FindJob())
+		{
+			Execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		jobAvailable.wait(lock, [this]() { return stopping || queuedCount.load(std::memory_order_seq_cst) > 0; });
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
+
+void JobSystem::Benchmark(JobSystem* jobs, ThreadPool* threads, int iterations)
+{
+	// Bounding spheres against the 6 planes of a frustum, like the culling of a big scene
+	const size_t sphereCount = 1 << 20;
+	std::vector<float> spheres(sphereCount * 4);
+	for (size_t i = 0; i < sphereCount; i++)
+	{
+		spheres[i * 4 + 0] = (float)(i % 1024) - 512.0f;
+		spheres[i * 4 + 1] = (float)((i / 1024) % 64) - 32.0f;
+		spheres[i * 4 + 2] = (float)(i / 65536) * 4.0f - 32.0f;
+		spheres[i * 4 + 3] = 0.5f + (float)(i % 7) * 0.25f;
+	}
+	float planes[6][4] = { { 1, 0, 0, 300 }, { -1, 0, 0, 300 }, { 0, 1, 0, 20 }, { 0, -1, 0, 20 }, { 0, 0, 1, 30 }, { 0, 0, -1, 30 } };
+	std::vector<unsigned char> visible(sphereCount);
+
+	// Rows of 1024 spheres per index so a job isn't only its own overhead
+	const size_t rowSize = 1024;
+	const size_t rowCount = sphereCount / rowSize;
+	std::function<void(size_t)> cullRow = [&](size_t row)
+	{
+		for (size_t i = row * rowSize; i < (row + 1) * rowSize; i++)
+		{
+			const float* sphere = &spheres[i * 4];
+			bool inside = true;
+			for (int p = 0; p < 6; p++)
+			{
+				// A bit of extra math to stand in for the rest of an object's update
+				float distance = planes[p][0] * sphere[0] + planes[p][1] * sphere[1] + planes[p][2] * sphere[2] + planes[p][3];
+				inside &= distance > -sphere[3] * sqrtf(1.0f + sphere[3] * 0.001f);
+			}
+			visible[i] = inside;
+		}
+	};
+
+	printf("Culling %u spheres, %d iterations, %u job threads, %u pool threads\n", (unsigned int)sphereCount, iterations,
+		jobs->GetThreadCount() + 1, threads->GetThreadCount() + 1);
+
+	double serialSeconds = 0.0;
+	for (int method = 0; method < 3; method++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			if (method == 0)
+			{
+				for (size_t row = 0; row < rowCount; row++)
+				{
+					cullRow(row);
+				}
+			}
+			else if (method == 1)
+			{
+				threads->ParallelFor(rowCount, cullRow);
+			}
+			else
+			{
+				jobs->ParallelFor(rowCount, 4, cullRow);
+			}
+		}
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+		if (method == 0)
+		{
+			serialSeconds = seconds;
+		}
+		const char* names[] = { "serial", "ThreadPool::ParallelFor", "JobSystem::ParallelFor" };
+		printf("  %-24s %8.3f ms  x%.2f\n", names[method], seconds * 1000.0, serialSeconds / seconds);
+	}
+
+	// What a job costs on its own: queue, steal or pop, run and count down
+	const int emptyJobs = 100000;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Counter counter;
+	for (int i = 0; i < emptyJobs; i++)
+	{
+		jobs->Run([]() {}, &counter);
+		if (i % 1024 == 1023)
+		{
+			// Stay under the size of the queue
+			jobs->Wait(&counter);
+		}
+	}
+	jobs->Wait(&counter);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("  %d empty jobs: %.3f us per job\n", emptyJobs, seconds * 1000000.0 / emptyJobs);
+
+	// A chain of dependencies, each job starting once the previous one is done
+	const int chainLength = 10000;
+	std::vector<Counter> links(chainLength);
+	int order = 0;
+	bool ordered = true;
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < chainLength; i++)
+	{
+		jobs->Run([&order, &ordered, i]()
+		{
+			ordered &= order == i;
+			order++;
+		}, &links[i], i > 0 ? &links[i - 1] : nullptr);
+	}
+	jobs->Wait(&links[chainLength - 1]);
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("  chain of %d dependent jobs: %.3f us per job%s\n", chainLength, seconds * 1000000.0 / chainLength, ordered ? "" : "  (out of order)");
+}
+
+JobSystem::~JobSystem()
+{
+	Stop();
+}
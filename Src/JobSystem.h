@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Work stealing scheduler for the short jobs of a frame (culling, animation, light binning...).
+// Every thread has its own Chase-Lev deque: it pushes and pops its jobs at the bottom without any lock
+// and the idle threads steal the oldest ones from the top of the others. The thread calling Start is
+// one of them, it runs jobs while it waits on a counter instead of sleeping.
+// ThreadPool stays for the long background loads, a job must not block on I/O or use OpenGL
+class JobSystem
+{
+public:
+	struct Job;
+
+	// Number of jobs not finished yet. Wait on it, or give it to Run as the dependency of other jobs.
+	// Must outlive the jobs counted by it and the ones depending on it
+	class Counter
+	{
+	public:
+		Counter() : value(0) {}
+
+		bool IsDone() { return value.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<int> value;
+		// Jobs given to Run with this counter as their dependency, queued once it reaches 0
+		std::mutex mutex;
+		std::vector<Job*> waiting;
+	};
+
+	JobSystem();
+
+	// 0 means one thread per core minus the calling thread
+	void Start(unsigned int threadCount = 0);
+	void Stop();
+
+	unsigned int GetThreadCount() { return workers.size(); }
+
+	// Run job on any thread. counter is incremented now and decremented once the job is done.
+	// The job only starts once dependency is done. Run it right away if the system isn't started
+	void Run(const std::function<void()>& job, Counter* counter = nullptr, Counter* dependency = nullptr);
+
+	// Return once counter is done, running the queued jobs meanwhile
+	void Wait(Counter* counter);
+
+	// Call body(i) for every i in [0, count), in jobs of batchSize indices, and wait for all of them
+	void ParallelFor(size_t count, size_t batchSize, const std::function<void(size_t)>& body);
+
+	// --benchmark-jobs: cost of an empty job, and a culling like loop run serially, with ThreadPool::ParallelFor and with the jobs
+	static void Benchmark(JobSystem* jobs, ThreadPool* threads, int iterations);
+
+	~JobSystem();
+
+	// The deque is public so Tests/JobSystemTests.cpp can check it on its own
+	struct Job
+	{
+		std::function<void()> function;
+		Counter* counter;
+	};
+
+	// Chase and Lev, "Dynamic Circular Work-Stealing Deque", with the memory orders of Lê et al. 2013.
+	// Fixed size, Push fails once it's full and the job is run in place
+	class WorkQueue
+	{
+	public:
+		WorkQueue();
+
+		// Owner thread only
+		bool Push(Job* job);
+		Job* Pop();
+		// Any thread
+		Job* Steal();
+
+		static const long long CAPACITY = 4096;
+
+	private:
+		std::atomic<long long> top;
+		std::atomic<long long> bottom;
+		std::atomic<Job*> jobs[CAPACITY];
+	};
+
+private:
+	void Queue(Job* job);
+	Job* FindJob();
+	void Execute(Job* job);
+	void WorkerLoop(int index);
+
+	// queues[0] belongs to the thread that called Start, queues[i + 1] to workers[i]
+	std::vector<WorkQueue*> queues;
+	std::vector<std::thread> workers;
+
+	// Jobs given by threads without a queue, like the loader threads
+	std::deque<Job*> sharedJobs;
+	std::mutex sharedMutex;
+
+	// Jobs queued and not taken yet, the workers sleep while it's 0
+	std::atomic<int> queuedCount;
+	std::mutex sleepMutex;
+	std::condition_variable jobAvailable;
+	std::atomic<bool> stopping;
+};
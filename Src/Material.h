@@ -7,6 +7,9 @@ public:
 	Material(GLfloat sIntensity, GLfloat shine);
 
 	void UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation);
+	// For the per draw data of the indirect draws
+	GLfloat GetSpecularIntensity() { return specularIntensity; }
+	GLfloat GetShininess() { return shininess; }
 	~Material();
 
 private:
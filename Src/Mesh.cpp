@@ -1,37 +1,87 @@
 #include "Mesh.h"
 
+#include <vector>
+
+#include "CommonValues.h"
+
 Mesh::Mesh()
 {
 	VAO = 0;
 	VBO = 0;
 	IBO = 0;
-	indexCount = 0;
+	indexType = GL_UNSIGNED_INT;
+	positionScale = glm::vec3(1.0f);
+	positionOffset = glm::vec3(0.0f);
+	octahedralNormal = false;
 }
 
-void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numVertices, unsigned int numOfIndices)
+void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int numVertices, unsigned int numOfIndices, const VertexFormat& format)
 {
-	indexCount = numOfIndices;
+	std::vector<std::vector<unsigned int>> lodIndices(1);
+	lodIndices[0].assign(indices, indices + numOfIndices);
+
+	CreateMesh(vertices, numVertices, lodIndices, format);
+}
+
+void Mesh::CreateMesh(GLfloat* vertices, unsigned int numVertices, const std::vector<std::vector<unsigned int>>& lodIndices, const VertexFormat& format)
+{
+	unsigned int vertexCount = numVertices / VERTEX_LENGTH;
+
+	// Bounds are needed for the quantised positions
+	glm::vec3 boundsMin, boundsMax;
+	CalculateBounds(vertices, vertexCount, &boundsMin, &boundsMax);
+
+	std::vector<unsigned char> packedVertices(vertexCount * format.GetStride());
+	if (vertexCount > 0)
+	{
+		format.Encode(vertices, vertexCount, boundsMin, boundsMax, &packedVertices[0]);
+	}
+
+	std::vector<unsigned char> indexData;
+	GLenum type = BuildIndexBuffer(lodIndices, vertexCount, &indexData);
+
+	std::vector<GLsizei> counts;
+	for (size_t i = 0; i < lodIndices.size(); i++)
+	{
+		counts.push_back(lodIndices[i].size());
+	}
+
+	CreateMesh(packedVertices.data(), vertexCount, indexData.data(), type, counts.data(), counts.size(), boundsMin, boundsMax, format);
+}
+
+void Mesh::CreateMesh(const void* vertexData, unsigned int vertexCount, const void* indexData, GLenum indexType, const GLsizei* lodIndexCounts, unsigned int lodCount,
+					glm::vec3 boundsMin, glm::vec3 boundsMax, const VertexFormat& format)
+{
+	format.GetPositionDecode(boundsMin, boundsMax, &positionScale, &positionOffset);
+	octahedralNormal = format.IsNormalOctahedral();
+
+	this->indexType = indexType;
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+	// Put the LODs one after the other
+	this->lodIndexCounts.clear();
+	lodFirstIndices.clear();
+	GLuint indexCount = 0;
+	for (unsigned int i = 0; i < lodCount; i++)
+	{
+		lodFirstIndices.push_back(indexCount);
+		this->lodIndexCounts.push_back(lodIndexCounts[i]);
+		indexCount += lodIndexCounts[i];
+	}
 
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
 
 		glGenBuffers(1, &IBO);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * numOfIndices, indices, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize * indexCount, indexData, GL_STATIC_DRAW);
 
 			glGenBuffers(1, &VBO);
 			glBindBuffer(GL_ARRAY_BUFFER, VBO);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * numVertices, vertices, GL_STATIC_DRAW);
-
-				// Handle 3 first values that are position
-				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, 0);
-				glEnableVertexAttribArray(0);
-				// Handle 2 next values that are UV values (coordinates of texture)
-				glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 3));
-				glEnableVertexAttribArray(1);
-				// Handle the 3 next values that are the normal vector of the vertex
-				glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, (void*)(sizeof(vertices[0]) * 5));
-				glEnableVertexAttribArray(2);
+			glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCount * format.GetStride(), vertexData, GL_STATIC_DRAW);
+
+				// position (0), UV (1) and normal (2) in the layout of the format
+				format.SetupAttributes();
 
 			glBindBuffer(GL_ARRAY_BUFFER, 0);
 
@@ -40,11 +90,106 @@ void Mesh::CreateMesh(GLfloat* vertices, unsigned int* indices, unsigned int num
 	glBindVertexArray(0);
 }
 
+GLenum Mesh::BuildIndexBuffer(const std::vector<std::vector<unsigned int>>& lodIndices, unsigned int vertexCount, std::vector<unsigned char>* indexData)
+{
+	size_t indexCount = 0;
+	for (size_t i = 0; i < lodIndices.size(); i++)
+	{
+		indexCount += lodIndices[i].size();
+	}
+
+	// Half the index bandwidth and memory when 16 bits are enough
+	if (vertexCount <= MAX_SHORT_INDEX_VERTICES)
+	{
+		indexData->resize(indexCount * sizeof(GLushort));
+		GLushort* out = (GLushort*)indexData->data();
+		for (size_t i = 0; i < lodIndices.size(); i++)
+		{
+			for (size_t j = 0; j < lodIndices[i].size(); j++)
+			{
+				*out++ = (GLushort)lodIndices[i][j];
+			}
+		}
+		return GL_UNSIGNED_SHORT;
+	}
+
+	indexData->resize(indexCount * sizeof(GLuint));
+	GLuint* out = (GLuint*)indexData->data();
+	for (size_t i = 0; i < lodIndices.size(); i++)
+	{
+		for (size_t j = 0; j < lodIndices[i].size(); j++)
+		{
+			*out++ = lodIndices[i][j];
+		}
+	}
+	return GL_UNSIGNED_INT;
+}
+
+void Mesh::CalculateBounds(const GLfloat* vertices, unsigned int vertexCount, glm::vec3* boundsMin, glm::vec3* boundsMax)
+{
+	*boundsMin = glm::vec3(0.0f);
+	*boundsMax = glm::vec3(0.0f);
+	if (vertexCount > 0)
+	{
+		*boundsMin = *boundsMax = glm::vec3(vertices[0], vertices[1], vertices[2]);
+	}
+	for (size_t i = 1; i < vertexCount; i++)
+	{
+		glm::vec3 pos(vertices[i * VERTEX_LENGTH], vertices[i * VERTEX_LENGTH + 1], vertices[i * VERTEX_LENGTH + 2]);
+		*boundsMin = glm::min(*boundsMin, pos);
+		*boundsMax = glm::max(*boundsMax, pos);
+	}
+}
+
 void Mesh::RenderMesh()
 {
+	RenderMesh(0);
+}
+
+void Mesh::RenderMesh(unsigned int lod)
+{
+	if (lodIndexCounts.empty())
+	{
+		return;
+	}
+	if (lod >= lodIndexCounts.size())
+	{
+		lod = lodIndexCounts.size() - 1;
+	}
+
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+	// Not part of the VAO state, these are constant attributes shared by all vertices of the draw
+	glVertexAttrib4f(VERTEX_ATTRIB_POSITION_SCALE, positionScale.x, positionScale.y, positionScale.z, octahedralNormal ? 1.0f : 0.0f);
+	glVertexAttrib4f(VERTEX_ATTRIB_POSITION_OFFSET, positionOffset.x, positionOffset.y, positionOffset.z, 0.0f);
+
+	glBindVertexArray(VAO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+			glDrawElements(GL_TRIANGLES, lodIndexCounts[lod], indexType, (void*)(lodFirstIndices[lod] * indexSize));
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+void Mesh::RenderRanges(const GLuint* firstIndices, const GLsizei* indexCounts, GLsizei rangeCount)
+{
+	if (rangeCount == 0)
+	{
+		return;
+	}
+
+	GLsizeiptr indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	rangeOffsets.resize(rangeCount);
+	for (GLsizei i = 0; i < rangeCount; i++)
+	{
+		rangeOffsets[i] = (const void*)(firstIndices[i] * indexSize);
+	}
+
+	glVertexAttrib4f(VERTEX_ATTRIB_POSITION_SCALE, positionScale.x, positionScale.y, positionScale.z, octahedralNormal ? 1.0f : 0.0f);
+	glVertexAttrib4f(VERTEX_ATTRIB_POSITION_OFFSET, positionOffset.x, positionOffset.y, positionOffset.z, 0.0f);
+
 	glBindVertexArray(VAO);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-			glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+			glMultiDrawElements(GL_TRIANGLES, indexCounts, indexType, &rangeOffsets[0], rangeCount);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
@@ -67,7 +212,9 @@ void Mesh::ClearMesh()
 		VAO = 0;
 	}
 
-	indexCount = 0;
+	lodIndexCounts.clear();
+	lodFirstIndices.clear();
+	indexType = GL_UNSIGNED_INT;
 }
 
 Mesh::~Mesh()
@@ -1,18 +1,49 @@
 #pragma once
+#include <vector>
+
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+
 class Mesh
 {
 public:
 	Mesh();
 
-	void CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numVertices, unsigned int numOfIndices);
+	// vertices are always given as x, y, z, u, v, nx, ny, nz floats, format is how they are stored on the GPU
+	void CreateMesh(GLfloat *vertices, unsigned int *indices, unsigned int numVertices, unsigned int numOfIndices, const VertexFormat& format = VertexFormat());
+	// Every LOD uses the same vertices with its own indices, lodIndices[0] is the full detail mesh
+	void CreateMesh(GLfloat *vertices, unsigned int numVertices, const std::vector<std::vector<unsigned int>>& lodIndices, const VertexFormat& format = VertexFormat());
+	// Already packed data: vertexCount vertices encoded with format using the bounds, indices of every LOD one after the other
+	void CreateMesh(const void* vertexData, unsigned int vertexCount, const void* indexData, GLenum indexType, const GLsizei* lodIndexCounts, unsigned int lodCount,
+					glm::vec3 boundsMin, glm::vec3 boundsMax, const VertexFormat& format);
 	void RenderMesh();
+	void RenderMesh(unsigned int lod);
+	// Draw only some ranges of the index buffer (the visible meshlets) with one glMultiDrawElements
+	void RenderRanges(const GLuint* firstIndices, const GLsizei* indexCounts, GLsizei rangeCount);
 	void ClearMesh();
 
+	unsigned int GetLodCount() { return lodIndexCounts.size(); }
+
+	// Content of the IBO for these LODs, return GL_UNSIGNED_SHORT if the vertices can be indexed with 16 bits
+	static GLenum BuildIndexBuffer(const std::vector<std::vector<unsigned int>>& lodIndices, unsigned int vertexCount, std::vector<unsigned char>* indexData);
+	static void CalculateBounds(const GLfloat* vertices, unsigned int vertexCount, glm::vec3* boundsMin, glm::vec3* boundsMax);
+
 	~Mesh();
 
 private:
 	GLuint VAO, VBO, IBO;
-	GLsizei indexCount;
-};
+	// GL_UNSIGNED_SHORT whenever the vertices can be indexed with 16 bits
+	GLenum indexType;
+
+	// All the LODs are stored one after the other in the IBO
+	std::vector<GLsizei> lodIndexCounts;
+	std::vector<GLuint> lodFirstIndices;
+	// Byte offsets given to glMultiDrawElements, kept to not allocate every frame
+	std::vector<const void*> rangeOffsets;
 
+	// Sent to the vertex shader to decode quantised positions and octahedral normals
+	glm::vec3 positionScale, positionOffset;
+	bool octahedralNormal;
+};
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "MeshCache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MeshCache::MeshCache()
+{
+	mappedData = nullptr;
+	mappedSize = 0;
+	readOffset = 0;
+	valid = false;
+
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+#else
+	fileDescriptor = -1;
+#endif
+}
+
+unsigned long long MeshCache::HashFile(const std::string& fileName)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return 0;
+	}
+
+	unsigned long long hash = 14695981039346656037ull;
+	unsigned char buffer[64 * 1024];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		for (size_t i = 0; i < read; i++)
+		{
+			hash = (hash ^ buffer[i]) * 1099511628211ull;
+		}
+	}
+
+	fclose(file);
+	return hash;
+}
+
+unsigned long long MeshCache::HashValue(unsigned long long hash, unsigned long long value)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 1099511628211ull;
+	}
+	return hash;
+}
+
+unsigned long long MeshCache::HashData(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+void MeshCache::BeginWrite(unsigned long long key)
+{
+	writeBuffer.clear();
+
+	Header header;
+	memcpy(header.magic, "SMSH", 4);
+	header.version = VERSION;
+	header.key = key;
+	WriteValue(header);
+}
+
+void MeshCache::WriteBlock(const void* data, size_t size)
+{
+	// Size on 8 bytes, padding to keep the data aligned, then the data padded to the next block
+	size_t offset = writeBuffer.size();
+	writeBuffer.resize(offset + ALIGNMENT + ((size + ALIGNMENT - 1) & ~(ALIGNMENT - 1)), 0);
+
+	unsigned long long blockSize = size;
+	memcpy(&writeBuffer[offset], &blockSize, sizeof(blockSize));
+	if (size > 0)
+	{
+		memcpy(&writeBuffer[offset + ALIGNMENT], data, size);
+	}
+}
+
+bool MeshCache::Save(const std::string& fileName)
+{
+	// Write to a temporary file first so a crash never leaves a half written cache behind
+	std::string tempName = fileName + ".tmp";
+	FILE* file = fopen(tempName.c_str(), "wb");
+	if (!file)
+	{
+		printf("Can't write mesh cache %s\n", tempName.c_str());
+		return false;
+	}
+
+	bool written = fwrite(writeBuffer.data(), 1, writeBuffer.size(), file) == writeBuffer.size();
+	fclose(file);
+
+	remove(fileName.c_str());
+	if (!written || rename(tempName.c_str(), fileName.c_str()) != 0)
+	{
+		printf("Can't write mesh cache %s\n", fileName.c_str());
+		remove(tempName.c_str());
+		return false;
+	}
+
+	writeBuffer.clear();
+	writeBuffer.shrink_to_fit();
+	return true;
+}
+
+bool MeshCache::Open(const std::string& fileName, unsigned long long key)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	fileHandle = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	mappedSize = (size_t)size.QuadPart;
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle)
+	{
+		Close();
+		return false;
+	}
+
+	mappedData = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+	fileDescriptor = open(fileName.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fileDescriptor, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	mappedSize = (size_t)fileStat.st_size;
+
+	void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	mappedData = mapping == MAP_FAILED ? nullptr : (const unsigned char*)mapping;
+#endif
+
+	if (!mappedData)
+	{
+		Close();
+		return false;
+	}
+
+	readOffset = 0;
+	valid = true;
+
+	Header header = ReadValue<Header>();
+	if (!valid || memcmp(header.magic, "SMSH", 4) != 0 || header.version != VERSION || header.key != key)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+const void* MeshCache::ReadBlock(size_t* size)
+{
+	*size = 0;
+	if (!valid || readOffset + ALIGNMENT > mappedSize)
+	{
+		valid = false;
+		return nullptr;
+	}
+
+	unsigned long long blockSize;
+	memcpy(&blockSize, mappedData + readOffset, sizeof(blockSize));
+
+	size_t paddedSize = (blockSize + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	if (blockSize > mappedSize || readOffset + ALIGNMENT + paddedSize > mappedSize)
+	{
+		valid = false;
+		return nullptr;
+	}
+
+	const void* data = mappedData + readOffset + ALIGNMENT;
+	readOffset += ALIGNMENT + paddedSize;
+
+	*size = blockSize;
+	return data;
+}
+
+void MeshCache::Close()
+{
+#ifdef _WIN32
+	if (mappedData)
+	{
+		UnmapViewOfFile(mappedData);
+	}
+	if (mappingHandle)
+	{
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (mappedData)
+	{
+		munmap((void*)mappedData, mappedSize);
+	}
+	if (fileDescriptor >= 0)
+	{
+		close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+#endif
+
+	mappedData = nullptr;
+	mappedSize = 0;
+	readOffset = 0;
+	valid = false;
+}
+
+MeshCache::~MeshCache()
+{
+	Close();
+}
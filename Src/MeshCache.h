@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Cooked binary file holding everything Model builds from an imported file, so Assimp and the
+// mesh processing only run once. The file is a list of blocks aligned on 16 bytes, read back
+// with a single memory mapping so the vertex and index blobs go to glBufferData without copy.
+class MeshCache
+{
+public:
+	MeshCache();
+
+	// FNV-1a of the content of a file, 0 if it can't be read
+	static unsigned long long HashFile(const std::string& fileName);
+	static unsigned long long HashValue(unsigned long long hash, unsigned long long value);
+	static unsigned long long HashData(unsigned long long hash, const void* data, size_t size);
+
+	// Writing: blocks are appended in memory then Save writes the whole file
+	void BeginWrite(unsigned long long key);
+	void WriteBlock(const void* data, size_t size);
+	template<class T> void WriteValue(const T& value) { WriteBlock(&value, sizeof(T)); }
+	void WriteString(const std::string& value) { WriteBlock(value.data(), value.size()); }
+	bool Save(const std::string& fileName);
+
+	// Reading: fails if the file doesn't exist or was cooked with another key.
+	// The pointers returned stay valid until Close
+	bool Open(const std::string& fileName, unsigned long long key);
+	const void* ReadBlock(size_t* size);
+	template<class T> T ReadValue()
+	{
+		size_t size;
+		const void* data = ReadBlock(&size);
+		if (!data || size != sizeof(T))
+		{
+			valid = false;
+			return T();
+		}
+		return *(const T*)data;
+	}
+	std::string ReadString()
+	{
+		size_t size;
+		const char* data = (const char*)ReadBlock(&size);
+		return data ? std::string(data, size) : std::string();
+	}
+	// False if a block went past the end of the file
+	bool IsValid() { return valid; }
+	// Most blocks the rest of the file can hold, each one takes at least its size field.
+	// A count read from the file must be checked against it before anything is allocated for it
+	size_t GetMaxBlockCount() { return valid ? (mappedSize - readOffset) / ALIGNMENT : 0; }
+	void Close();
+
+	~MeshCache();
+
+private:
+	struct Header
+	{
+		char magic[4];
+		unsigned int version;
+		unsigned long long key;
+	};
+
+	static const unsigned int VERSION = 1;
+	static const size_t ALIGNMENT = 16;
+
+	std::vector<unsigned char> writeBuffer;
+
+	const unsigned char* mappedData;
+	size_t mappedSize;
+	size_t readOffset;
+	bool valid;
+
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
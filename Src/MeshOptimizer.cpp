@@ -0,0 +1,420 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+float MeshOptimizer::CalculateACMR(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return 0.0f;
+	}
+
+	// A vertex is in the FIFO cache if it was added less than cacheSize misses ago
+	std::vector<size_t> cacheTimestamps(vertexCount, 0);
+	size_t timestamp = cacheSize + 1;
+	size_t misses = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int index = indices[i];
+		if (timestamp - cacheTimestamps[index] > cacheSize)
+		{
+			cacheTimestamps[index] = timestamp++;
+			misses++;
+		}
+	}
+
+	return (float)misses / (float)triangleCount;
+}
+
+float MeshOptimizer::VertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+	// Values from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+	const float cacheDecayPower = 1.5f;
+	const float lastTriangleScore = 0.75f;
+	const float valenceBoostScale = 2.0f;
+	const float valenceBoostPower = 0.5f;
+
+	if (remainingTriangles == 0)
+	{
+		// no triangle left to draw with this vertex
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		if (cachePosition < 3)
+		{
+			// used by the last triangle, a fixed score avoid to favor strips too much
+			score = lastTriangleScore;
+		}
+		else
+		{
+			float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cachePosition - 3) * scaler, cacheDecayPower);
+		}
+	}
+
+	// Boost the vertices with few triangles left so we don't leave lonely triangles behind
+	score += valenceBoostScale * std::pow((float)remainingTriangles, -valenceBoostPower);
+
+	return score;
+}
+
+void MeshOptimizer::OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Adjacency: triangles that use each vertex
+	std::vector<unsigned int> triangleCounts(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		triangleCounts[indices[i]]++;
+	}
+
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + triangleCounts[v];
+	}
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			adjacency[fillOffsets[indices[t * 3 + k]]++] = t;
+		}
+	}
+
+	// Initial scores
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<unsigned int> remaining(triangleCounts);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		vertexScores[v] = VertexScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> triangleAdded(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<unsigned int> output(triangleCount * 3);
+	size_t outputTriangles = 0;
+
+	// LRU cache, 3 extra slots for the vertices of the triangle we are adding
+	unsigned int cache[VERTEX_CACHE_SIZE + 3];
+	unsigned int newCache[VERTEX_CACHE_SIZE + 3];
+	int cacheCount = 0;
+
+	size_t scanCursor = 0;
+	int bestTriangle = -1;
+
+	while (outputTriangles < triangleCount)
+	{
+		if (bestTriangle < 0)
+		{
+			// Nothing left in the cache neighbourhood, take the next triangle not drawn yet
+			while (triangleAdded[scanCursor])
+			{
+				scanCursor++;
+			}
+			bestTriangle = scanCursor;
+		}
+
+		unsigned int* tri = indices + bestTriangle * 3;
+		memcpy(&output[outputTriangles * 3], tri, sizeof(unsigned int) * 3);
+		outputTriangles++;
+		triangleAdded[bestTriangle] = true;
+
+		// Remove the triangle from the adjacency of its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = tri[k];
+			unsigned int* begin = &adjacency[adjacencyOffsets[v]];
+			unsigned int* end = begin + remaining[v];
+			unsigned int* found = std::find(begin, end, (unsigned int)bestTriangle);
+			if (found != end)
+			{
+				*found = *(end - 1);
+				remaining[v]--;
+			}
+		}
+
+		// Move the triangle vertices to the front of the cache
+		int newCacheCount = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			newCache[newCacheCount++] = tri[k];
+		}
+		for (int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+			{
+				newCache[newCacheCount++] = v;
+			}
+		}
+
+		// Vertices pushed out of the cache lose their cache score
+		for (int i = VERTEX_CACHE_SIZE; i < newCacheCount; i++)
+		{
+			cachePositions[newCache[i]] = -1;
+			vertexScores[newCache[i]] = VertexScore(-1, remaining[newCache[i]]);
+		}
+
+		cacheCount = std::min(newCacheCount, (int)VERTEX_CACHE_SIZE);
+		memcpy(cache, newCache, sizeof(unsigned int) * cacheCount);
+
+		for (int i = 0; i < cacheCount; i++)
+		{
+			cachePositions[cache[i]] = i;
+			vertexScores[cache[i]] = VertexScore(i, remaining[cache[i]]);
+		}
+
+		// Update the triangles around the cache and find the best one for the next iteration
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; i++)
+		{
+			unsigned int v = cache[i];
+			for (unsigned int a = 0; a < remaining[v]; a++)
+			{
+				unsigned int t = adjacency[adjacencyOffsets[v] + a];
+				float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				triangleScores[t] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					bestTriangle = t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, &output[0], sizeof(unsigned int) * triangleCount * 3);
+}
+
+void MeshOptimizer::OptimizeOverdraw(unsigned int* indices, size_t indexCount, const GLfloat* vertices, size_t vertexCount, unsigned int vertexLength, float threshold)
+{
+	const unsigned int cacheSize = 16;
+
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	float acmrBefore = CalculateACMR(indices, indexCount, vertexCount, cacheSize);
+
+	// Split the triangles in clusters where the cache is fully cold: a triangle with 3 misses
+	// starts a new cluster, so moving the clusters around barely change the cache efficiency
+	std::vector<size_t> clusterStarts;
+	std::vector<size_t> cacheTimestamps(vertexCount, 0);
+	size_t timestamp = cacheSize + 1;
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		int misses = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int index = indices[t * 3 + k];
+			if (timestamp - cacheTimestamps[index] > cacheSize)
+			{
+				cacheTimestamps[index] = timestamp++;
+				misses++;
+			}
+		}
+
+		if (t == 0 || misses == 3)
+		{
+			clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+
+	size_t clusterCount = clusterStarts.size() - 1;
+	if (clusterCount < 2)
+	{
+		return;
+	}
+
+	// Cluster position and orientation, weighted by the triangle areas
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float clusterArea = 0.0f;
+
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const GLfloat* p0 = vertices + indices[t * 3] * vertexLength;
+			const GLfloat* p1 = vertices + indices[t * 3 + 1] * vertexLength;
+			const GLfloat* p2 = vertices + indices[t * 3 + 2] * vertexLength;
+
+			glm::vec3 v0(p0[0], p0[1], p0[2]);
+			glm::vec3 v1(p1[0], p1[1], p1[2]);
+			glm::vec3 v2(p2[0], p2[1], p2[2]);
+
+			glm::vec3 areaNormal = glm::cross(v1 - v0, v2 - v0);
+			float area = glm::length(areaNormal);
+			glm::vec3 centroid = (v0 + v1 + v2) / 3.0f;
+
+			clusterCentroids[c] += centroid * area;
+			clusterNormals[c] += areaNormal;
+			clusterArea += area;
+
+			meshCentroid += centroid * area;
+			meshArea += area;
+		}
+
+		if (clusterArea > 0.0f)
+		{
+			clusterCentroids[c] /= clusterArea;
+		}
+	}
+
+	if (meshArea > 0.0f)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters facing away from the center are most likely to occlude the others so they go first
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float normalLength = glm::length(clusterNormals[c]);
+		glm::vec3 normal = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+		sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, normal);
+	}
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<unsigned int> sorted;
+	sorted.reserve(triangleCount * 3);
+	for (size_t i = 0; i < clusterCount; i++)
+	{
+		size_t c = order[i];
+		sorted.insert(sorted.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+	}
+
+	// Keep the cache friendly order if we lose too much
+	float acmrAfter = CalculateACMR(&sorted[0], sorted.size(), vertexCount, cacheSize);
+	if (acmrAfter > acmrBefore * threshold)
+	{
+		return;
+	}
+
+	memcpy(indices, &sorted[0], sizeof(unsigned int) * triangleCount * 3);
+}
+
+size_t MeshOptimizer::OptimizeVertexFetch(GLfloat* vertices, unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int vertexLength)
+{
+	const unsigned int unused = ~0u;
+
+	std::vector<unsigned int> remap(vertexCount, unused);
+	unsigned int nextVertex = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int& newIndex = remap[indices[i]];
+		if (newIndex == unused)
+		{
+			newIndex = nextVertex++;
+		}
+		indices[i] = newIndex;
+	}
+
+	std::vector<GLfloat> reordered(nextVertex * vertexLength);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] != unused)
+		{
+			memcpy(&reordered[remap[v] * vertexLength], vertices + v * vertexLength, sizeof(GLfloat) * vertexLength);
+		}
+	}
+
+	if (nextVertex > 0)
+	{
+		memcpy(vertices, &reordered[0], sizeof(GLfloat) * nextVertex * vertexLength);
+	}
+
+	return nextVertex;
+}
+
+void MeshOptimizer::SplitMesh(const std::vector<GLfloat>& vertices, const std::vector<unsigned int>& indices, unsigned int vertexLength, size_t maxVertices,
+							std::vector<std::vector<GLfloat>>* outVertices, std::vector<std::vector<unsigned int>>* outIndices)
+{
+	const unsigned int unused = ~0u;
+
+	size_t vertexCount = vertices.size() / vertexLength;
+	std::vector<unsigned int> remap(vertexCount, unused);
+	// Vertices of the current chunk, to reset remap when we start the next one
+	std::vector<unsigned int> chunkVertices;
+
+	outVertices->clear();
+	outIndices->clear();
+
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		int newVertices = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			if (remap[indices[t + k]] == unused)
+			{
+				newVertices++;
+			}
+		}
+
+		if (outVertices->empty() || chunkVertices.size() + newVertices > maxVertices)
+		{
+			for (size_t i = 0; i < chunkVertices.size(); i++)
+			{
+				remap[chunkVertices[i]] = unused;
+			}
+			chunkVertices.clear();
+
+			outVertices->push_back(std::vector<GLfloat>());
+			outIndices->push_back(std::vector<unsigned int>());
+		}
+
+		std::vector<GLfloat>& chunkVertexData = outVertices->back();
+		std::vector<unsigned int>& chunkIndices = outIndices->back();
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int index = indices[t + k];
+			if (remap[index] == unused)
+			{
+				remap[index] = chunkVertices.size();
+				chunkVertices.push_back(index);
+				chunkVertexData.insert(chunkVertexData.end(), vertices.begin() + index * vertexLength, vertices.begin() + (index + 1) * vertexLength);
+			}
+			chunkIndices.push_back(remap[index]);
+		}
+	}
+}
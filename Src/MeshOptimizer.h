@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Reorder the triangles and vertices of indexed triangle lists so the GPU does less work:
+// - post transform vertex cache reuse (Tom Forsyth's linear speed vertex cache optimisation)
+// - overdraw, by drawing the clusters that face outward first
+// - vertex fetch locality, by storing the vertices in the order they are first used
+class MeshOptimizer
+{
+public:
+	// Average cache miss ratio: vertex shader invocations per triangle with a FIFO cache (between 0.5 and 3)
+	static float CalculateACMR(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16);
+
+	static void OptimizeVertexCache(unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+	// Must be called after OptimizeVertexCache, threshold is how much ACMR we accept to lose (1.05 = 5% worse)
+	static void OptimizeOverdraw(unsigned int* indices, size_t indexCount, const GLfloat* vertices, size_t vertexCount, unsigned int vertexLength, float threshold = 1.05f);
+
+	// Return the new number of vertices, vertices that are never used are removed
+	static size_t OptimizeVertexFetch(GLfloat* vertices, unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int vertexLength);
+
+	// Split in chunks of at most maxVertices vertices, triangles keep their order
+	static void SplitMesh(const std::vector<GLfloat>& vertices, const std::vector<unsigned int>& indices, unsigned int vertexLength, size_t maxVertices,
+						std::vector<std::vector<GLfloat>>* outVertices, std::vector<std::vector<unsigned int>>* outIndices);
+
+private:
+	static const int VERTEX_CACHE_SIZE = 32;
+
+	static float VertexScore(int cachePosition, unsigned int remainingTriangles);
+};
@@ -0,0 +1,262 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+void MeshSimplifier::AddPlane(Quadric* q, double a, double b, double c, double d)
+{
+	q->a2 += a * a; q->ab += a * b; q->ac += a * c; q->ad += a * d;
+	q->b2 += b * b; q->bc += b * c; q->bd += b * d;
+	q->c2 += c * c; q->cd += c * d;
+	q->d2 += d * d;
+}
+
+void MeshSimplifier::AddQuadric(Quadric* q, const Quadric& other)
+{
+	q->a2 += other.a2; q->ab += other.ab; q->ac += other.ac; q->ad += other.ad;
+	q->b2 += other.b2; q->bc += other.bc; q->bd += other.bd;
+	q->c2 += other.c2; q->cd += other.cd;
+	q->d2 += other.d2;
+}
+
+double MeshSimplifier::Evaluate(const Quadric& q, const GLfloat* position)
+{
+	double x = position[0], y = position[1], z = position[2];
+
+	// v^T Q v with v = (x, y, z, 1)
+	double result = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+				+ q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+				+ q.c2 * z * z + 2.0 * q.cd * z
+				+ q.d2;
+
+	return result > 0.0 ? result : 0.0;
+}
+
+bool MeshSimplifier::CollapseFlipsTriangle(const GLfloat* vertices, unsigned int vertexLength, const std::vector<unsigned int>& indices,
+										const std::vector<unsigned int>& adjacentTriangles, unsigned int from, unsigned int to)
+{
+	for (size_t i = 0; i < adjacentTriangles.size(); i++)
+	{
+		const unsigned int* tri = &indices[adjacentTriangles[i] * 3];
+
+		// These ones disappear with the collapse
+		if (tri[0] == to || tri[1] == to || tri[2] == to)
+		{
+			continue;
+		}
+
+		glm::vec3 before[3], after[3];
+		for (int k = 0; k < 3; k++)
+		{
+			const GLfloat* p = vertices + tri[k] * vertexLength;
+			before[k] = glm::vec3(p[0], p[1], p[2]);
+
+			const GLfloat* q = vertices + (tri[k] == from ? to : tri[k]) * vertexLength;
+			after[k] = glm::vec3(q[0], q[1], q[2]);
+		}
+
+		glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+		float lengthBefore = glm::length(normalBefore);
+		float lengthAfter = glm::length(normalAfter);
+		if (lengthAfter <= 1e-12f)
+		{
+			return true;
+		}
+
+		// More than ~75 degrees of rotation is treated as a flip
+		if (lengthBefore > 0.0f && glm::dot(normalBefore, normalAfter) < 0.25f * lengthBefore * lengthAfter)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+float MeshSimplifier::Simplify(const GLfloat* vertices, size_t vertexCount, unsigned int vertexLength,
+							const unsigned int* indices, size_t indexCount, size_t targetIndexCount,
+							std::vector<unsigned int>* result)
+{
+	result->assign(indices, indices + indexCount);
+
+	// Plane of every triangle added to its 3 vertices
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		const GLfloat* p0 = vertices + indices[t] * vertexLength;
+		const GLfloat* p1 = vertices + indices[t + 1] * vertexLength;
+		const GLfloat* p2 = vertices + indices[t + 2] * vertexLength;
+
+		glm::vec3 v0(p0[0], p0[1], p0[2]);
+		glm::vec3 normal = glm::cross(glm::vec3(p1[0], p1[1], p1[2]) - v0, glm::vec3(p2[0], p2[1], p2[2]) - v0);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+		normal /= length;
+
+		for (int k = 0; k < 3; k++)
+		{
+			AddPlane(&quadrics[indices[t + k]], normal.x, normal.y, normal.z, -glm::dot(normal, v0));
+		}
+	}
+
+	// An edge used by only one triangle is a border (or a UV seam since Assimp split the vertices there)
+	std::unordered_map<unsigned long long, int> edgeUses;
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned long long a = indices[t + k];
+			unsigned long long b = indices[t + (k + 1) % 3];
+			edgeUses[a < b ? (a << 32) | b : (b << 32) | a]++;
+		}
+	}
+
+	std::vector<bool> locked(vertexCount, false);
+	for (std::unordered_map<unsigned long long, int>::iterator it = edgeUses.begin(); it != edgeUses.end(); ++it)
+	{
+		if (it->second == 1)
+		{
+			locked[it->first >> 32] = true;
+			locked[it->first & 0xFFFFFFFF] = true;
+		}
+	}
+
+	std::vector<unsigned int>& current = *result;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<std::vector<unsigned int>> adjacency(vertexCount);
+	std::vector<Collapse> collapses;
+
+	double maxError = 0.0;
+
+	while (current.size() > targetIndexCount)
+	{
+		size_t triangleCount = current.size() / 3;
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			remap[v] = v;
+			touched[v] = false;
+			adjacency[v].clear();
+		}
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				adjacency[current[t * 3 + k]].push_back(t);
+			}
+		}
+
+		// Every edge can collapse in one direction, the cheapest one that is allowed
+		collapses.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = current[t * 3 + k];
+				unsigned int b = current[t * 3 + (k + 1) % 3];
+				if (a > b)
+				{
+					// the other triangle of the edge will add it, borders are locked anyway
+					continue;
+				}
+
+				Quadric q = quadrics[a];
+				AddQuadric(&q, quadrics[b]);
+
+				Collapse collapse;
+				collapse.cost = -1.0;
+				if (!locked[a])
+				{
+					collapse.from = a;
+					collapse.to = b;
+					collapse.cost = Evaluate(q, vertices + b * vertexLength);
+				}
+				if (!locked[b])
+				{
+					double cost = Evaluate(q, vertices + a * vertexLength);
+					if (collapse.cost < 0.0 || cost < collapse.cost)
+					{
+						collapse.from = b;
+						collapse.to = a;
+						collapse.cost = cost;
+					}
+				}
+
+				if (collapse.cost >= 0.0)
+				{
+					collapses.push_back(collapse);
+				}
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		// Apply as many collapses as possible in one pass, a vertex is only changed once per pass
+		// so the cost and the flip test of the others stay valid
+		size_t trianglesLeft = triangleCount;
+		size_t collapseCount = 0;
+		for (size_t i = 0; i < collapses.size() && trianglesLeft * 3 > targetIndexCount; i++)
+		{
+			const Collapse& collapse = collapses[i];
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+
+			if (CollapseFlipsTriangle(vertices, vertexLength, current, adjacency[collapse.from], collapse.from, collapse.to))
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			AddQuadric(&quadrics[collapse.to], quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.cost);
+			collapseCount++;
+
+			const std::vector<unsigned int>& around = adjacency[collapse.from];
+			for (size_t a = 0; a < around.size(); a++)
+			{
+				const unsigned int* tri = &current[around[a] * 3];
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+				{
+					trianglesLeft--;
+				}
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+		}
+
+		if (collapseCount == 0)
+		{
+			break;
+		}
+
+		// Rewrite the indices and remove the triangles that became degenerate
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			unsigned int a = remap[current[t * 3]];
+			unsigned int b = remap[current[t * 3 + 1]];
+			unsigned int c = remap[current[t * 3 + 2]];
+
+			if (a != b && b != c && c != a)
+			{
+				current[write++] = a;
+				current[write++] = b;
+				current[write++] = c;
+			}
+		}
+		current.resize(write);
+	}
+
+	// Distance to the original planes, the quadrics are not weighted so this is an upper bound of it
+	return (float)std::sqrt(maxError);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Quadric error metric simplification (Garland & Heckbert) by edge collapse.
+// Vertices are only merged into existing ones so every LOD can share the vertex buffer of the full mesh
+// and only needs its own indices.
+class MeshSimplifier
+{
+public:
+	// Collapse edges until there is targetIndexCount indices or nothing can be collapsed anymore.
+	// Vertices on open borders and UV seams are locked so the mesh doesn't get holes.
+	// Return the geometric error of the result in the units of the mesh.
+	static float Simplify(const GLfloat* vertices, size_t vertexCount, unsigned int vertexLength,
+						const unsigned int* indices, size_t indexCount, size_t targetIndexCount,
+						std::vector<unsigned int>* result);
+
+private:
+	// Symmetric 4x4 matrix, sum of the squared distance to the planes of the triangles around a vertex
+	struct Quadric
+	{
+		double a2, ab, ac, ad;
+		double b2, bc, bd;
+		double c2, cd;
+		double d2;
+	};
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double cost;
+	};
+
+	static void AddPlane(Quadric* q, double a, double b, double c, double d);
+	static void AddQuadric(Quadric* q, const Quadric& other);
+	static double Evaluate(const Quadric& q, const GLfloat* position);
+
+	// Check that moving "from" on "to" doesn't flip or collapse any of the remaining triangles around "from"
+	static bool CollapseFlipsTriangle(const GLfloat* vertices, unsigned int vertexLength, const std::vector<unsigned int>& indices,
+									const std::vector<unsigned int>& adjacentTriangles, unsigned int from, unsigned int to);
+};
@@ -0,0 +1,125 @@
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+
+void MeshletBuilder::BuildMeshlets(const GLfloat* vertices, unsigned int vertexLength, const unsigned int* indices, size_t indexCount, size_t vertexCount,
+								std::vector<Meshlet>* meshlets, unsigned int maxVertices, unsigned int maxTriangles)
+{
+	meshlets->clear();
+
+	// Index of the last meshlet that used each vertex, to count the unique vertices of the current one
+	std::vector<int> lastMeshlet(vertexCount, -1);
+	unsigned int meshletVertices = 0;
+
+	Meshlet current;
+	current.firstIndex = 0;
+	current.indexCount = 0;
+
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		int meshletIndex = meshlets->size();
+		unsigned int newVertices = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			if (lastMeshlet[indices[t + k]] != meshletIndex)
+			{
+				newVertices++;
+			}
+		}
+
+		if (current.indexCount > 0 && (meshletVertices + newVertices > maxVertices || current.indexCount / 3 >= maxTriangles))
+		{
+			ComputeBounds(vertices, vertexLength, indices, &current);
+			meshlets->push_back(current);
+
+			current.firstIndex = t;
+			current.indexCount = 0;
+			meshletVertices = 0;
+			meshletIndex++;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (lastMeshlet[indices[t + k]] != meshletIndex)
+			{
+				lastMeshlet[indices[t + k]] = meshletIndex;
+				meshletVertices++;
+			}
+		}
+		current.indexCount += 3;
+	}
+
+	if (current.indexCount > 0)
+	{
+		ComputeBounds(vertices, vertexLength, indices, &current);
+		meshlets->push_back(current);
+	}
+}
+
+void MeshletBuilder::ComputeBounds(const GLfloat* vertices, unsigned int vertexLength, const unsigned int* indices, Meshlet* meshlet)
+{
+	const unsigned int* meshletIndices = indices + meshlet->firstIndex;
+
+	// Sphere around the center of the AABB
+	glm::vec3 boundsMin(vertices[meshletIndices[0] * vertexLength], vertices[meshletIndices[0] * vertexLength + 1], vertices[meshletIndices[0] * vertexLength + 2]);
+	glm::vec3 boundsMax = boundsMin;
+	for (size_t i = 1; i < meshlet->indexCount; i++)
+	{
+		const GLfloat* p = vertices + meshletIndices[i] * vertexLength;
+		boundsMin = glm::min(boundsMin, glm::vec3(p[0], p[1], p[2]));
+		boundsMax = glm::max(boundsMax, glm::vec3(p[0], p[1], p[2]));
+	}
+
+	meshlet->center = (boundsMin + boundsMax) * 0.5f;
+	meshlet->radius = 0.0f;
+	for (size_t i = 0; i < meshlet->indexCount; i++)
+	{
+		const GLfloat* p = vertices + meshletIndices[i] * vertexLength;
+		meshlet->radius = std::max(meshlet->radius, glm::length(glm::vec3(p[0], p[1], p[2]) - meshlet->center));
+	}
+
+	// The cone axis is the average of the face normals, the cutoff comes from the normal that is the furthest from it
+	std::vector<glm::vec3> normals;
+	glm::vec3 axis(0.0f);
+	for (size_t t = 0; t + 2 < meshlet->indexCount; t += 3)
+	{
+		const GLfloat* p0 = vertices + meshletIndices[t] * vertexLength;
+		const GLfloat* p1 = vertices + meshletIndices[t + 1] * vertexLength;
+		const GLfloat* p2 = vertices + meshletIndices[t + 2] * vertexLength;
+
+		glm::vec3 v0(p0[0], p0[1], p0[2]);
+		glm::vec3 normal = glm::cross(glm::vec3(p1[0], p1[1], p1[2]) - v0, glm::vec3(p2[0], p2[1], p2[2]) - v0);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+
+		normals.push_back(normal / length);
+		axis += normals.back();
+	}
+
+	meshlet->coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet->coneCutoff = 1.0f;
+
+	float axisLength = glm::length(axis);
+	if (axisLength <= 0.0f)
+	{
+		return;
+	}
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for (size_t i = 0; i < normals.size(); i++)
+	{
+		minDot = std::min(minDot, glm::dot(axis, normals[i]));
+	}
+
+	meshlet->coneAxis = axis;
+	// Cones wider than ~85 degrees almost never pass the test, don't bother with them
+	if (minDot > 0.1f)
+	{
+		meshlet->coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+}
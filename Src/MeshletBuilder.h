@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Small cluster of triangles that are contiguous in the index buffer of the mesh
+struct Meshlet
+{
+	GLuint firstIndex;
+	GLuint indexCount;
+
+	// Bounding sphere in model space
+	glm::vec3 center;
+	float radius;
+
+	// Normal cone: every triangle faces away from a viewer at P when dot(center - P, coneAxis) >= coneCutoff * |center - P| + radius
+	// coneCutoff is 1 when the normals are too spread for the cluster to ever be back facing
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+class MeshletBuilder
+{
+public:
+	// Cut the index buffer in meshlets of at most maxVertices unique vertices and maxTriangles triangles.
+	// The triangles keep their order so the index buffer should already be optimised for the vertex cache.
+	// Front faces are counter clockwise like the OpenGL default.
+	static void BuildMeshlets(const GLfloat* vertices, unsigned int vertexLength, const unsigned int* indices, size_t indexCount, size_t vertexCount,
+							std::vector<Meshlet>* meshlets, unsigned int maxVertices = 64, unsigned int maxTriangles = 124);
+
+private:
+	static void ComputeBounds(const GLfloat* vertices, unsigned int vertexLength, const unsigned int* indices, Meshlet* meshlet);
+};
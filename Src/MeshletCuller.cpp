@@ -0,0 +1,150 @@
+#include "MeshletCuller.h"
+
+#include <cmath>
+
+#ifdef MESHLET_CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+MeshletCuller::MeshletCuller()
+{
+}
+
+void MeshletCuller::Init(const std::vector<Meshlet>& meshlets)
+{
+	size_t count = meshlets.size();
+	size_t paddedCount = (count + 3) & ~(size_t)3;
+
+	// A negative radius fails the frustum test so the padding is always culled
+	centerX.assign(paddedCount, 0.0f);
+	centerY.assign(paddedCount, 0.0f);
+	centerZ.assign(paddedCount, 0.0f);
+	radius.assign(paddedCount, -1e30f);
+	axisX.assign(paddedCount, 0.0f);
+	axisY.assign(paddedCount, 0.0f);
+	axisZ.assign(paddedCount, 0.0f);
+	cutoff.assign(paddedCount, 1.0f);
+
+	firstIndex.resize(count);
+	indexCount.resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		centerX[i] = meshlets[i].center.x;
+		centerY[i] = meshlets[i].center.y;
+		centerZ[i] = meshlets[i].center.z;
+		radius[i] = meshlets[i].radius;
+		axisX[i] = meshlets[i].coneAxis.x;
+		axisY[i] = meshlets[i].coneAxis.y;
+		axisZ[i] = meshlets[i].coneAxis.z;
+		cutoff[i] = meshlets[i].coneCutoff;
+		firstIndex[i] = meshlets[i].firstIndex;
+		indexCount[i] = meshlets[i].indexCount;
+	}
+}
+
+void MeshletCuller::Cull(const glm::mat4& modelViewProjection, const glm::vec3& viewPosition, std::vector<GLuint>* firstIndices, std::vector<GLsizei>* indexCounts)
+{
+	firstIndices->clear();
+	indexCounts->clear();
+
+	// Frustum planes in model space (Gribb & Hartmann), normalised so the distance can be compared with the radius
+	glm::vec4 planes[6];
+	glm::vec4 row0(modelViewProjection[0][0], modelViewProjection[1][0], modelViewProjection[2][0], modelViewProjection[3][0]);
+	glm::vec4 row1(modelViewProjection[0][1], modelViewProjection[1][1], modelViewProjection[2][1], modelViewProjection[3][1]);
+	glm::vec4 row2(modelViewProjection[0][2], modelViewProjection[1][2], modelViewProjection[2][2], modelViewProjection[3][2]);
+	glm::vec4 row3(modelViewProjection[0][3], modelViewProjection[1][3], modelViewProjection[2][3], modelViewProjection[3][3]);
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+	for (int p = 0; p < 6; p++)
+	{
+		planes[p] /= glm::length(glm::vec3(planes[p]));
+	}
+
+	size_t count = firstIndex.size();
+
+#ifdef MESHLET_CULLING_SSE
+	__m128 viewX = _mm_set1_ps(viewPosition.x);
+	__m128 viewY = _mm_set1_ps(viewPosition.y);
+	__m128 viewZ = _mm_set1_ps(viewPosition.z);
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&centerX[i]);
+		__m128 cy = _mm_loadu_ps(&centerY[i]);
+		__m128 cz = _mm_loadu_ps(&centerZ[i]);
+		__m128 r = _mm_loadu_ps(&radius[i]);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), r);
+
+		// Inside or crossing every plane
+		__m128 visible = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[p].x)), _mm_mul_ps(cy, _mm_set1_ps(planes[p].y))),
+										_mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+			visible = _mm_and_ps(visible, _mm_cmpgt_ps(distance, negativeRadius));
+		}
+
+		// Normal cone facing away from the viewer
+		__m128 dx = _mm_sub_ps(cx, viewX);
+		__m128 dy = _mm_sub_ps(cy, viewY);
+		__m128 dz = _mm_sub_ps(cz, viewZ);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&axisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&axisY[i]))), _mm_mul_ps(dz, _mm_loadu_ps(&axisZ[i])));
+		__m128 backFacing = _mm_cmpge_ps(facing, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cutoff[i]), distance), r));
+
+		int mask = _mm_movemask_ps(_mm_andnot_ps(backFacing, visible));
+		for (int lane = 0; lane < 4 && i + lane < count; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				AddRange(firstIndex[i + lane], indexCount[i + lane], firstIndices, indexCounts);
+			}
+		}
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 center(centerX[i], centerY[i], centerZ[i]);
+
+		bool visible = true;
+		for (int p = 0; p < 6 && visible; p++)
+		{
+			visible = glm::dot(glm::vec3(planes[p]), center) + planes[p].w > -radius[i];
+		}
+		if (!visible)
+		{
+			continue;
+		}
+
+		glm::vec3 direction = center - viewPosition;
+		if (glm::dot(direction, glm::vec3(axisX[i], axisY[i], axisZ[i])) >= cutoff[i] * glm::length(direction) + radius[i])
+		{
+			continue;
+		}
+
+		AddRange(firstIndex[i], indexCount[i], firstIndices, indexCounts);
+	}
+#endif
+}
+
+void MeshletCuller::AddRange(GLuint first, GLuint count, std::vector<GLuint>* firstIndices, std::vector<GLsizei>* indexCounts)
+{
+	// Meshlets are contiguous in the index buffer, so visible neighbours become a single range
+	if (!firstIndices->empty() && firstIndices->back() + indexCounts->back() == first)
+	{
+		indexCounts->back() += count;
+		return;
+	}
+
+	firstIndices->push_back(first);
+	indexCounts->push_back(count);
+}
+
+MeshletCuller::~MeshletCuller()
+{
+}
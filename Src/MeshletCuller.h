@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "MeshletBuilder.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MESHLET_CULLING_SSE
+#endif
+
+// Frustum and normal cone culling of the meshlets of one mesh on the CPU.
+// The meshlets are stored as structure of arrays so 4 of them are tested at once with SSE.
+class MeshletCuller
+{
+public:
+	MeshletCuller();
+
+	void Init(const std::vector<Meshlet>& meshlets);
+
+	// modelViewProjection and viewPosition (in model space) of the pass.
+	// Output the index ranges of the visible meshlets, neighbours are merged in one range,
+	// ready for Mesh::RenderRanges
+	void Cull(const glm::mat4& modelViewProjection, const glm::vec3& viewPosition, std::vector<GLuint>* firstIndices, std::vector<GLsizei>* indexCounts);
+
+	size_t GetMeshletCount() { return firstIndex.size(); }
+
+	~MeshletCuller();
+
+private:
+	void AddRange(GLuint first, GLuint count, std::vector<GLuint>* firstIndices, std::vector<GLsizei>* indexCounts);
+
+	// Padded to a multiple of 4, the padding is never visible
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<float> axisX, axisY, axisZ, cutoff;
+	std::vector<GLuint> firstIndex, indexCount;
+};
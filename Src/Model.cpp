@@ -1,23 +1,177 @@
 #include "Model.h"
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <stdarg.h>
+#include <string.h>
+
+#include "CommonValues.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+
+const unsigned int Model::IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices;
+
+// printf into a string, the import threads keep their messages until the GL stage prints them in order
+static void AppendLog(std::string* log, const char* format, ...)
+{
+	char buffer[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	log->append(buffer);
+}
 
 Model::Model()
-{}
+{
+	geometryPool = nullptr;
+	splitLargeMeshes = false;
+	lodCount = 1;
+	buildMeshlets = false;
+	threadPool = nullptr;
+	jobSystem = nullptr;
+	textureCache = nullptr;
+}
+
+void Model::LoadModel(const std::string& fileName, GeometryPool* pool)
+{
+	geometryPool = pool;
+
+	std::string cacheName = fileName + ".cooked";
+	unsigned long long key = GetCookKey(fileName, IMPORT_FLAGS);
+
+	if (key != 0 && LoadCookedModel(cacheName, key))
+	{
+		printf("Model (%s) loaded from %s\n", fileName.c_str(), cacheName.c_str());
+		return;
+	}
+
+	std::vector<std::string> texturePaths;
+	std::vector<ImportedMesh> meshes;
+	if (!ImportModel(fileName, key, &texturePaths, &meshes))
+	{
+		return;
+	}
 
-void Model::LoadModel(const std::string& fileName)
+	// GL stage: upload on this thread, in the order of the scene
+	LoadTextures(texturePaths);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		printf("%s", meshes[i].log.c_str());
+		AddCookedMesh(meshes[i].cooked);
+	}
+}
+
+void Model::LoadModelAsync(const std::string& fileName, GeometryPool* pool, AssetLoader* loader)
+{
+	geometryPool = pool;
+
+	loader->LoadAsync([this, fileName, loader]()
+	{
+		std::shared_ptr<std::vector<std::string>> texturePaths = std::make_shared<std::vector<std::string>>();
+		std::shared_ptr<std::vector<ImportedMesh>> meshes = std::make_shared<std::vector<ImportedMesh>>();
+
+		std::string cacheName = fileName + ".cooked";
+		unsigned long long key = GetCookKey(fileName, IMPORT_FLAGS);
+
+		if (key != 0 && ReadCookedModel(cacheName, key, texturePaths.get(), meshes.get()))
+		{
+			printf("Model (%s) loaded from %s\n", fileName.c_str(), cacheName.c_str());
+		}
+		else if (!ImportModel(fileName, key, texturePaths.get(), meshes.get()))
+		{
+			return;
+		}
+
+		// Textures are decoded here too, only their upload is left for the GL thread
+		std::vector<Texture*> textures(texturePaths->size());
+		size_t textureBytes = 0;
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textureCache)
+			{
+				// The cache queues its own uploads
+				textures[i] = AcquireModelTexture((*texturePaths)[i], loader);
+			}
+			else
+			{
+				textures[i] = DecodeModelTexture((*texturePaths)[i]);
+				textureBytes += textures[i]->GetDecodedSize();
+			}
+		}
+
+		// Textures first so the meshes never reference a missing one, they bind the placeholder until uploaded
+		loader->QueueUpload(textureBytes, [this, textures]()
+		{
+			textureList = textures;
+			for (size_t i = 0; i < textureList.size() && !textureCache; i++)
+			{
+				textureList[i]->UploadTexture();
+			}
+		});
+
+		for (size_t i = 0; i < meshes->size(); i++)
+		{
+			loader->QueueUpload(GetUploadSize((*meshes)[i].cooked), [this, meshes, i]()
+			{
+				printf("%s", (*meshes)[i].log.c_str());
+				AddCookedMesh((*meshes)[i].cooked);
+				// Unmapped with the last one
+				(*meshes)[i].mapping.reset();
+			});
+		}
+	});
+}
+
+bool Model::ImportModel(const std::string& fileName, unsigned long long key, std::vector<std::string>* texturePaths, std::vector<ImportedMesh>* meshes)
 {
 	Assimp::Importer importer;
-	const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_JoinIdenticalVertices);
+	const aiScene* scene = importer.ReadFile(fileName, IMPORT_FLAGS);
 
 	if (!scene)
 	{
 		printf("Model (%s) failed to load: %s", fileName.c_str(), importer.GetErrorString());
-		return;
+		return false;
+	}
+
+	LoadMaterials(scene, texturePaths);
+
+	std::vector<const aiMesh*> sceneMeshes;
+	LoadNode(scene->mRootNode, scene, &sceneMeshes);
+
+	// CPU stage: every aiMesh is converted and processed on its own on the thread pool
+	std::vector<std::vector<ImportedMesh>> imported(sceneMeshes.size());
+	std::function<void(size_t)> loadMesh = [&](size_t i) { LoadMesh(sceneMeshes[i], i, &imported[i]); };
+	if (threadPool)
+	{
+		threadPool->ParallelFor(sceneMeshes.size(), loadMesh);
+	}
+	else
+	{
+		for (size_t i = 0; i < sceneMeshes.size(); i++)
+		{
+			loadMesh(i);
+		}
 	}
 
-	LoadNode(scene->mRootNode, scene);
-	LoadMaterials(scene);
+	// Keep the order of the scene, moving the meshes keeps their buffers so the pointers stay valid
+	meshes->clear();
+	for (size_t i = 0; i < imported.size(); i++)
+	{
+		for (size_t j = 0; j < imported[i].size(); j++)
+		{
+			meshes->push_back(std::move(imported[i][j]));
+		}
+	}
+
+	if (key != 0)
+	{
+		WriteCookedModel(fileName + ".cooked", key, *texturePaths, *meshes);
+	}
+
+	return true;
 }
 
 void Model::RenderModel()
@@ -35,6 +189,209 @@ void Model::RenderModel()
 
 }
 
+void Model::CullMeshes(const glm::mat4& model, const ViewParameters& view, bool cullMeshlets)
+{
+	// Culling is done in model space, no need to transform every meshlet
+	glm::vec3 viewPosition = glm::vec3(glm::inverse(model) * glm::vec4(view.viewPosition, 1.0f));
+	glm::mat4 modelViewProjection = view.viewProjection * model;
+
+	size_t meshCount = lodErrors.size();
+	selectedLods.resize(meshCount);
+	visibleFirstIndices.resize(meshCount);
+	visibleIndexCounts.resize(meshCount);
+	std::function<void(size_t)> cullMesh = [&](size_t i)
+	{
+		selectedLods[i] = SelectLod(i, model, view);
+		if (selectedLods[i] == 0 && cullMeshlets && meshletCullers[i])
+		{
+			meshletCullers[i]->Cull(modelViewProjection, viewPosition, &visibleFirstIndices[i], &visibleIndexCounts[i]);
+		}
+	};
+	if (jobSystem)
+	{
+		jobSystem->ParallelFor(meshCount, 1, cullMesh);
+	}
+	else
+	{
+		for (size_t i = 0; i < meshCount; i++)
+		{
+			cullMesh(i);
+		}
+	}
+}
+
+void Model::RenderModel(const glm::mat4& model, const ViewParameters& view)
+{
+	// Every mesh is culled before the first draw so it can run on the job threads, the draws need the GL thread
+	CullMeshes(model, view, view.cullMeshlets);
+
+	for (size_t i = 0; i < meshList.size(); i++)
+	{
+		unsigned int materialIndex = meshToTex[i];
+		if (materialIndex < textureList.size() && textureList[materialIndex])
+		{
+			textureList[materialIndex]->UseTexture();
+		}
+
+		if (selectedLods[i] == 0 && view.cullMeshlets && meshletCullers[i])
+		{
+			meshList[i]->RenderRanges(visibleFirstIndices[i].data(), visibleIndexCounts[i].data(), visibleFirstIndices[i].size());
+		}
+		else
+		{
+			meshList[i]->RenderMesh(selectedLods[i]);
+		}
+	}
+}
+
+void Model::RequestTextureLevels(TextureStreamer* streamer, const glm::mat4& model, const ViewParameters& view)
+{
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+	// meshList is empty when the meshes are in the geometry pool
+	for (size_t i = 0; i < meshToTex.size(); i++)
+	{
+		unsigned int materialIndex = meshToTex[i];
+		if (materialIndex >= textureList.size() || !textureList[materialIndex])
+		{
+			continue;
+		}
+
+		glm::vec3 center = glm::vec3(model * glm::vec4(boundingCenters[i], 1.0f));
+		float radius = boundingRadii[i] * scale;
+		float distance = glm::length(center - view.viewPosition) - radius;
+		streamer->Request(textureList[materialIndex], TextureStreamer::GetPixelSize(distance, radius * 2.0f, view.projectionScale));
+	}
+}
+
+unsigned int Model::SelectLod(size_t meshIndex, const glm::mat4& model, const ViewParameters& view)
+{
+	const std::vector<float>& errors = lodErrors[meshIndex];
+
+	// Biggest scale of the model matrix so the error is never underestimated
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	glm::vec3 center = glm::vec3(model * glm::vec4(boundingCenters[meshIndex], 1.0f));
+
+	// Distance to the closest point of the bounding sphere
+	float distance = glm::length(center - view.viewPosition) - boundingRadii[meshIndex] * scale;
+	if (distance <= 0.0f)
+	{
+		return 0;
+	}
+
+	// Coarsest LOD that stays under the allowed error on screen
+	unsigned int selected = 0;
+	for (size_t i = 1; i < errors.size(); i++)
+	{
+		float pixelError = errors[i] * scale / distance * view.projectionScale;
+		if (pixelError > view.maxPixelError)
+		{
+			break;
+		}
+		selected = i;
+	}
+
+	return selected;
+}
+
+void Model::SetVertexFormat(const VertexFormat& format)
+{
+	vertexFormat = format;
+}
+
+void Model::SetSplitLargeMeshes(bool split)
+{
+	splitLargeMeshes = split;
+}
+
+void Model::SetLodCount(unsigned int count)
+{
+	lodCount = std::max(count, 1u);
+}
+
+void Model::SetThreadPool(ThreadPool* threads)
+{
+	threadPool = threads;
+}
+
+void Model::SetJobSystem(JobSystem* jobs)
+{
+	jobSystem = jobs;
+}
+
+void Model::SetTextureCache(TextureCache* cache)
+{
+	textureCache = cache;
+}
+
+void Model::SetBuildMeshlets(bool build)
+{
+	buildMeshlets = build;
+}
+
+void Model::AddToDrawList(GeometryPool* pool, const glm::mat4& model)
+{
+	for (size_t i = 0; i < poolMeshIds.size(); i++)
+	{
+		if (!poolMeshIds[i].empty())
+		{
+			pool->AddDraw(poolMeshIds[i][0], model);
+		}
+	}
+}
+
+void Model::AddToDrawList(GeometryPool* pool, const glm::mat4& model, const ViewParameters& view)
+{
+	// LODs and meshlets culled on the job threads, the draws are added here in the order of the meshes
+	CullMeshes(model, view, view.cullMeshlets);
+
+	for (size_t i = 0; i < poolMeshIds.size(); i++)
+	{
+		// Not in the pool, it was full
+		if (poolMeshIds[i].empty())
+		{
+			continue;
+		}
+
+		// The pool keeps the LOD 0 indices in the same order, the visible ranges are valid there too
+		if (selectedLods[i] == 0 && view.cullMeshlets && meshletCullers[i])
+		{
+			pool->AddDrawRanges(poolMeshIds[i][0], visibleFirstIndices[i].data(), visibleIndexCounts[i].data(), visibleFirstIndices[i].size(), model);
+		}
+		else
+		{
+			unsigned int selected = std::min(selectedLods[i], (unsigned int)poolMeshIds[i].size() - 1);
+			pool->AddDraw(poolMeshIds[i][selected], model);
+		}
+	}
+}
+
+void Model::AddToDrawList(GeometryPool* pool, const glm::mat4& model, const ViewParameters& view, TextureArray* textures, const glm::vec4& material)
+{
+	CullMeshes(model, view, view.cullMeshlets);
+
+	for (size_t i = 0; i < poolMeshIds.size(); i++)
+	{
+		if (poolMeshIds[i].empty())
+		{
+			continue;
+		}
+
+		unsigned int materialIndex = meshToTex[i];
+		Texture* texture = materialIndex < textureList.size() ? textureList[materialIndex] : nullptr;
+		if (selectedLods[i] == 0 && view.cullMeshlets && meshletCullers[i])
+		{
+			pool->AddDrawRanges(poolMeshIds[i][0], visibleFirstIndices[i].data(), visibleIndexCounts[i].data(), visibleFirstIndices[i].size(),
+				model, textures->GetDrawTexture(texture), material);
+		}
+		else
+		{
+			unsigned int selected = std::min(selectedLods[i], (unsigned int)poolMeshIds[i].size() - 1);
+			pool->AddDraw(poolMeshIds[i][selected], model, textures->GetDrawTexture(texture), material);
+		}
+	}
+}
+
 void Model::ClearModel()
 {
 	for (size_t i = 0; i < meshList.size(); i++)
@@ -45,76 +402,249 @@ void Model::ClearModel()
 			meshList[i] = nullptr;
 		}
 	}
+	for (size_t i = 0; i < meshletCullers.size(); i++)
+	{
+		if (meshletCullers[i])
+		{
+			delete meshletCullers[i];
+			meshletCullers[i] = nullptr;
+		}
+	}
+	meshletCullers.clear();
+
+	poolMeshIds.clear();
+	lodErrors.clear();
+	boundingCenters.clear();
+	boundingRadii.clear();
 
 	for (size_t i = 0; i < textureList.size(); i++)
 	{
 		if (textureList[i])
 		{
-			delete textureList[i];
+			if (textureCache)
+			{
+				textureCache->Release(textureList[i]);
+			}
+			else
+			{
+				delete textureList[i];
+			}
 			textureList[i] = nullptr;
 		}
 	}
 }
 
-void Model::LoadNode(aiNode* node, const aiScene* scene)
+void Model::LoadNode(aiNode* node, const aiScene* scene, std::vector<const aiMesh*>* meshes)
 {
 	for (size_t i = 0; i < node->mNumMeshes; i++)
 	{
-		LoadMesh(scene->mMeshes[node->mMeshes[i]], scene);
+		meshes->push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
 
 	for (size_t i = 0; i < node->mNumChildren; i++)
 	{
-		LoadNode(node->mChildren[i], scene);
+		LoadNode(node->mChildren[i], scene, meshes);
 	}
 }
-void Model::LoadMesh(aiMesh* mesh, const aiScene* scene)
+
+void Model::LoadMesh(const aiMesh* mesh, size_t meshIndex, std::vector<ImportedMesh>* out)
 {
-	std::vector<GLfloat> vertices;
-	std::vector<unsigned int> indices;
+	size_t vertexCount = mesh->mNumVertices;
 
-	// create vertices array
-	for (size_t i = 0; i < mesh->mNumVertices; i++)
+	// Allocated once and filled in place
+	std::vector<GLfloat> vertices(vertexCount * VERTEX_LENGTH);
+	for (size_t i = 0; i < vertexCount; i++)
 	{
-		vertices.insert(vertices.end(), { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z });
+		GLfloat* vertex = &vertices[i * VERTEX_LENGTH];
+		vertex[0] = mesh->mVertices[i].x;
+		vertex[1] = mesh->mVertices[i].y;
+		vertex[2] = mesh->mVertices[i].z;
 		if (mesh->mTextureCoords[0])
 		{
-			vertices.insert(vertices.end(), { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y });
+			vertex[3] = mesh->mTextureCoords[0][i].x;
+			vertex[4] = mesh->mTextureCoords[0][i].y;
 		}
 		else // if the mesh doesn't have a texture attach to it
 		{
-			vertices.insert(vertices.end(), {0.0f, 0.0f} );
+			vertex[3] = 0.0f;
+			vertex[4] = 0.0f;
 		}
 		// Use "-" because in our fragment shader we calculate diffuseFactor with dot(VertexNormal, lightDirection) instead of dot(VertexNormal, -lightDirection)
-		vertices.insert(vertices.end(), { -mesh->mNormals[i].x, -mesh->mNormals[i].y , -mesh->mNormals[i].z });
+		vertex[5] = -mesh->mNormals[i].x;
+		vertex[6] = -mesh->mNormals[i].y;
+		vertex[7] = -mesh->mNormals[i].z;
 	}
 
-	// create indices arrays to create faces
+	// create indices arrays to create faces, everything is a triangle after aiProcess_Triangulate
+	std::vector<unsigned int> indices;
+	indices.reserve(mesh->mNumFaces * 3);
 	for (size_t i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
-		for (size_t j = 0; j < face.mNumIndices; j++)
+		const aiFace& face = mesh->mFaces[i];
+		indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+	}
+
+	std::string log;
+
+	// Assimp gives the faces in file order, reorder them for the post transform cache, overdraw and vertex fetch
+	float acmrBefore = MeshOptimizer::CalculateACMR(&indices[0], indices.size(), vertexCount);
+
+	MeshOptimizer::OptimizeVertexCache(&indices[0], indices.size(), vertexCount);
+	MeshOptimizer::OptimizeOverdraw(&indices[0], indices.size(), &vertices[0], vertexCount, VERTEX_LENGTH);
+	vertexCount = MeshOptimizer::OptimizeVertexFetch(&vertices[0], &indices[0], indices.size(), vertexCount, VERTEX_LENGTH);
+	vertices.resize(vertexCount * VERTEX_LENGTH);
+
+	float acmrAfter = MeshOptimizer::CalculateACMR(&indices[0], indices.size(), vertexCount);
+	AppendLog(&log, "Mesh %u: %zu vertices, %zu triangles, ACMR %.3f -> %.3f\n", (unsigned int)meshIndex, vertexCount, indices.size() / 3, acmrBefore, acmrAfter);
+
+	if (splitLargeMeshes && vertexCount > MAX_SHORT_INDEX_VERTICES)
+	{
+		std::vector<std::vector<GLfloat>> splitVertices;
+		std::vector<std::vector<unsigned int>> splitIndices;
+		MeshOptimizer::SplitMesh(vertices, indices, VERTEX_LENGTH, MAX_SHORT_INDEX_VERTICES, &splitVertices, &splitIndices);
+
+		out->resize(splitVertices.size());
+		for (size_t i = 0; i < splitVertices.size(); i++)
 		{
-			indices.push_back(face.mIndices[j]);
+			BuildMesh(splitVertices[i], splitIndices[i], mesh->mMaterialIndex, &(*out)[i]);
 		}
 	}
+	else
+	{
+		out->resize(1);
+		BuildMesh(vertices, indices, mesh->mMaterialIndex, &(*out)[0]);
+	}
 
-	Mesh* newMesh = new Mesh();
-	newMesh->CreateMesh(&vertices[0], &indices[0], vertices.size(), indices.size());
-	meshList.push_back(newMesh);
-	meshToTex.push_back(mesh->mMaterialIndex);
+	(*out)[0].log.insert(0, log);
 }
 
-void Model::LoadMaterials(const aiScene* scene)
+void Model::BuildMesh(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices, unsigned int materialIndex, ImportedMesh* out)
 {
-	textureList.resize(scene->mNumMaterials);
+	size_t vertexCount = vertices.size() / VERTEX_LENGTH;
+
+	CookedMesh& cooked = out->cooked;
+	cooked = CookedMesh();
+	cooked.materialIndex = materialIndex;
+	cooked.vertexCount = vertexCount;
+
+	// Bounding sphere around the center of the AABB
+	Mesh::CalculateBounds(&vertices[0], vertexCount, &cooked.boundsMin, &cooked.boundsMax);
+	cooked.center = (cooked.boundsMin + cooked.boundsMax) * 0.5f;
+	cooked.radius = 0.0f;
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		glm::vec3 pos(vertices[i * VERTEX_LENGTH], vertices[i * VERTEX_LENGTH + 1], vertices[i * VERTEX_LENGTH + 2]);
+		cooked.radius = std::max(cooked.radius, glm::length(pos - cooked.center));
+	}
+
+	// Every LOD has half the triangles of the previous one and is simplified from the full mesh
+	// so its error is measured against the original surface
+	std::vector<std::vector<unsigned int>> lodIndices(1, indices);
+	std::vector<float>& errors = out->lodErrors;
+	errors.assign(1, 0.0f);
+	for (unsigned int lod = 1; lod < lodCount; lod++)
+	{
+		size_t target = (indices.size() >> lod) / 3 * 3;
+		std::vector<unsigned int> simplified;
+		float error = MeshSimplifier::Simplify(&vertices[0], vertexCount, VERTEX_LENGTH, &indices[0], indices.size(), target, &simplified);
+
+		// Stop when the borders are all that is left
+		if (simplified.empty() || simplified.size() > lodIndices.back().size() * 9 / 10)
+		{
+			break;
+		}
+
+		MeshOptimizer::OptimizeVertexCache(&simplified[0], simplified.size(), vertexCount);
+		lodIndices.push_back(simplified);
+		errors.push_back(std::max(error, errors.back()));
+
+		AppendLog(&out->log, "  LOD %u: %zu triangles, error %f\n", lod, simplified.size() / 3, errors.back());
+	}
+
+	for (size_t i = 0; i < lodIndices.size(); i++)
+	{
+		out->lodIndexCounts.push_back(lodIndices[i].size());
+	}
+	cooked.lodCount = lodIndices.size();
+
+	// Only the full detail mesh is culled, the lower LODs are small enough to be drawn whole
+	if (buildMeshlets)
+	{
+		MeshletBuilder::BuildMeshlets(&vertices[0], VERTEX_LENGTH, &indices[0], indices.size(), vertexCount, &out->meshlets);
+		AppendLog(&out->log, "  %zu meshlets\n", out->meshlets.size());
+	}
+	cooked.meshletCount = out->meshlets.size();
+
+	// Same content as the GPU buffers so a cooked model can be uploaded directly
+	out->vertexData.resize(vertexCount * vertexFormat.GetStride());
+	vertexFormat.Encode(&vertices[0], vertexCount, cooked.boundsMin, cooked.boundsMax, &out->vertexData[0]);
+	cooked.indexType = Mesh::BuildIndexBuffer(lodIndices, vertexCount, &out->indexData);
+
+	SetMeshPointers(out);
+}
+
+void Model::AddCookedMesh(const CookedMesh& cooked)
+{
+	// With a pool the mesh is only uploaded there, meshList stays empty and RenderModel draws nothing
+	if (!geometryPool)
+	{
+		Mesh* newMesh = new Mesh();
+		newMesh->CreateMesh(cooked.vertexData, cooked.vertexCount, cooked.indexData, cooked.indexType, cooked.lodIndexCounts, cooked.lodCount,
+							cooked.boundsMin, cooked.boundsMax, vertexFormat);
+		meshList.push_back(newMesh);
+	}
+	meshToTex.push_back(cooked.materialIndex);
+
+	lodErrors.push_back(std::vector<float>(cooked.lodErrors, cooked.lodErrors + cooked.lodCount));
+	boundingCenters.push_back(cooked.center);
+	boundingRadii.push_back(cooked.radius);
+
+	MeshletCuller* culler = nullptr;
+	if (cooked.meshletCount > 0)
+	{
+		culler = new MeshletCuller();
+		culler->Init(std::vector<Meshlet>(cooked.meshlets, cooked.meshlets + cooked.meshletCount));
+	}
+	meshletCullers.push_back(culler);
+
+	if (geometryPool)
+	{
+		// The pool takes the vertices and the indices as they were cooked, 16 bits ones included
+		std::vector<int> ids;
+		const unsigned char* lodIndices = (const unsigned char*)cooked.indexData;
+		size_t indexSize = cooked.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		for (unsigned int lod = 0; lod < cooked.lodCount; lod++)
+		{
+			GLsizei count = cooked.lodIndexCounts[lod];
+			int id;
+			if (lod == 0)
+			{
+				id = geometryPool->AddMesh(cooked.vertexData, cooked.vertexCount, vertexFormat, cooked.boundsMin, cooked.boundsMax, lodIndices, cooked.indexType, count);
+			}
+			else
+			{
+				id = geometryPool->AddMeshLod(ids[0], lodIndices, count);
+			}
+			if (id < 0)
+			{
+				// The pool is full, it said so. Without LOD 0 the mesh isn't drawn, without the others it stays more detailed
+				break;
+			}
+			ids.push_back(id);
+			lodIndices += indexSize * count;
+		}
+		poolMeshIds.push_back(ids);
+	}
+}
+
+void Model::LoadMaterials(const aiScene* scene, std::vector<std::string>* texturePaths)
+{
+	texturePaths->assign(scene->mNumMaterials, std::string());
 	
 	for (size_t i = 0; i < scene->mNumMaterials; i++)
 	{
 		aiMaterial* material = scene->mMaterials[i];
 
-		textureList[i] = nullptr;
-
 		if (material->GetTextureCount(aiTextureType_DIFFUSE))
 		{
 			aiString path;
@@ -123,29 +653,327 @@ void Model::LoadMaterials(const aiScene* scene)
 				int idx = std::string(path.data).rfind("\\");
 				std::string filename = std::string(path.data).substr(idx + 1);
 
-				std::string textPath = std::string("Textures/") + filename;
-				std::ifstream infile(textPath.c_str());
-				
-				textureList[i] = new Texture(textPath.c_str());
+				(*texturePaths)[i] = std::string("Textures/") + filename;
+			}
+		}
+	}
+}
+
+void Model::LoadTextures(const std::vector<std::string>& texturePaths)
+{
+	textureList.resize(texturePaths.size());
+
+	for (size_t i = 0; i < texturePaths.size(); i++)
+	{
+		if (textureCache)
+		{
+			textureList[i] = AcquireModelTexture(texturePaths[i], nullptr);
+		}
+		else
+		{
+			textureList[i] = DecodeModelTexture(texturePaths[i]);
+			textureList[i]->UploadTexture();
+		}
+	}
+}
+
+Texture* Model::AcquireModelTexture(const std::string& texturePath, AssetLoader* loader)
+{
+	Texture* texture = nullptr;
+
+	// The loader can't tell us if the file is missing so check before
+	if (!texturePath.empty() && (!loader || std::ifstream(texturePath.c_str()).good()))
+	{
+		texture = textureCache->Acquire(texturePath, false, loader);
+	}
+
+	if (!texture)
+	{
+		if (!texturePath.empty())
+		{
+			printf("Failed to load texture at: %s\n", texturePath.c_str());
+		}
+
+		// default texture if we can't load, shared by every material without one
+		texture = textureCache->Acquire("Textures/plain.png", true, loader);
+	}
+
+	return texture;
+}
 
-				if (!textureList[i]->LoadTexture())
-				{
-					printf("Failed to load texture at: %s\n", textPath.c_str());
-					delete textureList[i];
-					textureList[i] = nullptr;
-				}
+Texture* Model::DecodeModelTexture(const std::string& texturePath)
+{
+	if (!texturePath.empty())
+	{
+		Texture* texture = new Texture(texturePath.c_str());
+		if (texture->DecodeTexture(false))
+		{
+			return texture;
+		}
+
+		printf("Failed to load texture at: %s\n", texturePath.c_str());
+		delete texture;
+	}
+
+	// default texture if we can't load
+	Texture* texture = new Texture("Textures/plain.png");
+	texture->DecodeTexture(true);
+	return texture;
+}
+
+unsigned long long Model::GetCookKey(const std::string& fileName, unsigned int importFlags)
+{
+	unsigned long long key = MeshCache::HashFile(fileName);
+	if (key == 0)
+	{
+		return 0;
+	}
 
-				
+	// Everything that changes what BuildMesh produces
+	key = MeshCache::HashValue(key, importFlags);
+	key = MeshCache::HashValue(key, vertexFormat.GetId());
+	key = MeshCache::HashValue(key, splitLargeMeshes);
+	key = MeshCache::HashValue(key, lodCount);
+	key = MeshCache::HashValue(key, buildMeshlets);
+	key = MeshCache::HashValue(key, VERTEX_LENGTH);
+	key = MeshCache::HashValue(key, MAX_SHORT_INDEX_VERTICES);
+	key = MeshCache::HashValue(key, sizeof(Meshlet));
+	key = MeshCache::HashValue(key, sizeof(CookedMeshHeader));
+	key = MeshCache::HashValue(key, COOKED_FILE_VERSION);
+	return key;
+}
+
+void Model::WriteCookedModel(const std::string& cacheName, unsigned long long key, const std::vector<std::string>& texturePaths, const std::vector<ImportedMesh>& meshes)
+{
+	MeshCache cache;
+	cache.BeginWrite(key);
+
+	cache.WriteValue((unsigned int)texturePaths.size());
+	for (size_t i = 0; i < texturePaths.size(); i++)
+	{
+		cache.WriteString(texturePaths[i]);
+	}
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const CookedMesh& cooked = meshes[i].cooked;
+
+		CookedMeshHeader header;
+		header.materialIndex = cooked.materialIndex;
+		header.vertexCount = cooked.vertexCount;
+		header.indexType = cooked.indexType;
+		header.lodCount = cooked.lodCount;
+		header.meshletCount = cooked.meshletCount;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			header.boundsMin[axis] = cooked.boundsMin[axis];
+			header.boundsMax[axis] = cooked.boundsMax[axis];
+			header.center[axis] = cooked.center[axis];
+		}
+		header.radius = cooked.radius;
+
+		cache.WriteValue(header);
+		cache.WriteBlock(cooked.lodIndexCounts, sizeof(GLsizei) * cooked.lodCount);
+		cache.WriteBlock(cooked.lodErrors, sizeof(float) * cooked.lodCount);
+		cache.WriteBlock(cooked.meshlets, sizeof(Meshlet) * cooked.meshletCount);
+		cache.WriteBlock(cooked.vertexData, meshes[i].vertexData.size());
+		cache.WriteBlock(cooked.indexData, meshes[i].indexData.size());
+	}
+
+	// Empty block to mark the end of the meshes
+	cache.WriteBlock(nullptr, 0);
+	cache.Save(cacheName);
+}
+
+bool Model::ParseCookedModel(MeshCache* cache, std::vector<std::string>* texturePaths, std::vector<CookedMesh>* meshes)
+{
+	unsigned int textureCount = cache->ReadValue<unsigned int>();
+	if (!cache->IsValid() || textureCount > cache->GetMaxBlockCount())
+	{
+		return false;
+	}
+
+	texturePaths->resize(textureCount);
+	for (size_t i = 0; i < texturePaths->size() && cache->IsValid(); i++)
+	{
+		(*texturePaths)[i] = cache->ReadString();
+	}
+
+	while (cache->IsValid())
+	{
+		size_t size;
+		const void* block = cache->ReadBlock(&size);
+		if (!block)
+		{
+			return false;
+		}
+		if (size == 0)
+		{
+			// The empty block at the end
+			break;
+		}
+		if (size != sizeof(CookedMeshHeader))
+		{
+			return false;
+		}
+
+		CookedMeshHeader header;
+		memcpy(&header, block, sizeof(header));
+		if (header.lodCount == 0 || (header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT))
+		{
+			return false;
+		}
+
+		CookedMesh cooked;
+		cooked.materialIndex = header.materialIndex;
+		cooked.vertexCount = header.vertexCount;
+		cooked.indexType = header.indexType;
+		cooked.lodCount = header.lodCount;
+		cooked.meshletCount = header.meshletCount;
+		cooked.boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+		cooked.boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+		cooked.center = glm::vec3(header.center[0], header.center[1], header.center[2]);
+		cooked.radius = header.radius;
+
+		// Every block must match the counts of the header, the data is used straight from the mapping
+		cooked.lodIndexCounts = (const GLsizei*)cache->ReadBlock(&size);
+		if (size != sizeof(GLsizei) * cooked.lodCount)
+		{
+			return false;
+		}
+		size_t indexCount = 0;
+		for (unsigned int lod = 0; lod < cooked.lodCount; lod++)
+		{
+			if (cooked.lodIndexCounts[lod] < 0)
+			{
+				return false;
+			}
+			indexCount += cooked.lodIndexCounts[lod];
+		}
+
+		cooked.lodErrors = (const float*)cache->ReadBlock(&size);
+		if (size != sizeof(float) * cooked.lodCount)
+		{
+			return false;
+		}
+
+		// The culler draws the meshlets as ranges of the LOD 0 indices
+		cooked.meshlets = (const Meshlet*)cache->ReadBlock(&size);
+		if (size != sizeof(Meshlet) * cooked.meshletCount)
+		{
+			return false;
+		}
+		for (unsigned int m = 0; m < cooked.meshletCount; m++)
+		{
+			if ((size_t)cooked.meshlets[m].firstIndex + cooked.meshlets[m].indexCount > (size_t)cooked.lodIndexCounts[0])
+			{
+				return false;
 			}
 		}
 
-		// default texture if we can't load
-		if (!textureList[i])
+		cooked.vertexData = cache->ReadBlock(&size);
+		if (size != (size_t)cooked.vertexCount * vertexFormat.GetStride())
+		{
+			return false;
+		}
+
+		cooked.indexData = cache->ReadBlock(&size);
+		if (size != indexCount * (cooked.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint)))
 		{
-			textureList[i] = new Texture("Textures/plain.png");
-			textureList[i]->LoadTextureA();
+			return false;
 		}
+
+		// Every LOD indexes the same vertices, an index past them would make the GPU fetch out of the VBO
+		unsigned int maxIndex = 0;
+		for (size_t i = 0; i < indexCount; i++)
+		{
+			unsigned int index = cooked.indexType == GL_UNSIGNED_SHORT ? ((const GLushort*)cooked.indexData)[i] : ((const GLuint*)cooked.indexData)[i];
+			maxIndex = std::max(maxIndex, index);
+		}
+		if (indexCount > 0 && maxIndex >= cooked.vertexCount)
+		{
+			return false;
+		}
+
+		meshes->push_back(cooked);
+	}
+
+	return cache->IsValid();
+}
+
+bool Model::LoadCookedModel(const std::string& cacheName, unsigned long long key)
+{
+	MeshCache cache;
+	if (!cache.Open(cacheName, key))
+	{
+		return false;
+	}
+
+	// Read everything before creating anything so a broken file falls back on the import
+	std::vector<std::string> texturePaths;
+	std::vector<CookedMesh> meshes;
+	if (!ParseCookedModel(&cache, &texturePaths, &meshes))
+	{
+		printf("Mesh cache %s is corrupted\n", cacheName.c_str());
+		return false;
+	}
+
+	// Straight from the mapped file to the GPU
+	LoadTextures(texturePaths);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		AddCookedMesh(meshes[i]);
+	}
+
+	return true;
+}
+
+bool Model::ReadCookedModel(const std::string& cacheName, unsigned long long key, std::vector<std::string>* texturePaths, std::vector<ImportedMesh>* meshes)
+{
+	std::shared_ptr<MeshCache> cache = std::make_shared<MeshCache>();
+	if (!cache->Open(cacheName, key))
+	{
+		return false;
+	}
+
+	std::vector<CookedMesh> cooked;
+	if (!ParseCookedModel(cache.get(), texturePaths, &cooked))
+	{
+		printf("Mesh cache %s is corrupted\n", cacheName.c_str());
+		return false;
 	}
+
+	// The upload happens later on the GL thread, the mapping stays open until the last mesh is done with it
+	// so the blobs still go from the file to glBufferData without a copy
+	meshes->resize(cooked.size());
+	for (size_t i = 0; i < cooked.size(); i++)
+	{
+		(*meshes)[i].cooked = cooked[i];
+		(*meshes)[i].mapping = cache;
+	}
+
+	return true;
+}
+
+size_t Model::GetUploadSize(const CookedMesh& cooked)
+{
+	size_t indexCount = 0;
+	for (unsigned int lod = 0; lod < cooked.lodCount; lod++)
+	{
+		indexCount += cooked.lodIndexCounts[lod];
+	}
+
+	return (size_t)cooked.vertexCount * vertexFormat.GetStride() + indexCount * (cooked.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+}
+
+void Model::SetMeshPointers(ImportedMesh* mesh)
+{
+	CookedMesh& cooked = mesh->cooked;
+	cooked.lodIndexCounts = mesh->lodIndexCounts.data();
+	cooked.lodErrors = mesh->lodErrors.data();
+	cooked.meshlets = mesh->meshlets.data();
+	cooked.vertexData = mesh->vertexData.data();
+	cooked.indexData = mesh->indexData.data();
 }
 
 Model::~Model()
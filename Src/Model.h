@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -7,26 +8,187 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "AssetLoader.h"
+#include "GeometryPool.h"
+#include "JobSystem.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshletCuller.h"
 #include "Texture.h"
+#include "TextureArray.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+
+// What the LOD selection and the meshlet culling need to know about the pass being drawn
+struct ViewParameters
+{
+	glm::vec3 viewPosition;
+	glm::mat4 viewProjection;
+	// viewport height / (2 * tan(fov / 2)): size in pixels of 1 unit seen at a distance of 1
+	float projectionScale;
+	// Biggest error allowed on screen, shadow passes can use a bigger value to get coarser LODs
+	float maxPixelError;
+	// Only when the whole pass is seen through viewProjection (not for cube maps)
+	bool cullMeshlets;
+};
 
 class Model
 {
 public:
 	Model();
 
-	void LoadModel(const std::string& fileName);
+	// If a pool is given the meshes are also added to it so the model can be drawn with AddToDrawList.
+	// The result of the import is cooked in fileName.cooked and loaded from there the next times
+	// as long as the file and the settings of the model don't change
+	void LoadModel(const std::string& fileName, GeometryPool* pool = nullptr);
+	// Same as LoadModel but the import runs on the loader threads and the meshes appear once their upload
+	// went through the loader queue. The model must stay alive and keep its settings until then
+	void LoadModelAsync(const std::string& fileName, GeometryPool* pool, AssetLoader* loader);
 	void RenderModel();
+	// Choose the LOD of each mesh from its projected error, the full detail meshes are drawn
+	// without their back facing and off screen meshlets
+	void RenderModel(const glm::mat4& model, const ViewParameters& view);
+	// Format used by the meshes created by the next LoadModel
+	void SetVertexFormat(const VertexFormat& format);
+	// Split the meshes with more than 65536 vertices so all of them can use 16 bits indices, in the geometry pool too
+	void SetSplitLargeMeshes(bool split);
+	// Number of LODs generated for each mesh by the next LoadModel, 1 means only the full mesh
+	void SetLodCount(unsigned int count);
+	// Cut the meshes of the next LoadModel in meshlets of 64 vertices and 124 triangles for the culling
+	void SetBuildMeshlets(bool build);
+	// Meshes of the next LoadModel are converted and processed in parallel on these threads
+	void SetThreadPool(ThreadPool* threads);
+	// The LOD selection and meshlet culling of the meshes are spread over these threads when drawing
+	void SetJobSystem(JobSystem* jobs);
+	// Textures of the next LoadModel come from the cache and are shared with everything else using it,
+	// without a cache the model loads and owns its own copies
+	void SetTextureCache(TextureCache* cache);
+	// Tell the streamer how big the texture of every mesh is on screen, assuming it covers the mesh once
+	void RequestTextureLevels(TextureStreamer* streamer, const glm::mat4& model, const ViewParameters& view);
+	void AddToDrawList(GeometryPool* pool, const glm::mat4& model);
+	void AddToDrawList(GeometryPool* pool, const glm::mat4& model, const ViewParameters& view);
+	// For the main pass: every draw also gets the texture of its mesh from the arrays and the material
+	void AddToDrawList(GeometryPool* pool, const glm::mat4& model, const ViewParameters& view, TextureArray* textures, const glm::vec4& material);
 	void ClearModel();
 
 	~Model();
 
 private:
-	void LoadNode(aiNode* node, const aiScene* scene);
-	void LoadMesh(aiMesh* mesh, const aiScene* scene);
-	void LoadMaterials(const aiScene* scene);
+	// Everything needed to create a mesh, built by BuildMesh or pointing in the memory mapped cache
+	struct CookedMesh
+	{
+		unsigned int materialIndex;
+		unsigned int vertexCount;
+		GLenum indexType;
+		unsigned int lodCount;
+		unsigned int meshletCount;
+		glm::vec3 boundsMin, boundsMax;
+		glm::vec3 center;
+		float radius;
+
+		const GLsizei* lodIndexCounts;
+		const float* lodErrors;
+		const Meshlet* meshlets;
+		// Packed with vertexFormat and indices of every LOD one after the other, ready for glBufferData.
+		// The geometry pool takes the same vertices
+		const void* vertexData;
+		const void* indexData;
+	};
+
+	// What the cache stores of a CookedMesh before its blocks, only 32 bits fields so there is no padding
+	struct CookedMeshHeader
+	{
+		unsigned int materialIndex;
+		unsigned int vertexCount;
+		unsigned int indexType;
+		unsigned int lodCount;
+		unsigned int meshletCount;
+		float boundsMin[3];
+		float boundsMax[3];
+		float center[3];
+		float radius;
+	};
+
+	// Output of the CPU stage of the import for one mesh, own the data of the CookedMesh.
+	// When read from the cache the vectors stay empty and the CookedMesh points in the mapping instead
+	struct ImportedMesh
+	{
+		CookedMesh cooked;
+		// Keeps the cooked file mapped until the mesh is uploaded
+		std::shared_ptr<MeshCache> mapping;
+		std::vector<GLsizei> lodIndexCounts;
+		std::vector<float> lodErrors;
+		std::vector<Meshlet> meshlets;
+		std::vector<unsigned char> vertexData;
+		std::vector<unsigned char> indexData;
+		// Printed by the GL stage so the messages of the threads don't mix
+		std::string log;
+	};
+
+	static const unsigned int IMPORT_FLAGS;
+	// Part of the cook key, bumped when the blocks of the cooked file change
+	static const unsigned int COOKED_FILE_VERSION = 2;
+
+	// CPU stage, no GL and no change to the model so they can run on any thread
+	bool ImportModel(const std::string& fileName, unsigned long long key, std::vector<std::string>* texturePaths, std::vector<ImportedMesh>* meshes);
+	void LoadNode(aiNode* node, const aiScene* scene, std::vector<const aiMesh*>* meshes);
+	void LoadMaterials(const aiScene* scene, std::vector<std::string>* texturePaths);
+	void LoadMesh(const aiMesh* mesh, size_t meshIndex, std::vector<ImportedMesh>* out);
+	void BuildMesh(std::vector<GLfloat>& vertices, std::vector<unsigned int>& indices, unsigned int materialIndex, ImportedMesh* out);
+	Texture* DecodeModelTexture(const std::string& texturePath);
+	// From the cache, on any thread with a loader and on the GL thread without
+	Texture* AcquireModelTexture(const std::string& texturePath, AssetLoader* loader);
+	// Point the CookedMesh to the vectors of the ImportedMesh
+	static void SetMeshPointers(ImportedMesh* mesh);
+	// Bytes of the vertex and index buffers of the mesh, for the upload budget
+	size_t GetUploadSize(const CookedMesh& cooked);
 
+	// GL stage
+	void LoadTextures(const std::vector<std::string>& texturePaths);
+	void AddCookedMesh(const CookedMesh& cooked);
+
+	// Cooked cache
+	unsigned long long GetCookKey(const std::string& fileName, unsigned int importFlags);
+	void WriteCookedModel(const std::string& cacheName, unsigned long long key, const std::vector<std::string>& texturePaths, const std::vector<ImportedMesh>& meshes);
+	// False if a block doesn't have the size its header gives, the model is then imported again
+	bool ParseCookedModel(MeshCache* cache, std::vector<std::string>* texturePaths, std::vector<CookedMesh>* meshes);
+	// Upload from the mapped file
+	bool LoadCookedModel(const std::string& cacheName, unsigned long long key);
+	// Parse the mapped file for a later upload, the meshes keep it mapped until then
+	bool ReadCookedModel(const std::string& cacheName, unsigned long long key, std::vector<std::string>* texturePaths, std::vector<ImportedMesh>* meshes);
+	unsigned int SelectLod(size_t meshIndex, const glm::mat4& model, const ViewParameters& view);
+	// LOD of every mesh in selectedLods and, with cullMeshlets, the visible ranges of the full detail ones.
+	// Spread over the job threads, nothing here touches GL
+	void CullMeshes(const glm::mat4& model, const ViewParameters& view, bool cullMeshlets);
+
+	// Empty when the meshes are in the geometry pool
 	std::vector<Mesh*> meshList;
 	std::vector<Texture*> textureList;
 	std::vector<unsigned int> meshToTex;
+
+	VertexFormat vertexFormat;
+	bool splitLargeMeshes;
+	unsigned int lodCount;
+	bool buildMeshlets;
+
+	// For each mesh: geometric error of every LOD and bounding sphere in model space
+	std::vector<std::vector<float>> lodErrors;
+	std::vector<glm::vec3> boundingCenters;
+	std::vector<float> boundingRadii;
+
+	// nullptr for the meshes without meshlets
+	std::vector<MeshletCuller*> meshletCullers;
+	// Result of the culling of each mesh for the draw being made
+	std::vector<unsigned int> selectedLods;
+	std::vector<std::vector<GLuint>> visibleFirstIndices;
+	std::vector<std::vector<GLsizei>> visibleIndexCounts;
+
+	ThreadPool* threadPool;
+	JobSystem* jobSystem;
+	TextureCache* textureCache;
+
+	GeometryPool* geometryPool;
+	// Pool mesh id of every LOD of each mesh
+	std::vector<std::vector<int>> poolMeshIds;
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "OmniShadowMap.h"
 
+#include "DebugLayer.h"
+
 OmniShadowMap::OmniShadowMap() : ShadowMap() {}
 
 bool OmniShadowMap::Init(GLuint width, GLuint height)
@@ -24,6 +26,8 @@ bool OmniShadowMap::Init(GLuint width, GLuint height)
 
 	glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMap, 0);
+	DebugLayer::Label(GL_TEXTURE, shadowMap, "Omni shadow map");
+	DebugLayer::Label(GL_FRAMEBUFFER, FBO, "Omni shadow map");
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
 
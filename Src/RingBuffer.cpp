@@ -0,0 +1,127 @@
+#include "RingBuffer.h"
+
+#include <stdio.h>
+
+#include "DebugLayer.h"
+
+RingBuffer::RingBuffer()
+{
+	buffer = 0;
+	mapping = nullptr;
+	frameSize = 0;
+	frame = 0;
+	used = 0;
+	stallCount = 0;
+	for (int i = 0; i < FRAME_COUNT; i++)
+	{
+		fences[i] = 0;
+	}
+}
+
+bool RingBuffer::IsSupported()
+{
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+bool RingBuffer::Init(size_t frameSize, const char* label)
+{
+	this->frameSize = frameSize;
+
+	// Coherent: what the CPU writes is seen by the next draws without a flush
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * FRAME_COUNT, nullptr, flags);
+	mapping = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * FRAME_COUNT, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (!mapping)
+	{
+		printf("Failed to map the ring buffer: %s\n", label);
+		Clear();
+		return false;
+	}
+
+	DebugLayer::Label(GL_BUFFER, buffer, label);
+
+	frame = 0;
+	used = 0;
+	return true;
+}
+
+void RingBuffer::BeginFrame()
+{
+	used = 0;
+
+	if (fences[frame] == 0)
+	{
+		return;
+	}
+
+	GLenum result = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		stallCount++;
+		while (result == GL_TIMEOUT_EXPIRED)
+		{
+			result = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+	}
+
+	glDeleteSync(fences[frame]);
+	fences[frame] = 0;
+}
+
+void* RingBuffer::Allocate(size_t size, size_t alignment, GLintptr* offset)
+{
+	size_t start = (used + alignment - 1) / alignment * alignment;
+	if (!mapping || start + size > frameSize)
+	{
+		return nullptr;
+	}
+
+	used = start + size;
+	*offset = (GLintptr)(frame * frameSize + start);
+	return mapping + *offset;
+}
+
+void RingBuffer::EndFrame()
+{
+	if (!mapping)
+	{
+		return;
+	}
+
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame = (frame + 1) % FRAME_COUNT;
+}
+
+void RingBuffer::Clear()
+{
+	for (int i = 0; i < FRAME_COUNT; i++)
+	{
+		if (fences[i] != 0)
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	}
+
+	if (buffer != 0)
+	{
+		if (mapping)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+	mapping = nullptr;
+}
+
+RingBuffer::~RingBuffer()
+{
+}
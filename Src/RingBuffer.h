@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+// Triple buffered stream of per frame data in one buffer mapped once for good (ARB_buffer_storage, core in 4.4).
+// The CPU writes straight into the mapping and the draws read it by range, nothing goes through glBufferSubData
+// so the driver never copies nor synchronises behind our back. A fence at the end of every frame tells when
+// the GPU is done with its third, BeginFrame only waits if the GPU is more than two frames late
+class RingBuffer
+{
+public:
+	RingBuffer();
+
+	static bool IsSupported();
+
+	// frameSize bytes for each of the frames in flight
+	bool Init(size_t frameSize, const char* label);
+
+	// Once per frame before the first Allocate
+	void BeginFrame();
+	// size bytes of the current frame at a multiple of alignment, nullptr once the frame is full.
+	// offset is where they are in GetBuffer()
+	void* Allocate(size_t size, size_t alignment, GLintptr* offset);
+	// After the last draw reading the frame
+	void EndFrame();
+
+	bool IsInitialised() { return mapping != nullptr; }
+	GLuint GetBuffer() { return buffer; }
+	// How many times BeginFrame had to wait for the GPU
+	unsigned int GetStallCount() { return stallCount; }
+
+	void Clear();
+
+	~RingBuffer();
+
+private:
+	static const int FRAME_COUNT = 3;
+
+	GLuint buffer;
+	unsigned char* mapping;
+	size_t frameSize;
+
+	int frame;
+	// In the current frame
+	size_t used;
+	GLsync fences[FRAME_COUNT];
+	unsigned int stallCount;
+};
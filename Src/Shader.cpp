@@ -1,11 +1,19 @@
 #include "Shader.h"
 
+#include "DebugLayer.h"
+#include "MeshCache.h"
+
+bool Shader::parallelCompile = false;
+
 Shader::Shader()
 {
 	shaderID = 0;
 	uniformModel = 0;
 	uniformProjection = 0;
 
+	compilePending = false;
+	cacheKey = 0;
+
 	pointLightCount = 0;
 	spotLightCount = 0;
 }
@@ -15,43 +23,185 @@ void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode)
 	CompileShader(vertexCode, fragmentCode);
 }
 
+void Shader::InitParallelCompile()
+{
+	// Let the driver use as many threads as it wants for the compiles
+	if (GLEW_KHR_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		parallelCompile = true;
+	}
+	else if (GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		parallelCompile = true;
+	}
+}
+
+bool Shader::IsReady()
+{
+	if (!compilePending || !parallelCompile)
+	{
+		return true;
+	}
+
+	GLint done = 0;
+	glGetProgramiv(shaderID, GL_COMPLETION_STATUS_KHR, &done);
+	return done != 0;
+}
+
+bool Shader::UsesFile(const std::string& fileLocation)
+{
+	return sourceFiles.count(fileLocation) > 0;
+}
+
+bool Shader::Reload()
+{
+	if (stageFiles.empty())
+	{
+		return false;
+	}
+
+	FinishCompile();
+	GLuint previousID = shaderID;
+
+	// CreateFromFiles fills them again
+	std::vector<std::string> files = stageFiles;
+	if (files.size() == 1)
+	{
+		CreateComputeFromFile(files[0].c_str());
+	}
+	else if (files.size() == 3)
+	{
+		CreateFromFiles(files[0].c_str(), files[1].c_str(), files[2].c_str());
+	}
+	else
+	{
+		CreateFromFiles(files[0].c_str(), files[1].c_str());
+	}
+
+	if (shaderID == 0 || !FinishCompile())
+	{
+		std::cout << "Keeping the previous program of " << files[0] << std::endl;
+		if (shaderID != 0)
+		{
+			glDeleteProgram(shaderID);
+		}
+		shaderID = previousID;
+		return false;
+	}
+
+	glDeleteProgram(previousID);
+	return true;
+}
+
+void Shader::SetDefines(const std::string& defines)
+{
+	this->defines = defines;
+}
+
 void Shader::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation)
 {
-	std::string vertexString = ReadFile(vertexLocation);
-	std::string fragmentString = ReadFile(fragmentLocation);
+	stageFiles.clear();
+	stageFiles.push_back(vertexLocation);
+	stageFiles.push_back(fragmentLocation);
+	sourceFiles.clear();
+
+	std::string vertexString = AddDefines(ReadStage(vertexLocation));
+	std::string fragmentString = AddDefines(ReadStage(fragmentLocation));
 	const char* vertexCode = vertexString.c_str();
 	const char* fragmentCode = fragmentString.c_str();
 
-	CompileShader(vertexCode, fragmentCode);
+	CompileShader(vertexCode, fragmentCode, GetCacheName());
+	DebugLayer::Label(GL_PROGRAM, shaderID, GetLabel());
 }
 
 void Shader::CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation)
 {
-	std::string vertexString = ReadFile(vertexLocation);
-	std::string geometryString = ReadFile(geometryLocation);
-	std::string fragmentString = ReadFile(fragmentLocation);
+	stageFiles.clear();
+	stageFiles.push_back(vertexLocation);
+	stageFiles.push_back(geometryLocation);
+	stageFiles.push_back(fragmentLocation);
+	sourceFiles.clear();
+
+	std::string vertexString = AddDefines(ReadStage(vertexLocation));
+	std::string geometryString = AddDefines(ReadStage(geometryLocation));
+	std::string fragmentString = AddDefines(ReadStage(fragmentLocation));
 	const char* vertexCode = vertexString.c_str();
 	const char* geometryCode = geometryString.c_str();
 	const char* fragmentCode = fragmentString.c_str();
 
-	CompileShader(vertexCode, geometryCode, fragmentCode);
+	CompileShader(vertexCode, geometryCode, fragmentCode, GetCacheName());
+	DebugLayer::Label(GL_PROGRAM, shaderID, GetLabel());
+}
+
+void Shader::CreateComputeFromFile(const char* computeLocation)
+{
+	stageFiles.clear();
+	stageFiles.push_back(computeLocation);
+	sourceFiles.clear();
+
+	std::string computeString = AddDefines(ReadStage(computeLocation));
+
+	CompileComputeShader(computeString.c_str(), GetCacheName());
+	DebugLayer::Label(GL_PROGRAM, shaderID, GetLabel());
 }
 
 std::string Shader::ReadFile(const char* fileLocation)
+{
+	std::set<std::string> included;
+	return ReadFile(fileLocation, &included);
+}
+
+std::string Shader::ReadStage(const char* fileLocation)
+{
+	std::set<std::string> included;
+	std::string content = ReadFile(fileLocation, &included);
+	sourceFiles.insert(included.begin(), included.end());
+	return content;
+}
+
+std::string Shader::ReadFile(const std::string& fileLocation, std::set<std::string>* included)
 {
 	std::string content;
-	std::ifstream fileStream(fileLocation, std::ios::in);
+	std::ifstream fileStream(fileLocation.c_str(), std::ios::in);
 
 	if (!fileStream.is_open())
 	{
 		std::cout << "Failed to read " << fileLocation << "! File doesn't exist." << std::endl;
 		return "";
 	}
+	included->insert(fileLocation);
+
+	// Included files are relative to the one including them
+	size_t slash = fileLocation.find_last_of("/\\");
+	std::string directory = slash != std::string::npos ? fileLocation.substr(0, slash + 1) : "";
 
 	std::string line = "";
 	while (!fileStream.eof())
 	{
 		std::getline(fileStream, line);
+
+		size_t start = line.find_first_not_of(" \t");
+		if (start != std::string::npos && line.compare(start, 8, "#include") == 0)
+		{
+			size_t open = line.find('"', start);
+			size_t close = open != std::string::npos ? line.find('"', open + 1) : std::string::npos;
+			if (close == std::string::npos)
+			{
+				std::cout << "Bad #include in " << fileLocation << ": " << line << std::endl;
+				continue;
+			}
+
+			// Every file goes in once, like with include guards
+			std::string includeLocation = directory + line.substr(open + 1, close - open - 1);
+			if (!included->count(includeLocation))
+			{
+				content.append(ReadFile(includeLocation, included));
+			}
+			continue;
+		}
+
 		content.append(line + "\n");
 	}
 
@@ -59,8 +209,62 @@ std::string Shader::ReadFile(const char* fileLocation)
 	return content;
 }
 
+std::string Shader::AddDefines(const std::string& source)
+{
+	if (defines.empty())
+	{
+		return source;
+	}
+
+	// Right after #version, it must stay the first line
+	size_t version = source.find("#version");
+	size_t lineEnd = version != std::string::npos ? source.find('\n', version) : std::string::npos;
+	if (lineEnd == std::string::npos)
+	{
+		return defines + source;
+	}
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+}
+
+std::string Shader::GetCacheName()
+{
+	// Every stage and the defines are in the name, programs sharing their vertex shader like the forward
+	// and the g-buffer ones get a file each instead of overwriting each other's
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < stageFiles.size(); i++)
+	{
+		hash = MeshCache::HashData(hash, stageFiles[i].c_str(), stageFiles[i].size() + 1);
+	}
+	hash = MeshCache::HashData(hash, defines.data(), defines.size());
+
+	char name[32] = { '\0' };
+	snprintf(name, sizeof(name), ".%016llx", hash);
+	return stageFiles[0] + name + ".program";
+}
+
+std::string Shader::GetLabel()
+{
+	// The files and the names of the defines, "Shaders/shader.frag SHADOWS SPECULAR" for example
+	std::string label = stageFiles.empty() ? "" : stageFiles.back();
+	size_t start = 0;
+	while ((start = defines.find("#define ", start)) != std::string::npos)
+	{
+		start += 8;
+		size_t end = defines.find_first_of(" \n", start);
+		label += " " + defines.substr(start, end - start);
+	}
+	return label;
+}
+
 void Shader::Validate()
 {
+	if (!DebugLayer::IsEnabled())
+	{
+		return;
+	}
+
+	FinishCompile();
+
 	GLint result = 0;
 	GLchar eLog[1024] = { 0 };
 
@@ -74,21 +278,64 @@ void Shader::Validate()
 	}
 }
 
-void Shader::CompileProgram()
+void Shader::CompileProgram(const std::string& cacheName, unsigned long long cacheKey)
 {
+	if (ShaderCache::IsEnabled() && !cacheName.empty())
+	{
+		glProgramParameteri(shaderID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Link the program, its status is only asked for by FinishCompile so the driver can work on it meanwhile
+	glLinkProgram(shaderID);
+
+	this->cacheName = cacheName;
+	this->cacheKey = cacheKey;
+	compilePending = true;
+}
+
+bool Shader::FinishCompile()
+{
+	if (!compilePending)
+	{
+		return true;
+	}
+	compilePending = false;
+
 	GLint result = 0;
 	GLchar eLog[1024] = { 0 };
 
-	// Link the program
-	glLinkProgram(shaderID);
+	for (size_t i = 0; i < pendingStages.size(); i++)
+	{
+		glGetShaderiv(pendingStages[i], GL_COMPILE_STATUS, &result);
+		if (!result)
+		{
+			GLint shaderType = 0;
+			glGetShaderiv(pendingStages[i], GL_SHADER_TYPE, &shaderType);
+			glGetShaderInfoLog(pendingStages[i], sizeof(eLog), NULL, eLog);
+			std::cout << "Error compiling the " << shaderType << "shader: " << eLog << std::endl;
+		}
+
+		// The program keeps what it needs once linked
+		glDetachShader(shaderID, pendingStages[i]);
+		glDeleteShader(pendingStages[i]);
+	}
+	pendingStages.clear();
+
 	glGetProgramiv(shaderID, GL_LINK_STATUS, &result);
 	if (!result)
 	{
 		glGetProgramInfoLog(shaderID, sizeof(eLog), NULL, eLog);
 		std::cout << "Error linking program: " << eLog << std::endl;
-		return;
+		return false;
 	}
 
+	ShaderCache::Save(shaderID, cacheName, cacheKey);
+	GetUniformLocations();
+	return true;
+}
+
+void Shader::GetUniformLocations()
+{
 	// directional Light
 	uniformProjection = glGetUniformLocation(shaderID, "projection");
 	uniformModel = glGetUniformLocation(shaderID, "model");
@@ -164,10 +411,25 @@ void Shader::CompileProgram()
 	uniformTexture = glGetUniformLocation(shaderID, "theTexture");
 	uniformDirectionalShadowMap = glGetUniformLocation(shaderID, "directionalShadowMap");
 
+	// Texture arrays of the indirect main pass
+	for (size_t i = 0; i < MAX_TEXTURE_ARRAYS; i++)
+	{
+		char locBuff[100] = { '\0' };
+
+		snprintf(locBuff, sizeof(locBuff), "textureArrays[%zu]", i);
+		uniformTextureArrays[i] = glGetUniformLocation(shaderID, locBuff);
+	}
+
 	// OmniLight shadowMap
 	uniformOmniLightPos = glGetUniformLocation(shaderID, "lightPos");
 	uniformFarPlane = glGetUniformLocation(shaderID, "farPlane");
 
+	// Deferred lighting
+	uniformInverseViewProjection = glGetUniformLocation(shaderID, "inverseViewProjection");
+	uniformGBuffer[0] = glGetUniformLocation(shaderID, "gAlbedoSpecular");
+	uniformGBuffer[1] = glGetUniformLocation(shaderID, "gNormalShininess");
+	uniformGBuffer[2] = glGetUniformLocation(shaderID, "gDepth");
+
 	for (size_t i = 0; i < 6; i++)
 	{
 		char locBuff[100] = { '\0' };
@@ -177,7 +439,7 @@ void Shader::CompileProgram()
 	}
 }
 
-void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
+void Shader::CompileShader(const char* vertexCode, const char* fragmentCode, const std::string& cacheName)
 {
 	shaderID = glCreateProgram();
 
@@ -187,13 +449,23 @@ void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 		return;
 	}
 
+	std::vector<const char*> sources;
+	sources.push_back(vertexCode);
+	sources.push_back(fragmentCode);
+	unsigned long long cacheKey = ShaderCache::GetKey(sources);
+	if (ShaderCache::Load(shaderID, cacheName, cacheKey))
+	{
+		GetUniformLocations();
+		return;
+	}
+
 	AddShader(shaderID, vertexCode, GL_VERTEX_SHADER);
 	AddShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER);
 
-	CompileProgram();
+	CompileProgram(cacheName, cacheKey);
 }
 
-void Shader::CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode)
+void Shader::CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode, const std::string& cacheName)
 {
 	shaderID = glCreateProgram();
 
@@ -203,61 +475,113 @@ void Shader::CompileShader(const char* vertexCode, const char* geometryCode, con
 		return;
 	}
 
+	std::vector<const char*> sources;
+	sources.push_back(vertexCode);
+	sources.push_back(geometryCode);
+	sources.push_back(fragmentCode);
+	unsigned long long cacheKey = ShaderCache::GetKey(sources);
+	if (ShaderCache::Load(shaderID, cacheName, cacheKey))
+	{
+		GetUniformLocations();
+		return;
+	}
+
 	AddShader(shaderID, vertexCode, GL_VERTEX_SHADER);
 	AddShader(shaderID, geometryCode, GL_GEOMETRY_SHADER);
 	AddShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER);
 
-	CompileProgram();
+	CompileProgram(cacheName, cacheKey);
+}
+
+void Shader::CompileComputeShader(const char* computeCode, const std::string& cacheName)
+{
+	shaderID = glCreateProgram();
+
+	if (!shaderID)
+	{
+		std::cout << "Error creating shader program!" << std::endl;
+		return;
+	}
+
+	std::vector<const char*> sources;
+	sources.push_back(computeCode);
+	unsigned long long cacheKey = ShaderCache::GetKey(sources);
+	if (ShaderCache::Load(shaderID, cacheName, cacheKey))
+	{
+		GetUniformLocations();
+		return;
+	}
+
+	AddShader(shaderID, computeCode, GL_COMPUTE_SHADER);
+
+	CompileProgram(cacheName, cacheKey);
 }
 
 GLuint Shader::GetProjectionLocation()
 {
+	FinishCompile();
 	return uniformProjection;
 }
 GLuint Shader::GetModelLocation()
 {
+	FinishCompile();
 	return uniformModel;
 }
 GLuint Shader::GetViewLocation()
 {
+	FinishCompile();
 	return uniformView;
 }
 GLuint Shader::GetAmbientIntensityLocation()
 {
+	FinishCompile();
 	return uniformDirectionalLight.uniformAmbientIntensity;
 }
 GLuint Shader::GetAmbientColourLocation()
 {
+	FinishCompile();
 	return uniformDirectionalLight.uniformColour;
 }
 GLuint Shader::GetDiffuseIntensityLocation()
 {
+	FinishCompile();
 	return uniformDirectionalLight.uniformDiffuseIntensity;
 }
 GLuint Shader::GetDirectionLocation()
 {
+	FinishCompile();
 	return uniformDirectionalLight.uniformDirection;
 }
 GLuint Shader::GetSpecularIntensityLocation()
 {
+	FinishCompile();
 	return uniformSpecularIntensity;
 }
 GLuint Shader::GetShininessLocation()
 {
+	FinishCompile();
 	return uniformShininess;
 }
 GLuint Shader::GetEyePositionLocation()
 {
+	FinishCompile();
 	return uniformEyePosition;
 }
 GLuint Shader::GetOmniLightPosLocation()
 {
+	FinishCompile();
 	return uniformOmniLightPos;
 }
 GLuint Shader::GetFarPlaneLocation()
 {
+	FinishCompile();
 	return uniformFarPlane;
 }
+GLuint Shader::GetInverseViewProjectionLocation()
+{
+	FinishCompile();
+	return uniformInverseViewProjection;
+}
 
 void Shader::SetDirectionalLight(DirectionalLight* dLight)
 {
@@ -311,6 +635,22 @@ void Shader::SetTexture(GLuint textureUnit)
 	glUniform1i(uniformTexture, textureUnit);
 }
 
+void Shader::SetTextureArrays(GLuint firstTextureUnit)
+{
+	for (size_t i = 0; i < MAX_TEXTURE_ARRAYS; i++)
+	{
+		glUniform1i(uniformTextureArrays[i], firstTextureUnit + i);
+	}
+}
+
+void Shader::SetGBuffer(GLuint firstTextureUnit)
+{
+	for (size_t i = 0; i < 3; i++)
+	{
+		glUniform1i(uniformGBuffer[i], firstTextureUnit + i);
+	}
+}
+
 void Shader::SetDirectionalShadowMap(GLuint textureUnit)
 {
 	glUniform1i(uniformDirectionalShadowMap, textureUnit);
@@ -332,11 +672,19 @@ void Shader::SetOmniLightMatrices(std::vector<glm::mat4> lightMatrices)
 
 void Shader::UseShader()
 {
+	FinishCompile();
 	glUseProgram(shaderID);
 }
 
 void Shader::ClearShader()
 {
+	for (size_t i = 0; i < pendingStages.size(); i++)
+	{
+		glDeleteShader(pendingStages[i]);
+	}
+	pendingStages.clear();
+	compilePending = false;
+
 	if (shaderID != 0)
 	{
 		glDeleteProgram(shaderID);
@@ -360,18 +708,9 @@ void Shader::AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderT
 	glShaderSource(theShader, 1, theCode, codeLength);
 	glCompileShader(theShader);
 
-	GLint result = 0;
-	GLchar eLog[1024] = { 0 };
-
-	glGetShaderiv(theShader, GL_COMPILE_STATUS, &result);
-	if (!result)
-	{
-		glGetShaderInfoLog(theShader, sizeof(eLog), NULL, eLog);
-		std::cout << "Error compiling the " << shaderType << "shader: " << eLog << std::endl;
-		return;
-	}
-
+	// Not waiting for the result here, FinishCompile prints the errors
 	glAttachShader(theProgram, theShader);
+	pendingStages.push_back(theShader);
 }
 
 Shader::~Shader()
@@ -4,12 +4,15 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <set>
+#include <vector>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "CommonValues.h"
+#include "ShaderCache.h"
 
 #include "DirectionalLight.h"
 #include "PointLight.h"
@@ -23,9 +26,27 @@ public:
 	void CreateFromString(const char* vertexCode, const char* fragmentCode);
 	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation);
 	void CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation);
+	// Compute program, GL 4.3
+	void CreateComputeFromFile(const char* computeLocation);
+	// Added after the #version line of every stage by the next CreateFromFiles, "#define SHADOWS\n" for example
+	void SetDefines(const std::string& defines);
 
+	// glValidateProgram is a round trip to the driver, it only runs with the debug layer on
 	void Validate();
 
+	// With KHR_parallel_shader_compile the driver compiles on its own threads: CreateFromFiles only submits
+	// the work and the first use of the program waits for it. Once after the context is created
+	static void InitParallelCompile();
+	// The program can be used without waiting, always true without the extension
+	bool IsReady();
+
+	// Hot reload: the stages and the files they include
+	bool UsesFile(const std::string& fileLocation);
+	// Compile again from the same files and defines and wait for it. On error the messages are printed
+	// and the previous program stays in use. The uniforms must be set again
+	bool Reload();
+
+	// The lines #include "file" are replaced by the file, relative to the one including it
 	std::string ReadFile(const char* fileLocation);
 
 	GLuint GetProjectionLocation();
@@ -40,11 +61,16 @@ public:
 	GLuint GetEyePositionLocation();
 	GLuint GetOmniLightPosLocation();
 	GLuint GetFarPlaneLocation();
+	GLuint GetInverseViewProjectionLocation();
 
 	void SetDirectionalLight(DirectionalLight* dLight);
 	void SetPointLights(PointLight* pLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset);
 	void SetSpotLights(SpotLight* sLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset);
 	void SetTexture(GLuint textureUnit);
+	// textureArrays[i] of shader_indirect.frag on firstTextureUnit + i
+	void SetTextureArrays(GLuint firstTextureUnit);
+	// gAlbedoSpecular, gNormalShininess and gDepth of deferred_tiled.comp from firstTextureUnit
+	void SetGBuffer(GLuint firstTextureUnit);
 	void SetDirectionalShadowMap(GLuint textureUnit);
 	void SetDirectionalLightTransform(glm::mat4* lTransform);
 	void SetOmniLightMatrices(std::vector<glm::mat4> lightMatrices);
@@ -58,13 +84,29 @@ private:
 	int pointLightCount;
 	int spotLightCount;
 
+	std::string defines;
+
+	// Given to CreateFromFiles, empty for CreateFromString
+	std::vector<std::string> stageFiles;
+	std::set<std::string> sourceFiles;
+
+	static bool parallelCompile;
+	// Stages compiled and linked by the driver, checked by FinishCompile
+	bool compilePending;
+	std::vector<GLuint> pendingStages;
+	std::string cacheName;
+	unsigned long long cacheKey;
+
 	GLuint shaderID, uniformProjection, uniformModel, uniformView, uniformEyePosition,
 		uniformSpecularIntensity, uniformShininess,
 		uniformTexture, uniformDirectionalShadowMap,
 		uniformDirectionalLightTransform,
-		uniformOmniLightPos, uniformFarPlane;
+		uniformOmniLightPos, uniformFarPlane,
+		uniformInverseViewProjection;
 
 	GLuint uniformLightMatrices[6];
+	GLuint uniformTextureArrays[MAX_TEXTURE_ARRAYS];
+	GLuint uniformGBuffer[3];
 
 	struct {
 		GLuint uniformColour;
@@ -108,9 +150,23 @@ private:
 		GLuint uniformFarPlane;
 	} uniformOmniShadowMap[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
 
-	void CompileProgram();
-	void CompileShader(const char* vertexCode, const char* fragmentCode);
-	void CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode);
+	// Link and save the binary in cacheName (see ShaderCache) if it isn't empty
+	void CompileProgram(const std::string& cacheName, unsigned long long cacheKey);
+	std::string ReadFile(const std::string& fileLocation, std::set<std::string>* included);
+	// ReadFile of a stage, its files are added to sourceFiles
+	std::string ReadStage(const char* fileLocation);
+	std::string AddDefines(const std::string& source);
+	// Binary file of the program, named after its first stage and hashed with every stage and the defines
+	std::string GetCacheName();
+	// For the debug layer
+	std::string GetLabel();
+	// Wait for the compile and the link, print their errors, save the binary and get the uniforms
+	// False if the program can't be used
+	bool FinishCompile();
+	void GetUniformLocations();
+	void CompileShader(const char* vertexCode, const char* fragmentCode, const std::string& cacheName = "");
+	void CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode, const std::string& cacheName = "");
+	void CompileComputeShader(const char* computeCode, const std::string& cacheName = "");
 	void AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType);
 };
 
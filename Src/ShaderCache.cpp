@@ -0,0 +1,157 @@
+#include "ShaderCache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "MeshCache.h"
+
+bool ShaderCache::enabled = false;
+unsigned long long ShaderCache::driverHash = 0;
+unsigned int ShaderCache::loadedCount = 0;
+unsigned int ShaderCache::compiledCount = 0;
+
+void ShaderCache::Init()
+{
+	GLint formatCount = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+	{
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	}
+	enabled = formatCount > 0;
+
+	// The binaries are only valid for the driver that made them
+	driverHash = 14695981039346656037ull;
+	GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+	for (size_t i = 0; i < 4; i++)
+	{
+		const char* value = (const char*)glGetString(names[i]);
+		if (value)
+		{
+			driverHash = MeshCache::HashData(driverHash, value, strlen(value));
+		}
+	}
+
+	loadedCount = 0;
+	compiledCount = 0;
+}
+
+unsigned long long ShaderCache::GetKey(const std::vector<const char*>& sources)
+{
+	unsigned long long key = MeshCache::HashValue(driverHash, VERSION);
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		key = MeshCache::HashData(key, sources[i], strlen(sources[i]));
+		// So moving code from one stage to the next isn't the same program
+		key = MeshCache::HashValue(key, i);
+	}
+	return key;
+}
+
+bool ShaderCache::Load(GLuint program, const std::string& fileName, unsigned long long key)
+{
+	if (!enabled || fileName.empty())
+	{
+		return false;
+	}
+
+	// Counted here as the program is saved only once its compile is done, maybe after PrintStats
+	if (!LoadFile(program, fileName, key))
+	{
+		compiledCount++;
+		return false;
+	}
+
+	return true;
+}
+
+bool ShaderCache::LoadFile(GLuint program, const std::string& fileName, unsigned long long key)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	Header header;
+	std::vector<unsigned char> binary;
+	bool read = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "SPRG", 4) == 0
+		&& header.version == VERSION && header.key == key && header.length > 0;
+	if (read)
+	{
+		binary.resize(header.length);
+		read = fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+
+	if (!read)
+	{
+		return false;
+	}
+
+	glProgramBinary(program, header.binaryFormat, binary.data(), header.length);
+
+	// The driver can still refuse it, for example after an update that kept the same version string
+	GLint result = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	if (!result)
+	{
+		printf("Program binary rejected by the driver, compiling again: %s\n", fileName.c_str());
+		return false;
+	}
+
+	loadedCount++;
+	return true;
+}
+
+bool ShaderCache::Save(GLuint program, const std::string& fileName, unsigned long long key)
+{
+	if (!enabled || fileName.empty())
+	{
+		return false;
+	}
+
+	Header header;
+	memcpy(header.magic, "SPRG", 4);
+	header.version = VERSION;
+	header.key = key;
+	header.binaryFormat = 0;
+	header.length = 0;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+	if (header.length <= 0)
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> binary(header.length);
+	glGetProgramBinary(program, header.length, &header.length, &header.binaryFormat, binary.data());
+
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if (!file)
+	{
+		printf("Failed to write the program binary: %s\n", fileName.c_str());
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, header.length, file) == (size_t)header.length;
+	fclose(file);
+	if (!written)
+	{
+		// A truncated file would only be rejected on the next load, don't leave it there
+		remove(fileName.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void ShaderCache::PrintStats()
+{
+	if (!enabled)
+	{
+		printf("Program binary cache: not supported by the driver\n");
+		return;
+	}
+
+	printf("Program binary cache: %u programs loaded, %u compiled\n", loadedCount, compiledCount);
+}
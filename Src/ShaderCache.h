@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Linked programs saved with glGetProgramBinary next to their vertex shader (".program") so the next runs
+// give them back to glProgramBinary and never call the GLSL compiler. The key kept in the file hashes the
+// sources with the vendor, renderer and version of the driver: after a driver update the load fails and
+// the program is compiled and saved again
+class ShaderCache
+{
+public:
+	// On the GL thread once the context exists. The cache stays off without it or if the driver has no binary format
+	static void Init();
+	static bool IsEnabled() { return enabled; }
+
+	static unsigned long long GetKey(const std::vector<const char*>& sources);
+
+	// Give the saved binary to program, it's then linked. False if there is no file, it was saved with
+	// another key or the driver rejects it: the program can still be compiled and linked as usual
+	static bool Load(GLuint program, const std::string& fileName, unsigned long long key);
+	// program must be linked, with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before
+	static bool Save(GLuint program, const std::string& fileName, unsigned long long key);
+
+	// How many programs came from the cache and how many had to be compiled since Init
+	static void PrintStats();
+
+private:
+	struct Header
+	{
+		char magic[4];
+		unsigned int version;
+		unsigned long long key;
+		GLenum binaryFormat;
+		GLint length;
+	};
+
+	static const unsigned int VERSION = 1;
+
+	static bool LoadFile(GLuint program, const std::string& fileName, unsigned long long key);
+
+	static bool enabled;
+	static unsigned long long driverHash;
+	static unsigned int loadedCount;
+	static unsigned int compiledCount;
+};
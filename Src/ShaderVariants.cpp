@@ -0,0 +1,89 @@
+#include "ShaderVariants.h"
+
+#include <stdio.h>
+
+ShaderVariants::ShaderVariants()
+{
+}
+
+void ShaderVariants::Init(const std::string& vertexLocation, const std::string& fragmentLocation)
+{
+	this->vertexLocation = vertexLocation;
+	this->fragmentLocation = fragmentLocation;
+	computeLocation.clear();
+}
+
+void ShaderVariants::InitCompute(const std::string& computeLocation)
+{
+	vertexLocation.clear();
+	fragmentLocation.clear();
+	this->computeLocation = computeLocation;
+}
+
+Shader* ShaderVariants::Get(unsigned int features)
+{
+	std::map<unsigned int, Shader*>::iterator found = variants.find(features);
+	if (found != variants.end())
+	{
+		return found->second;
+	}
+
+	Shader* shader = new Shader();
+	shader->SetDefines(GetDefines(features));
+	if (!computeLocation.empty())
+	{
+		shader->CreateComputeFromFile(computeLocation.c_str());
+	}
+	else
+	{
+		shader->CreateFromFiles(vertexLocation.c_str(), fragmentLocation.c_str());
+	}
+	variants[features] = shader;
+	return shader;
+}
+
+std::string ShaderVariants::GetDefines(unsigned int features)
+{
+	const char* names[FEATURE_COUNT] = { "SHADOWS", "SOFT_SHADOWS", "POINT_LIGHTS", "SPOT_LIGHTS", "SPECULAR" };
+
+	char sizes[128] = { '\0' };
+	snprintf(sizes, sizeof(sizes), "#define MAX_POINT_LIGHTS %d\n#define MAX_SPOT_LIGHTS %d\n#define MAX_TEXTURE_ARRAYS %d\n",
+		MAX_POINT_LIGHTS, MAX_SPOT_LIGHTS, MAX_TEXTURE_ARRAYS);
+
+	std::string defines = sizes;
+	for (int i = 0; i < FEATURE_COUNT; i++)
+	{
+		if (features & (1 << i))
+		{
+			defines += std::string("#define ") + names[i] + "\n";
+		}
+	}
+	return defines;
+}
+
+int ShaderVariants::Reload(const std::string& fileLocation)
+{
+	int reloaded = 0;
+	for (std::map<unsigned int, Shader*>::iterator it = variants.begin(); it != variants.end(); ++it)
+	{
+		if (it->second->UsesFile(fileLocation) && it->second->Reload())
+		{
+			reloaded++;
+		}
+	}
+	return reloaded;
+}
+
+void ShaderVariants::Clear()
+{
+	for (std::map<unsigned int, Shader*>::iterator it = variants.begin(); it != variants.end(); ++it)
+	{
+		delete it->second;
+	}
+	variants.clear();
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	Clear();
+}
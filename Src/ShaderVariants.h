@@ -0,0 +1,52 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "CommonValues.h"
+#include "Shader.h"
+
+// Every program built from the same sources with a different set of features. A variant is compiled the
+// first time its combination is asked for (or loaded from its program binary) and kept for the next ones.
+// Each feature bit gives a #define to the sources, so a material only pays for the code it needs
+class ShaderVariants
+{
+public:
+	enum Feature
+	{
+		// Directional and omni shadow maps
+		FEATURE_SHADOWS = 1 << 0,
+		// 3x3 PCF on the directional shadow map and 20 samples in the cube maps, else a single one
+		FEATURE_SOFT_SHADOWS = 1 << 1,
+		FEATURE_POINT_LIGHTS = 1 << 2,
+		FEATURE_SPOT_LIGHTS = 1 << 3,
+		// Off for the materials without specular intensity
+		FEATURE_SPECULAR = 1 << 4,
+		FEATURE_COUNT = 5
+	};
+
+	ShaderVariants();
+
+	void Init(const std::string& vertexLocation, const std::string& fragmentLocation);
+	// Variants of a compute program
+	void InitCompute(const std::string& computeLocation);
+
+	// Must be called on the GL thread. The first time the compile is only submitted, see Shader::IsReady
+	Shader* Get(unsigned int features);
+
+	// The #define lines of features, with the sizes of the arrays shared with the C++ side
+	static std::string GetDefines(unsigned int features);
+
+	// Reload the variants compiled from fileLocation, the next ones read it anyway. Return how many were reloaded
+	int Reload(const std::string& fileLocation);
+
+	void Clear();
+
+	~ShaderVariants();
+
+private:
+	std::string vertexLocation;
+	std::string fragmentLocation;
+	std::string computeLocation;
+	std::map<unsigned int, Shader*> variants;
+};
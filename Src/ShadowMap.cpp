@@ -1,5 +1,7 @@
 #include "ShadowMap.h"
 
+#include "DebugLayer.h"
+
 ShadowMap::ShadowMap()
 {
 	FBO = 0;
@@ -24,6 +26,8 @@ bool ShadowMap::Init(GLuint width, GLuint height)
 
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
 	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
+	DebugLayer::Label(GL_TEXTURE, shadowMap, "Directional shadow map");
+	DebugLayer::Label(GL_FRAMEBUFFER, FBO, "Directional shadow map");
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
 
@@ -1,10 +1,14 @@
 #include "Skybox.h"
 
+#include <memory>
+
+#include "DebugLayer.h"
+
 Skybox::Skybox()
 {
 }
 
-Skybox::Skybox(std::vector<std::string> faceLocations)
+Skybox::Skybox(std::vector<std::string> faceLocations, AssetLoader* loader)
 {
 	// Shader Setup
 	skyShader = new Shader();
@@ -17,18 +21,39 @@ Skybox::Skybox(std::vector<std::string> faceLocations)
 	glGenTextures(1, &textureId);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
 
-	int width, height, bitDepth;
-
-	for (size_t i = 0; i < 6; i++)
+	if (loader)
 	{
-		unsigned char* texData = stbi_load(faceLocations[i].c_str(), &width, &height, &bitDepth, 0);
-		if (!texData)
+		unsigned char grey[3] = { 128, 128, 128 };
+		for (size_t i = 0; i < 6; i++)
 		{
-			printf("Failed to find: %s. %s\n", faceLocations[i].c_str(), stbi_failure_reason());
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
 		}
 
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-		stbi_image_free(texData);
+		// Only the texture name goes in the lambdas, the skybox itself is copied around
+		GLuint cubeMap = textureId;
+		loader->LoadAsync([faceLocations, cubeMap, loader]()
+		{
+			// The six faces are decoded and encoded on the loader threads at the same time
+			std::shared_ptr<TextureFile::Image> faces = std::make_shared<TextureFile::Image>();
+			if (!DecodeFaces(faceLocations, loader->GetThreadPool(), faces.get()))
+			{
+				return;
+			}
+
+			loader->QueueUpload(TextureFile::GetSize(*faces), [faces, cubeMap]()
+			{
+				UploadFaces(cubeMap, *faces);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+			});
+		});
+	}
+	else
+	{
+		TextureFile::Image faces;
+		if (DecodeFaces(faceLocations, nullptr, &faces))
+		{
+			UploadFaces(textureId, faces);
+		}
 	}
 
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -75,6 +100,53 @@ Skybox::Skybox(std::vector<std::string> faceLocations)
 	skyMesh->CreateMesh(skyboxVertices, skyboxIndices, 64, 36);
 }
 
+std::string Skybox::GetCookedName(const std::vector<std::string>& faceLocations)
+{
+	return faceLocations[0] + ".cube.dds";
+}
+
+bool Skybox::CookFaces(const std::vector<std::string>& faceLocations, ThreadPool* threads)
+{
+	TextureFile::Image faces;
+	return DecodeFaces(faceLocations, threads, &faces);
+}
+
+bool Skybox::DecodeFaces(const std::vector<std::string>& faceLocations, ThreadPool* threads, TextureFile::Image* faces)
+{
+	// The sky has no alpha
+	TextureCompressor::Format format = TextureCompressor::ChooseFormat(false);
+	if (!TextureFile::Cook(faceLocations, GetCookedName(faceLocations), format, threads, faces))
+	{
+		return false;
+	}
+
+	if (faces->faceCount != 6 || !TextureCompressor::IsSupported(faces->format))
+	{
+		printf("Unsupported skybox format in: %s\n", GetCookedName(faceLocations).c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void Skybox::UploadFaces(GLuint textureId, const TextureFile::Image& faces)
+{
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+	TextureFile::Upload(faces);
+}
+
+bool Skybox::ReloadShader(const std::string& fileLocation)
+{
+	if (!skyShader->UsesFile(fileLocation) || !skyShader->Reload())
+	{
+		return false;
+	}
+
+	uniformProjection = skyShader->GetProjectionLocation();
+	uniformView = skyShader->GetViewLocation();
+	return true;
+}
+
 void Skybox::DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 {
 	// get rid of the translate info that it stored in the 4th column
@@ -85,6 +157,8 @@ void Skybox::DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 	// And all that behind won't appear
 	glDepthMask(GL_FALSE);
 
+	DebugLayer::PushGroup("Skybox");
+
 	skyShader->UseShader();
 	
 	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
@@ -101,4 +175,6 @@ void Skybox::DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 	skyMesh->RenderMesh();
 
 	glDepthMask(GL_TRUE);
+
+	DebugLayer::PopGroup();
 }
@@ -8,19 +8,34 @@
 #include <vector>
 #include <string>
 
+#include "AssetLoader.h"
 #include "CommonValues.h"
 #include "Mesh.h"
 #include "Shader.h"
+#include "TextureFile.h"
 
 class Skybox
 {
 public:
 	Skybox();
-	Skybox(std::vector<std::string> faceLocations);
+	// With a loader the faces are decoded in the background and a grey cube map is used until they are uploaded
+	Skybox(std::vector<std::string> faceLocations, AssetLoader* loader = nullptr);
 
 	void DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
 
+	// Hot reload of the skybox program if it's compiled from fileLocation
+	bool ReloadShader(const std::string& fileLocation);
+
+	// Encode the faces in a cube map DDS next to the first one, the skybox then loads it instead of the images
+	static bool CookFaces(const std::vector<std::string>& faceLocations, ThreadPool* threads = nullptr);
+
 private:
+	static std::string GetCookedName(const std::vector<std::string>& faceLocations);
+
+	// Cooked cube map, or the faces encoded if it's missing or out of date
+	static bool DecodeFaces(const std::vector<std::string>& faceLocations, ThreadPool* threads, TextureFile::Image* faces);
+	static void UploadFaces(GLuint textureId, const TextureFile::Image& faces);
+
 	Mesh* skyMesh;
 	Shader* skyShader;
 
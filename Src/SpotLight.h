@@ -22,6 +22,7 @@ public:
 	void SetFlash(glm::vec3 pos, glm::vec3 dir);
 
 	void Toggle() { isOn = !isOn; }
+	void SetOn(bool on) { isOn = on; }
 
 	~SpotLight();
 
@@ -1,5 +1,9 @@
 #include "Texture.h"
 #include "CommonValues.h"
+#include "DebugLayer.h"
+#include "ImageDecoder.h"
+
+#include <algorithm>
 
 Texture::Texture()
 {
@@ -8,7 +12,14 @@ Texture::Texture()
 	height = 0;
 	bitDepth = 0;
 	fileLocation = "";
-
+	pixels = nullptr;
+	alpha = false;
+	compression = TextureCompressor::FORMAT_NONE;
+	compressionThreads = nullptr;
+	memoryUsage = 0;
+	streamed = false;
+	levelCount = 0;
+	baseLevel = 0;
 }
 
 Texture::Texture(const char* fileLoc)
@@ -18,17 +29,115 @@ Texture::Texture(const char* fileLoc)
 	height = 0;
 	bitDepth = 0;
 	fileLocation = fileLoc;
+	pixels = nullptr;
+	alpha = false;
+	compression = TextureCompressor::FORMAT_NONE;
+	compressionThreads = nullptr;
+	memoryUsage = 0;
+	streamed = false;
+	levelCount = 0;
+	baseLevel = 0;
 }
 
+GLuint Texture::placeholderID = 0;
+
 bool Texture::LoadTexture()
 {
-	unsigned char* texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
-	if (!texData)
+	if (!DecodeTexture(false))
+	{
+		return false;
+	}
+
+	UploadTexture();
+	return true;
+}
+
+bool Texture::LoadTextureA()
+{
+	if (!DecodeTexture(true))
+	{
+		return false;
+	}
+
+	UploadTexture();
+	return true;
+}
+
+void Texture::SetCompression(TextureCompressor::Format format, ThreadPool* threads)
+{
+	compression = format;
+	compressionThreads = threads;
+}
+
+bool Texture::DecodeTexture(bool alpha)
+{
+	this->alpha = alpha;
+
+	bool dds = fileLocation.size() > 4 && fileLocation.compare(fileLocation.size() - 4, 4, ".dds") == 0;
+	if (dds || compression != TextureCompressor::FORMAT_NONE)
+	{
+		bool loaded = dds ? TextureFile::Load(fileLocation, &image)
+						: TextureFile::Cook(std::vector<std::string>(1, fileLocation), fileLocation + ".dds", compression, compressionThreads, &image);
+		if (loaded && (image.faceCount != 1 || !TextureCompressor::IsSupported(image.format)))
+		{
+			printf("Unsupported texture format in: %s\n", fileLocation.c_str());
+			loaded = false;
+		}
+		if (!loaded)
+		{
+			image.levels.clear();
+			return false;
+		}
+
+		compression = image.format;
+		width = image.width;
+		height = image.height;
+		cookedLocation = dds ? fileLocation : fileLocation + ".dds";
+		levelCount = image.levelCount;
+		baseLevel = 0;
+
+		if (streamed)
+		{
+			// Only the tail goes to the GPU, TextureStreamer reads the rest again when it's needed
+			baseLevel = GetTailLevel();
+			image.levels.erase(image.levels.begin(), image.levels.begin() + baseLevel);
+			image.levelCount = levelCount - baseLevel;
+		}
+		return true;
+	}
+
+	ImageDecoder::Image decoded;
+	if (!ImageDecoder::Decode(fileLocation, 0, &decoded))
 	{
-		printf("Failed to find: %s. %s\n", fileLocation, stbi_failure_reason());
 		return false;
 	}
 
+	width = decoded.width;
+	height = decoded.height;
+	bitDepth = decoded.channels;
+	pixels = decoded.pixels;
+	return true;
+}
+
+size_t Texture::GetDecodedSize()
+{
+	if (image.levels.empty())
+	{
+		return (size_t)width * height * (alpha ? 4 : 3);
+	}
+
+	return TextureFile::GetSize(image);
+}
+
+void Texture::UploadTexture()
+{
+	if (!pixels && image.levels.empty())
+	{
+		return;
+	}
+
+	GLenum format = alpha ? GL_RGBA : GL_RGB;
+
 	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
@@ -36,41 +145,133 @@ bool Texture::LoadTexture()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	DebugLayer::Label(GL_TEXTURE, textureID, fileLocation);
+
+	if (!image.levels.empty())
+	{
+		// The mip chain was built by the encoder or read from the file, nothing to generate
+		memoryUsage = TextureFile::Upload(image, baseLevel);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		image.levels.clear();
+		image.levels.shrink_to_fit();
+		return;
+	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
 	glGenerateMipmap(GL_TEXTURE_2D);
+	// Mipmaps add about a third of the base level
+	memoryUsage = (size_t)width * height * (alpha ? 4 : 3) * 4 / 3;
+	levelCount = 1;
+	while (std::max(width, height) >> levelCount)
+	{
+		levelCount++;
+	}
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-	stbi_image_free(texData);
+	stbi_image_free(pixels);
+	pixels = nullptr;
+}
 
-	return true;
+void Texture::SetStreamed(bool streamed)
+{
+	this->streamed = streamed;
 }
 
-bool Texture::LoadTextureA()
+int Texture::GetTailLevel()
 {
-	unsigned char* texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
-	if (!texData)
+	int level = 0;
+	while (level < levelCount - 1 && std::max(width >> level, height >> level) > STREAMING_TAIL_SIZE)
 	{
-		printf("Failed to find: %s\n", fileLocation);
-		return false;
+		level++;
+	}
+	return level;
+}
+
+GLenum Texture::GetInternalFormat()
+{
+	if (compression != TextureCompressor::FORMAT_NONE)
+	{
+		return TextureCompressor::GetInternalFormat(compression);
+	}
+	return alpha ? GL_RGBA8 : GL_RGB8;
+}
+
+size_t Texture::GetLevelMemory(int level)
+{
+	return TextureCompressor::GetLevelSize(compression, std::max(1, width >> level), std::max(1, height >> level));
+}
+
+void Texture::AddLevels(const std::vector<TextureCompressor::Level>& levels, int firstLevel)
+{
+	if (textureID == 0 || firstLevel + (int)levels.size() != baseLevel)
+	{
+		return;
 	}
 
-	glGenTextures(1, &textureID);
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	GLenum internalFormat = TextureCompressor::GetInternalFormat(compression);
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, firstLevel + (GLint)i, internalFormat, levels[i].width, levels[i].height, 0,
+							(GLsizei)levels[i].data.size(), levels[i].data.data());
+		memoryUsage += levels[i].data.size();
+	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texData);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	// Every level down to the tail is there so the texture stays complete
+	baseLevel = firstLevel;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, baseLevel);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-	stbi_image_free(texData);
-	return true;
+void Texture::DropLevels(int newBaseLevel)
+{
+	if (textureID == 0 || newBaseLevel <= baseLevel || newBaseLevel >= levelCount)
+	{
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, newBaseLevel);
+
+	// A level respecified with a size of 0 has no storage anymore, it's outside of [base, max] so it's never sampled
+	GLenum internalFormat = TextureCompressor::GetInternalFormat(compression);
+	for (int level = baseLevel; level < newBaseLevel; level++)
+	{
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, 0, 0, 0, 0, nullptr);
+		memoryUsage -= GetLevelMemory(level);
+	}
+	baseLevel = newBaseLevel;
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::Replace(Texture* other)
+{
+	if (!other->IsUploaded())
+	{
+		return;
+	}
+
+	glDeleteTextures(1, &textureID);
+
+	textureID = other->textureID;
+	width = other->width;
+	height = other->height;
+	bitDepth = other->bitDepth;
+	alpha = other->alpha;
+	compression = other->compression;
+	memoryUsage = other->memoryUsage;
+	cookedLocation = other->cookedLocation;
+	levelCount = other->levelCount;
+	baseLevel = other->baseLevel;
+
+	other->textureID = 0;
+	other->memoryUsage = 0;
 }
 
 void Texture::UseTexture()
@@ -82,13 +283,42 @@ void Texture::UseTexture()
 	// There are several way to deal with that problem but for an idiotic way we just shift everything by one
 	// So object texture 0->1
 	glActiveTexture(GL_TEXTURE1);
+
+	if (textureID == 0)
+	{
+		// Still loading, bind a 1x1 white texture so the object is lit with its material only
+		if (placeholderID == 0)
+		{
+			unsigned char white[4] = { 255, 255, 255, 255 };
+			glGenTextures(1, &placeholderID);
+			glBindTexture(GL_TEXTURE_2D, placeholderID);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+		glBindTexture(GL_TEXTURE_2D, placeholderID);
+		return;
+	}
+
 	glBindTexture(GL_TEXTURE_2D, textureID);
 }
 
 void Texture::ClearTexture()
 {
+	if (pixels)
+	{
+		stbi_image_free(pixels);
+		pixels = nullptr;
+	}
+
+	image.levels.clear();
+
 	glDeleteTextures(1, &textureID);
 	textureID = 0;
+	memoryUsage = 0;
+	cookedLocation = "";
+	levelCount = 0;
+	baseLevel = 0;
 	width = 0;
 	height = 0;
 	bitDepth = 0;
@@ -97,5 +327,10 @@ void Texture::ClearTexture()
 
 Texture::~Texture()
 {
+	// Decoded but never uploaded
+	if (pixels)
+	{
+		stbi_image_free(pixels);
+	}
 
 }
\ No newline at end of file
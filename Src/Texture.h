@@ -1,6 +1,11 @@
 #pragma once
+#include <string>
+#include <vector>
+
 #include <GL\glew.h>
 
+#include "TextureFile.h"
+
 class Texture
 {
 public:
@@ -10,6 +15,49 @@ public:
 	bool LoadTextureA();
 	bool LoadTexture();
 
+	// LoadTexture in two steps: DecodeTexture reads the file on any thread, UploadTexture must be on the GL thread.
+	// UseTexture binds a white placeholder until the upload is done
+	bool DecodeTexture(bool alpha);
+	// Must be set before DecodeTexture: the image is then encoded with its whole mip chain while decoding,
+	// on threads if given, and uploaded with glCompressedTexImage2D. FORMAT_NONE keeps the raw upload.
+	// The result is cooked next to the file (fileLocation + ".dds") so the next runs only read it.
+	// A ".dds" fileLocation is always loaded as it is
+	void SetCompression(TextureCompressor::Format format, ThreadPool* threads = nullptr);
+	void UploadTexture();
+	bool IsDecoded() { return pixels != nullptr || !image.levels.empty(); }
+	bool IsUploaded() { return textureID != 0; }
+	int GetWidth() { return width; }
+	int GetHeight() { return height; }
+	TextureCompressor::Format GetCompression() { return compression; }
+	// For the copies and handles of TextureArray, 0 until uploaded
+	GLuint GetTextureID() { return textureID; }
+	// Sized format of the levels on the GPU
+	GLenum GetInternalFormat();
+	// Bytes the upload will send to the GPU
+	size_t GetDecodedSize();
+	// Bytes on the GPU once uploaded, mipmaps included
+	size_t GetMemoryUsage() { return memoryUsage; }
+
+	// Streaming (see TextureStreamer), only for compressed textures: UploadTexture keeps the levels of
+	// STREAMING_TAIL_SIZE texels and less, the bigger ones are read from the cooked file when needed.
+	// Levels [baseLevel, levelCount) are on the GPU and baseLevel is what gets sampled
+	void SetStreamed(bool streamed);
+	bool IsStreamed() { return streamed && !cookedLocation.empty() && textureID != 0; }
+	const std::string& GetCookedLocation() { return cookedLocation; }
+	int GetLevelCount() { return levelCount; }
+	int GetBaseLevel() { return baseLevel; }
+	// First level small enough to always stay resident
+	int GetTailLevel();
+	size_t GetLevelMemory(int level);
+	// levels are [firstLevel, baseLevel), uploaded in place and sampled right away
+	void AddLevels(const std::vector<TextureCompressor::Level>& levels, int firstLevel);
+	// Give back the memory of the levels before newBaseLevel
+	void DropLevels(int newBaseLevel);
+
+	// Hot reload: take the GL texture of other, uploaded from the same file, so whoever holds this Texture samples
+	// the new image. The previous one is deleted and other is left empty. On the GL thread
+	void Replace(Texture* other);
+
 	void UseTexture();
 	void ClearTexture();
 
@@ -19,6 +67,25 @@ private:
 	GLuint textureID;
 	int width, height, bitDepth;
 
-	const char* fileLocation;
+	std::string fileLocation;
+
+	// Result of DecodeTexture waiting for UploadTexture
+	unsigned char* pixels;
+	bool alpha;
+
+	TextureCompressor::Format compression;
+	ThreadPool* compressionThreads;
+	// Encoded mip chain waiting for UploadTexture when compressed or loaded from a DDS file
+	TextureFile::Image image;
+	size_t memoryUsage;
+
+	static const int STREAMING_TAIL_SIZE = 64;
+	bool streamed;
+	// Where the levels come from, empty if the texture isn't compressed
+	std::string cookedLocation;
+	int levelCount;
+	int baseLevel;
+
+	static GLuint placeholderID;
 };
 
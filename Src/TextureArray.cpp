@@ -0,0 +1,289 @@
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <stdio.h>
+
+#include "DebugLayer.h"
+
+TextureArray::TextureArray()
+{
+	textureCache = nullptr;
+	useBindless = false;
+	memoryUsage = 0;
+}
+
+bool TextureArray::IsSupported()
+{
+	return GLEW_VERSION_4_3 || GLEW_ARB_copy_image;
+}
+
+bool TextureArray::IsBindlessSupported()
+{
+	return GLEW_ARB_bindless_texture;
+}
+
+void TextureArray::Init(TextureCache* cache, bool allowBindless)
+{
+	textureCache = cache;
+	useBindless = allowBindless && IsBindlessSupported();
+
+	// Sampled by the draws whose texture isn't placed yet
+	Array placeholder;
+	placeholder.internalFormat = GL_RGBA8;
+	placeholder.width = 1;
+	placeholder.height = 1;
+	placeholder.levelCount = 1;
+	placeholder.layers.push_back(nullptr);
+
+	unsigned char white[] = { 255, 255, 255, 255 };
+	glGenTextures(1, &placeholder.textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, placeholder.textureID);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, 1, 1, 1);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	arrays.push_back(placeholder);
+	memoryUsage += 4;
+
+	printf("Texture arrays: %d arrays of %d layers, bindless textures %s\n", MAX_TEXTURE_ARRAYS, LAYERS_PER_ARRAY, useBindless ? "on" : "off");
+}
+
+void TextureArray::Update()
+{
+	if (arrays.empty())
+	{
+		return;
+	}
+
+	std::vector<std::shared_ptr<Texture>> textures;
+	textureCache->GetTextures(&textures);
+
+	// Give back the layers of the textures the cache released, their handles went away with them
+	std::set<Texture*> alive;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		alive.insert(textures[i].get());
+	}
+	for (std::map<Texture*, Placement>::iterator it = placements.begin(); it != placements.end();)
+	{
+		if (alive.count(it->first) && it->first->GetTextureID() == it->second.textureID)
+		{
+			++it;
+			continue;
+		}
+
+		if (it->second.array >= 0)
+		{
+			arrays[it->second.array].layers[it->second.layer] = nullptr;
+		}
+		it = placements.erase(it);
+	}
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		Texture* texture = textures[i].get();
+		if (!texture->IsUploaded())
+		{
+			continue;
+		}
+
+		std::map<Texture*, Placement>::iterator found = placements.find(texture);
+		if (found == placements.end())
+		{
+			Place(texture);
+			continue;
+		}
+
+		// The layer keeps the levels the streamer dropped since the array storage is immutable,
+		// only the ones it added are copied
+		Placement& placement = found->second;
+		if (placement.array >= 0 && texture->GetBaseLevel() < placement.copiedLevel)
+		{
+			CopyLevels(texture, placement, texture->GetBaseLevel(), placement.copiedLevel);
+			placement.copiedLevel = texture->GetBaseLevel();
+		}
+	}
+}
+
+void TextureArray::Place(Texture* texture)
+{
+	Placement placement;
+	placement.array = -1;
+	placement.layer = 0;
+	placement.copiedLevel = texture->GetLevelCount();
+	placement.handle = 0;
+	placement.textureID = texture->GetTextureID();
+
+	if (useBindless && !texture->IsStreamed())
+	{
+		placement.handle = glGetTextureHandleARB(texture->GetTextureID());
+		glMakeTextureHandleResidentARB(placement.handle);
+		placements[texture] = placement;
+		return;
+	}
+
+	placement.array = FindArray(texture);
+	if (placement.array < 0)
+	{
+		printf("No texture array left for %s, drawn with the placeholder\n", texture->GetCookedLocation().c_str());
+		placements[texture] = placement;
+		return;
+	}
+
+	Array& array = arrays[placement.array];
+	placement.layer = (int)(std::find(array.layers.begin(), array.layers.end(), (Texture*)nullptr) - array.layers.begin());
+	array.layers[placement.layer] = texture;
+
+	CopyLevels(texture, placement, texture->GetBaseLevel(), texture->GetLevelCount());
+	placement.copiedLevel = texture->GetBaseLevel();
+	placements[texture] = placement;
+}
+
+int TextureArray::FindArray(Texture* texture)
+{
+	for (size_t i = 1; i < arrays.size(); i++)
+	{
+		Array& array = arrays[i];
+		if (array.internalFormat == texture->GetInternalFormat() && array.width == texture->GetWidth()
+			&& array.height == texture->GetHeight() && array.levelCount == texture->GetLevelCount()
+			&& std::find(array.layers.begin(), array.layers.end(), (Texture*)nullptr) != array.layers.end())
+		{
+			return (int)i;
+		}
+	}
+
+	if (arrays.size() >= MAX_TEXTURE_ARRAYS)
+	{
+		return -1;
+	}
+
+	Array array;
+	array.internalFormat = texture->GetInternalFormat();
+	array.width = texture->GetWidth();
+	array.height = texture->GetHeight();
+	array.levelCount = texture->GetLevelCount();
+	array.layers.resize(LAYERS_PER_ARRAY, nullptr);
+
+	glGenTextures(1, &array.textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array.textureID);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levelCount, array.internalFormat, array.width, array.height, LAYERS_PER_ARRAY);
+
+	char label[64] = { '\0' };
+	snprintf(label, sizeof(label), "Texture array %dx%d 0x%04x", array.width, array.height, array.internalFormat);
+	DebugLayer::Label(GL_TEXTURE, array.textureID, label);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// The shader picks the level of the draw with textureLod, like the base level of the 2D texture is sampled
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	for (int level = 0; level < array.levelCount; level++)
+	{
+		memoryUsage += texture->GetLevelMemory(level) * LAYERS_PER_ARRAY;
+	}
+
+	arrays.push_back(array);
+	return (int)arrays.size() - 1;
+}
+
+void TextureArray::CopyLevels(Texture* texture, const Placement& placement, int firstLevel, int lastLevel)
+{
+	const Array& array = arrays[placement.array];
+	for (int level = firstLevel; level < lastLevel; level++)
+	{
+		// Whole levels, the small ones of the compressed formats aren't a multiple of the block size
+		GLsizei width = std::max(1, array.width >> level);
+		GLsizei height = std::max(1, array.height >> level);
+		glCopyImageSubData(texture->GetTextureID(), GL_TEXTURE_2D, level, 0, 0, 0,
+			array.textureID, GL_TEXTURE_2D_ARRAY, level, 0, 0, placement.layer, width, height, 1);
+	}
+}
+
+glm::uvec4 TextureArray::GetDrawTexture(Texture* texture)
+{
+	std::map<Texture*, Placement>::iterator found = placements.find(texture);
+	if (found == placements.end())
+	{
+		return glm::uvec4(0, 0, 0, DRAW_TEXTURE_ARRAY);
+	}
+
+	const Placement& placement = found->second;
+	if (placement.handle != 0)
+	{
+		return glm::uvec4((GLuint)(placement.handle & 0xffffffff), (GLuint)(placement.handle >> 32), 0, DRAW_TEXTURE_BINDLESS);
+	}
+	if (placement.array < 0)
+	{
+		return glm::uvec4(0, 0, 0, DRAW_TEXTURE_ARRAY);
+	}
+
+	int level = std::max(texture->GetBaseLevel(), placement.copiedLevel);
+	return glm::uvec4(placement.array, placement.layer, level, DRAW_TEXTURE_ARRAY);
+}
+
+void TextureArray::Bind()
+{
+	if (arrays.empty())
+	{
+		return;
+	}
+
+	for (int i = 0; i < MAX_TEXTURE_ARRAYS; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_UNIT + i);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, i < (int)arrays.size() ? arrays[i].textureID : arrays[0].textureID);
+	}
+}
+
+void TextureArray::PrintStats()
+{
+	unsigned int layers = 0;
+	unsigned int bindless = 0;
+	for (std::map<Texture*, Placement>::iterator it = placements.begin(); it != placements.end(); ++it)
+	{
+		if (it->second.handle != 0)
+		{
+			bindless++;
+		}
+		else if (it->second.array >= 0)
+		{
+			layers++;
+		}
+	}
+
+	printf("Texture arrays: %u arrays, %u layers used, %.2f MB, %u bindless textures\n",
+		(unsigned int)arrays.size() - (arrays.empty() ? 0 : 1), layers, memoryUsage / (1024.0f * 1024.0f), bindless);
+	for (size_t i = 1; i < arrays.size(); i++)
+	{
+		unsigned int used = (unsigned int)(arrays[i].layers.size() - std::count(arrays[i].layers.begin(), arrays[i].layers.end(), (Texture*)nullptr));
+		printf("  %dx%d, %d levels, format 0x%x: %u / %d layers\n", arrays[i].width, arrays[i].height, arrays[i].levelCount,
+			arrays[i].internalFormat, used, LAYERS_PER_ARRAY);
+	}
+}
+
+void TextureArray::Clear()
+{
+	for (std::map<Texture*, Placement>::iterator it = placements.begin(); it != placements.end(); ++it)
+	{
+		if (it->second.handle != 0 && it->first->GetTextureID() == it->second.textureID)
+		{
+			glMakeTextureHandleNonResidentARB(it->second.handle);
+		}
+	}
+	placements.clear();
+
+	for (size_t i = 0; i < arrays.size(); i++)
+	{
+		glDeleteTextures(1, &arrays[i].textureID);
+	}
+	arrays.clear();
+	memoryUsage = 0;
+}
+
+TextureArray::~TextureArray()
+{
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "CommonValues.h"
+#include "Texture.h"
+#include "TextureCache.h"
+
+// The textures of a cache packed by size and format in the layers of GL_TEXTURE_2D_ARRAY, so draws with
+// different textures don't need a rebind and the whole main pass goes in one glMultiDrawElementsIndirect.
+// The per draw data tells the shader where its texture is (GetDrawTexture).
+// With ARB_bindless_texture the textures that aren't streamed are sampled through their handle instead:
+// a handle makes the state of its texture immutable, so the streamed ones always go in the arrays
+class TextureArray
+{
+public:
+	// w of GetDrawTexture, must match shader_indirect.frag
+	enum DrawTextureType
+	{
+		DRAW_TEXTURE_ARRAY = 0,
+		DRAW_TEXTURE_BINDLESS = 1
+	};
+
+	TextureArray();
+
+	// glCopyImageSubData is GL 4.3, like the geometry pool
+	static bool IsSupported();
+	static bool IsBindlessSupported();
+
+	// Must be called on the GL thread
+	void Init(TextureCache* cache, bool allowBindless);
+
+	// Once per frame on the GL thread after the streamer Update: place the textures uploaded since the last call,
+	// copy the levels the streamer added and forget the textures the cache released
+	void Update();
+
+	// PerDrawData::texture of a draw sampling texture: array, layer and level to sample or the bindless handle.
+	// The white placeholder until the texture is placed
+	glm::uvec4 GetDrawTexture(Texture* texture);
+
+	// Bind the arrays from TEXTURE_ARRAY_UNIT, the unused units get the placeholder
+	void Bind();
+
+	void PrintStats();
+
+	void Clear();
+
+	~TextureArray();
+
+private:
+	struct Array
+	{
+		GLuint textureID;
+		GLenum internalFormat;
+		int width, height, levelCount;
+		// nullptr for the free layers
+		std::vector<Texture*> layers;
+	};
+
+	struct Placement
+	{
+		// -1 when bindless or when every array is full
+		int array;
+		int layer;
+		// Levels [copiedLevel, levelCount) of the texture are in the layer
+		int copiedLevel;
+		GLuint64 handle;
+		// A texture created where a released one was isn't mistaken for it
+		GLuint textureID;
+	};
+
+	static const int LAYERS_PER_ARRAY = 16;
+
+	void Place(Texture* texture);
+	int FindArray(Texture* texture);
+	void CopyLevels(Texture* texture, const Placement& placement, int firstLevel, int lastLevel);
+
+	TextureCache* textureCache;
+	bool useBindless;
+
+	// The first one is the 1x1 white placeholder
+	std::vector<Array> arrays;
+	std::map<Texture*, Placement> placements;
+	size_t memoryUsage;
+};
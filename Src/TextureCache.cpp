@@ -0,0 +1,277 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <vector>
+
+TextureCache::TextureCache()
+{
+	compress = false;
+	stream = false;
+	compressionThreads = nullptr;
+}
+
+std::string TextureCache::CanonicalPath(const std::string& fileLocation)
+{
+	// Same separators, no "." and resolved ".." so "Textures\\a.png" and "./Textures/a.png" are the same entry
+	std::vector<std::string> parts;
+	std::string part;
+	for (size_t i = 0; i <= fileLocation.size(); i++)
+	{
+		char c = i < fileLocation.size() ? fileLocation[i] : '/';
+		if (c != '/' && c != '\\')
+		{
+#ifdef _WIN32
+			c = (char)tolower((unsigned char)c);
+#endif
+			part += c;
+			continue;
+		}
+
+		if (part == "..")
+		{
+			if (!parts.empty() && parts.back() != "..")
+			{
+				parts.pop_back();
+			}
+			else
+			{
+				parts.push_back(part);
+			}
+		}
+		else if (!part.empty() && part != ".")
+		{
+			parts.push_back(part);
+		}
+		part.clear();
+	}
+
+	std::string path = !fileLocation.empty() && (fileLocation[0] == '/' || fileLocation[0] == '\\') ? "/" : "";
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		path += i > 0 ? "/" + parts[i] : parts[i];
+	}
+	return path;
+}
+
+Texture* TextureCache::Acquire(const std::string& fileLocation, bool alpha, AssetLoader* loader)
+{
+	std::string path = CanonicalPath(fileLocation);
+	std::string key = path + (alpha ? "|rgba" : "|rgb");
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::map<std::string, Entry>::iterator it = entries.find(key);
+	if (it != entries.end())
+	{
+		it->second.references++;
+		return it->second.texture.get();
+	}
+
+	std::shared_ptr<Texture> texture = CreateTexture(path, alpha);
+
+	if (loader)
+	{
+		// The entry can be released before the upload, the upload then has nothing to do
+		std::weak_ptr<Texture> weakTexture = texture;
+		loader->LoadAsync([texture, weakTexture, loader, alpha]()
+		{
+			if (texture->DecodeTexture(alpha))
+			{
+				loader->QueueUpload(texture->GetDecodedSize(), [weakTexture]()
+				{
+					std::shared_ptr<Texture> uploaded = weakTexture.lock();
+					if (uploaded)
+					{
+						uploaded->UploadTexture();
+					}
+				});
+			}
+		});
+	}
+	else
+	{
+		if (!texture->DecodeTexture(alpha))
+		{
+			return nullptr;
+		}
+		texture->UploadTexture();
+	}
+
+	Entry entry;
+	entry.fileLocation = path;
+	entry.alpha = alpha;
+	entry.references = 1;
+	entry.texture = texture;
+	entries[key] = entry;
+
+	return texture.get();
+}
+
+std::shared_ptr<Texture> TextureCache::CreateTexture(const std::string& path, bool alpha)
+{
+	std::shared_ptr<Texture> texture = std::make_shared<Texture>(path.c_str());
+	if (compress)
+	{
+		texture->SetCompression(TextureCompressor::ChooseFormat(alpha), compressionThreads);
+		texture->SetStreamed(stream);
+	}
+	return texture;
+}
+
+int TextureCache::Reload(const std::string& fileLocation, AssetLoader* loader)
+{
+	std::string path = CanonicalPath(fileLocation);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	int reloaded = 0;
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (it->second.fileLocation != path)
+		{
+			continue;
+		}
+		reloaded++;
+
+		bool alpha = it->second.alpha;
+		std::shared_ptr<Texture> replacement = CreateTexture(path, alpha);
+		std::weak_ptr<Texture> weakTexture = it->second.texture;
+
+		if (loader)
+		{
+			loader->LoadAsync([replacement, weakTexture, loader, alpha]()
+			{
+				if (replacement->DecodeTexture(alpha))
+				{
+					loader->QueueUpload(replacement->GetDecodedSize(), [replacement, weakTexture]()
+					{
+						// Released meanwhile or not uploaded yet
+						std::shared_ptr<Texture> texture = weakTexture.lock();
+						if (texture && texture->IsUploaded())
+						{
+							replacement->UploadTexture();
+							texture->Replace(replacement.get());
+						}
+					});
+				}
+			});
+		}
+		else if (replacement->DecodeTexture(alpha) && it->second.texture->IsUploaded())
+		{
+			replacement->UploadTexture();
+			it->second.texture->Replace(replacement.get());
+		}
+	}
+	return reloaded;
+}
+
+void TextureCache::Release(Texture* texture)
+{
+	if (!texture)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (it->second.texture.get() != texture)
+		{
+			continue;
+		}
+
+		if (--it->second.references == 0)
+		{
+			// A texture still decoding is freed by the loader once it's done with it
+			if (it->second.texture->IsUploaded())
+			{
+				it->second.texture->ClearTexture();
+			}
+			entries.erase(it);
+		}
+		return;
+	}
+}
+
+void TextureCache::SetCompression(bool enabled, ThreadPool* threads)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	compress = enabled;
+	compressionThreads = threads;
+}
+
+void TextureCache::SetStreaming(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stream = enabled;
+}
+
+void TextureCache::GetTextures(std::vector<std::shared_ptr<Texture>>* textures)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	textures->clear();
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		textures->push_back(it->second.texture);
+	}
+}
+
+void TextureCache::PrintStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t total = 0;
+	printf("Texture cache: %zu textures\n", entries.size());
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		const Entry& entry = it->second;
+		size_t memory = entry.texture->GetMemoryUsage();
+		total += memory;
+
+		if (entry.texture->IsUploaded())
+		{
+			printf("  %s (%s, %s): %u users, %dx%d, %.2f MB\n", entry.fileLocation.c_str(), entry.alpha ? "RGBA" : "RGB",
+				TextureCompressor::GetFormatName(entry.texture->GetCompression()), entry.references,
+				entry.texture->GetWidth(), entry.texture->GetHeight(), memory / (1024.0f * 1024.0f));
+		}
+		else
+		{
+			printf("  %s (%s): %u users, loading\n", entry.fileLocation.c_str(), entry.alpha ? "RGBA" : "RGB", entry.references);
+		}
+	}
+	printf("  total %.2f MB\n", total / (1024.0f * 1024.0f));
+}
+
+size_t TextureCache::GetMemoryUsage()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t total = 0;
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		total += it->second.texture->GetMemoryUsage();
+	}
+	return total;
+}
+
+void TextureCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (it->second.texture->IsUploaded())
+		{
+			it->second.texture->ClearTexture();
+		}
+	}
+	entries.clear();
+}
+
+TextureCache::~TextureCache()
+{
+}
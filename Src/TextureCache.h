@@ -0,0 +1,65 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AssetLoader.h"
+#include "Texture.h"
+
+// Every image is decoded and uploaded once, whoever asks for it again gets the same Texture.
+// Entries are keyed by canonical path and format and freed when their last user releases them.
+class TextureCache
+{
+public:
+	TextureCache();
+
+	// Can be called from any thread when a loader is given: the texture is then decoded on the loader threads
+	// and binds a placeholder until it's uploaded. Without a loader it must be called on the GL thread and
+	// return nullptr if the file can't be decoded
+	Texture* Acquire(const std::string& fileLocation, bool alpha, AssetLoader* loader = nullptr);
+	void Release(Texture* texture);
+
+	// Hot reload: decode fileLocation again for the entries using it and swap the new image in the same Texture
+	// once uploaded (see Acquire for loader). The compressed ones are cooked again. Return how many entries use it
+	int Reload(const std::string& fileLocation, AssetLoader* loader = nullptr);
+
+	// Textures acquired from now on are block compressed in the best format the driver supports,
+	// TextureCompressor::Init must have been called
+	void SetCompression(bool enabled, ThreadPool* threads = nullptr);
+	// Compressed textures acquired from now on only upload their mip tail, a TextureStreamer loads the rest
+	void SetStreaming(bool enabled);
+
+	// Every texture of the cache, for TextureStreamer and TextureArray
+	void GetTextures(std::vector<std::shared_ptr<Texture>>* textures);
+
+	// Path, users, size and GPU memory of every entry
+	void PrintStats();
+	size_t GetMemoryUsage();
+
+	// Delete everything, even the textures still in use
+	void Clear();
+
+	~TextureCache();
+
+private:
+	struct Entry
+	{
+		std::string fileLocation;
+		bool alpha;
+		unsigned int references;
+		std::shared_ptr<Texture> texture;
+	};
+
+	static std::string CanonicalPath(const std::string& fileLocation);
+	// With the compression and streaming settings of the cache, must be called with the mutex locked
+	std::shared_ptr<Texture> CreateTexture(const std::string& path, bool alpha);
+
+	std::mutex mutex;
+	bool compress;
+	bool stream;
+	ThreadPool* compressionThreads;
+	std::map<std::string, Entry> entries;
+};
@@ -0,0 +1,569 @@
+#include "TextureCompressor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef TEXTURE_COMPRESSION_SSE
+#include <xmmintrin.h>
+#endif
+
+bool TextureCompressor::supported[FORMAT_COUNT] = {};
+
+void TextureCompressor::Init()
+{
+	supported[FORMAT_NONE] = true;
+	supported[FORMAT_BC1] = GLEW_EXT_texture_compression_s3tc != 0;
+	supported[FORMAT_BC3] = GLEW_EXT_texture_compression_s3tc != 0;
+	// RGTC is core since 3.0 and BPTC since 4.2
+	supported[FORMAT_BC5] = true;
+	supported[FORMAT_BC7] = GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+}
+
+void TextureCompressor::InitOffline()
+{
+	for (int i = 0; i < FORMAT_COUNT; i++)
+	{
+		supported[i] = true;
+	}
+}
+
+bool TextureCompressor::IsSupported(Format format)
+{
+	return supported[format];
+}
+
+TextureCompressor::Format TextureCompressor::ChooseFormat(bool alpha)
+{
+	if (!alpha)
+	{
+		return supported[FORMAT_BC1] ? FORMAT_BC1 : FORMAT_NONE;
+	}
+
+	// BC7 has better colours than BC3 for the same size
+	if (supported[FORMAT_BC7])
+	{
+		return FORMAT_BC7;
+	}
+	return supported[FORMAT_BC3] ? FORMAT_BC3 : FORMAT_NONE;
+}
+
+GLenum TextureCompressor::GetInternalFormat(Format format)
+{
+	switch (format)
+	{
+	case FORMAT_BC1:
+		return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case FORMAT_BC3:
+		return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case FORMAT_BC5:
+		return GL_COMPRESSED_RG_RGTC2;
+	case FORMAT_BC7:
+		return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	default:
+		return GL_RGBA;
+	}
+}
+
+const char* TextureCompressor::GetFormatName(Format format)
+{
+	switch (format)
+	{
+	case FORMAT_BC1:
+		return "BC1";
+	case FORMAT_BC3:
+		return "BC3";
+	case FORMAT_BC5:
+		return "BC5";
+	case FORMAT_BC7:
+		return "BC7";
+	default:
+		return "uncompressed";
+	}
+}
+
+size_t TextureCompressor::GetLevelSize(Format format, int width, int height)
+{
+	size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	switch (format)
+	{
+	case FORMAT_BC1:
+		return blocks * 8;
+	case FORMAT_BC3:
+	case FORMAT_BC5:
+	case FORMAT_BC7:
+		return blocks * 16;
+	default:
+		return (size_t)width * height * 4;
+	}
+}
+
+void TextureCompressor::Compress(const unsigned char* rgba, int width, int height, Format format, ThreadPool* threads, std::vector<Level>* levels)
+{
+	levels->clear();
+
+	const unsigned char* source = rgba;
+	std::vector<unsigned char> current, next;
+
+	while (true)
+	{
+		levels->push_back(Level());
+		Level& level = levels->back();
+		level.width = width;
+		level.height = height;
+		level.data.resize(GetLevelSize(format, width, height));
+		EncodeLevel(source, width, height, format, threads, level.data.data());
+
+		if (width == 1 && height == 1)
+		{
+			break;
+		}
+
+		// Every level is filtered from the one above, not from the full image
+		Downsample(source, width, height, &next);
+		current.swap(next);
+		source = current.data();
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+}
+
+void TextureCompressor::EncodeLevel(const unsigned char* rgba, int width, int height, Format format, ThreadPool* threads, unsigned char* out)
+{
+	int blocksX = (width + 3) / 4;
+	int blocksY = (height + 3) / 4;
+	size_t blockSize = format == FORMAT_BC1 ? 8 : 16;
+
+	std::function<void(size_t)> encodeRow = [&](size_t y)
+	{
+		Block block;
+		for (int x = 0; x < blocksX; x++)
+		{
+			ExtractBlock(rgba, width, height, x, (int)y, &block);
+			unsigned char* blockOut = out + (y * blocksX + x) * blockSize;
+
+			switch (format)
+			{
+			case FORMAT_BC1:
+				EncodeBC1(block, blockOut);
+				break;
+			case FORMAT_BC3:
+				EncodeBC4(block, 3, blockOut);
+				EncodeBC1(block, blockOut + 8);
+				break;
+			case FORMAT_BC5:
+				EncodeBC4(block, 0, blockOut);
+				EncodeBC4(block, 1, blockOut + 8);
+				break;
+			case FORMAT_BC7:
+				EncodeBC7(block, blockOut);
+				break;
+			default:
+				break;
+			}
+		}
+	};
+
+	if (format == FORMAT_NONE)
+	{
+		std::copy(rgba, rgba + (size_t)width * height * 4, out);
+		return;
+	}
+
+	if (threads)
+	{
+		threads->ParallelFor(blocksY, encodeRow);
+	}
+	else
+	{
+		for (int y = 0; y < blocksY; y++)
+		{
+			encodeRow(y);
+		}
+	}
+}
+
+void TextureCompressor::Downsample(const unsigned char* rgba, int width, int height, std::vector<unsigned char>* result)
+{
+	int halfWidth = std::max(1, width / 2);
+	int halfHeight = std::max(1, height / 2);
+	result->resize((size_t)halfWidth * halfHeight * 4);
+
+	for (int y = 0; y < halfHeight; y++)
+	{
+		int y0 = std::min(y * 2, height - 1);
+		int y1 = std::min(y * 2 + 1, height - 1);
+		for (int x = 0; x < halfWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1);
+			int x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < 4; c++)
+			{
+				unsigned int sum = rgba[((size_t)y0 * width + x0) * 4 + c] + rgba[((size_t)y0 * width + x1) * 4 + c]
+								+ rgba[((size_t)y1 * width + x0) * 4 + c] + rgba[((size_t)y1 * width + x1) * 4 + c];
+				(*result)[((size_t)y * halfWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void TextureCompressor::ExtractBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, Block* block)
+{
+	for (int y = 0; y < 4; y++)
+	{
+		int row = std::min(blockY * 4 + y, height - 1);
+		for (int x = 0; x < 4; x++)
+		{
+			int column = std::min(blockX * 4 + x, width - 1);
+			const unsigned char* texel = rgba + ((size_t)row * width + column) * 4;
+			for (int c = 0; c < 4; c++)
+			{
+				block->channels[c][y * 4 + x] = texel[c];
+			}
+		}
+	}
+}
+
+void TextureCompressor::ComputeEndpoints(const Block& block, int firstChannel, int channelCount, float* endpoint0, float* endpoint1)
+{
+	const float* channels[4];
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float minimum[4], maximum[4];
+	for (int c = 0; c < channelCount; c++)
+	{
+		channels[c] = block.channels[firstChannel + c];
+		minimum[c] = 255.0f;
+		maximum[c] = 0.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			mean[c] += channels[c][i];
+			minimum[c] = std::min(minimum[c], channels[c][i]);
+			maximum[c] = std::max(maximum[c], channels[c][i]);
+		}
+		mean[c] /= 16.0f;
+	}
+
+	// Covariance of the texels
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++)
+	{
+		for (int a = 0; a < channelCount; a++)
+		{
+			for (int b = a; b < channelCount; b++)
+			{
+				covariance[a][b] += (channels[a][i] - mean[a]) * (channels[b][i] - mean[b]);
+			}
+		}
+	}
+	for (int a = 0; a < channelCount; a++)
+	{
+		for (int b = 0; b < a; b++)
+		{
+			covariance[a][b] = covariance[b][a];
+		}
+	}
+
+	// Principal axis by power iteration, starting from the diagonal of the bounding box
+	float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int c = 0; c < channelCount; c++)
+	{
+		axis[c] = maximum[c] - minimum[c];
+	}
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float largest = 0.0f;
+		for (int a = 0; a < channelCount; a++)
+		{
+			for (int b = 0; b < channelCount; b++)
+			{
+				next[a] += covariance[a][b] * axis[b];
+			}
+			largest = std::max(largest, fabsf(next[a]));
+		}
+		if (largest == 0.0f)
+		{
+			break;
+		}
+		for (int c = 0; c < channelCount; c++)
+		{
+			axis[c] = next[c] / largest;
+		}
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < channelCount; c++)
+	{
+		length += axis[c] * axis[c];
+	}
+	if (length == 0.0f)
+	{
+		// Every texel is the same
+		for (int c = 0; c < channelCount; c++)
+		{
+			endpoint0[c] = mean[c];
+			endpoint1[c] = mean[c];
+		}
+		return;
+	}
+	length = sqrtf(length);
+	for (int c = 0; c < channelCount; c++)
+	{
+		axis[c] /= length;
+	}
+
+	float tMin = 1e30f, tMax = -1e30f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < channelCount; c++)
+		{
+			t += (channels[c][i] - mean[c]) * axis[c];
+		}
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+
+	for (int c = 0; c < channelCount; c++)
+	{
+		endpoint0[c] = std::min(std::max(mean[c] + axis[c] * tMin, 0.0f), 255.0f);
+		endpoint1[c] = std::min(std::max(mean[c] + axis[c] * tMax, 0.0f), 255.0f);
+	}
+}
+
+void TextureCompressor::ProjectTexels(const Block& block, int firstChannel, int channelCount, const float* endpoint0, const float* endpoint1, int levelCount, unsigned char* steps)
+{
+	float direction[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float lengthSquared = 0.0f;
+	for (int c = 0; c < channelCount; c++)
+	{
+		direction[c] = endpoint1[c] - endpoint0[c];
+		lengthSquared += direction[c] * direction[c];
+	}
+	float scale = lengthSquared > 0.0f ? (levelCount - 1) / lengthSquared : 0.0f;
+	float lastLevel = (float)(levelCount - 1);
+
+#ifdef TEXTURE_COMPRESSION_SSE
+	__m128 zero = _mm_setzero_ps();
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 last = _mm_set1_ps(lastLevel);
+	__m128 scale4 = _mm_set1_ps(scale);
+
+	for (int i = 0; i < 16; i += 4)
+	{
+		__m128 dot = _mm_setzero_ps();
+		for (int c = 0; c < channelCount; c++)
+		{
+			__m128 offset = _mm_sub_ps(_mm_loadu_ps(&block.channels[firstChannel + c][i]), _mm_set1_ps(endpoint0[c]));
+			dot = _mm_add_ps(dot, _mm_mul_ps(offset, _mm_set1_ps(direction[c])));
+		}
+
+		__m128 step = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dot, scale4), zero), last);
+		step = _mm_add_ps(step, half);
+
+		// Truncating the positive values rounds them since we added a half
+		float rounded[4];
+		_mm_storeu_ps(rounded, step);
+		for (int k = 0; k < 4; k++)
+		{
+			steps[i + k] = (unsigned char)rounded[k];
+		}
+	}
+#else
+	for (int i = 0; i < 16; i++)
+	{
+		float dot = 0.0f;
+		for (int c = 0; c < channelCount; c++)
+		{
+			dot += (block.channels[firstChannel + c][i] - endpoint0[c]) * direction[c];
+		}
+		float step = std::min(std::max(dot * scale, 0.0f), lastLevel);
+		steps[i] = (unsigned char)(step + 0.5f);
+	}
+#endif
+}
+
+unsigned short TextureCompressor::PackRGB565(const float* color)
+{
+	unsigned int r = (unsigned int)(color[0] * 31.0f / 255.0f + 0.5f);
+	unsigned int g = (unsigned int)(color[1] * 63.0f / 255.0f + 0.5f);
+	unsigned int b = (unsigned int)(color[2] * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+void TextureCompressor::UnpackRGB565(unsigned short packed, float* color)
+{
+	unsigned int r = (packed >> 11) & 31;
+	unsigned int g = (packed >> 5) & 63;
+	unsigned int b = packed & 31;
+	color[0] = (float)((r << 3) | (r >> 2));
+	color[1] = (float)((g << 2) | (g >> 4));
+	color[2] = (float)((b << 3) | (b >> 2));
+}
+
+void TextureCompressor::EncodeBC1(const Block& block, unsigned char* out)
+{
+	float endpoint0[3], endpoint1[3];
+	ComputeEndpoints(block, 0, 3, endpoint0, endpoint1);
+
+	// The 4 colours mode needs color0 > color1, the other one has a transparent black
+	unsigned short color0 = PackRGB565(endpoint0);
+	unsigned short color1 = PackRGB565(endpoint1);
+	if (color0 < color1)
+	{
+		std::swap(color0, color1);
+	}
+
+	unsigned int indices = 0;
+	if (color0 != color1)
+	{
+		// Project on what the GPU decodes, not on the endpoints before quantisation
+		float decoded0[3], decoded1[3];
+		UnpackRGB565(color0, decoded0);
+		UnpackRGB565(color1, decoded1);
+
+		unsigned char steps[16];
+		ProjectTexels(block, 0, 3, decoded0, decoded1, 4, steps);
+
+		// The palette is color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1
+		static const unsigned int STEP_TO_INDEX[4] = { 0, 2, 3, 1 };
+		for (int i = 0; i < 16; i++)
+		{
+			indices |= STEP_TO_INDEX[steps[i]] << (i * 2);
+		}
+	}
+
+	out[0] = (unsigned char)(color0 & 0xFF);
+	out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)(color1 & 0xFF);
+	out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+	{
+		out[4 + i] = (unsigned char)(indices >> (i * 8));
+	}
+}
+
+void TextureCompressor::EncodeBC4(const Block& block, int channel, unsigned char* out)
+{
+	float minimum = 255.0f, maximum = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		minimum = std::min(minimum, block.channels[channel][i]);
+		maximum = std::max(maximum, block.channels[channel][i]);
+	}
+
+	// value0 > value1 selects the mode with 6 interpolated values
+	unsigned char value0 = (unsigned char)(maximum + 0.5f);
+	unsigned char value1 = (unsigned char)(minimum + 0.5f);
+
+	unsigned long long indices = 0;
+	if (value0 > value1)
+	{
+		float low = value1, high = value0;
+		unsigned char steps[16];
+		ProjectTexels(block, channel, 1, &low, &high, 8, steps);
+
+		// The palette is value0, value1 then 6/7 value0 + 1/7 value1 down to 1/7 value0 + 6/7 value1
+		static const unsigned long long STEP_TO_INDEX[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			indices |= STEP_TO_INDEX[steps[i]] << (i * 3);
+		}
+	}
+
+	out[0] = value0;
+	out[1] = value1;
+	for (int i = 0; i < 6; i++)
+	{
+		out[2 + i] = (unsigned char)(indices >> (i * 8));
+	}
+}
+
+void TextureCompressor::EncodeBC7(const Block& block, unsigned char* out)
+{
+	float endpoints[2][4];
+	ComputeEndpoints(block, 0, 4, endpoints[0], endpoints[1]);
+
+	// 7 bits per channel and a low bit shared by the 4 channels of an endpoint, keep the p bit closest to the endpoint
+	int quantised[2][4];
+	int pBits[2];
+	for (int e = 0; e < 2; e++)
+	{
+		float bestError = 1e30f;
+		for (int p = 0; p < 2; p++)
+		{
+			int candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++)
+			{
+				candidate[c] = std::min(std::max((int)floorf((endpoints[e][c] - p) / 2.0f + 0.5f), 0), 127);
+				float difference = (float)((candidate[c] << 1) | p) - endpoints[e][c];
+				error += difference * difference;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				pBits[e] = p;
+				std::copy(candidate, candidate + 4, quantised[e]);
+			}
+		}
+	}
+
+	float decoded[2][4];
+	for (int e = 0; e < 2; e++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			decoded[e][c] = (float)((quantised[e][c] << 1) | pBits[e]);
+		}
+	}
+
+	// The 16 interpolation weights of BC7 are close enough to evenly spaced
+	unsigned char indices[16];
+	ProjectTexels(block, 0, 4, decoded[0], decoded[1], 16, indices);
+
+	// The first index is stored without its high bit, it must be 0
+	if (indices[0] & 8)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			std::swap(quantised[0][c], quantised[1][c]);
+		}
+		std::swap(pBits[0], pBits[1]);
+		for (int i = 0; i < 16; i++)
+		{
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	// The fields are packed from the lowest bit of the first byte
+	unsigned long long bits[2] = { 0, 0 };
+	unsigned int position = 0;
+	auto write = [&](unsigned int value, unsigned int count)
+	{
+		for (unsigned int i = 0; i < count; i++, position++)
+		{
+			bits[position / 64] |= (unsigned long long)((value >> i) & 1) << (position % 64);
+		}
+	};
+
+	// Mode 6 is 6 zero bits then a one
+	write(0, 6);
+	write(1, 1);
+	for (int c = 0; c < 4; c++)
+	{
+		write(quantised[0][c], 7);
+		write(quantised[1][c], 7);
+	}
+	write(pBits[0], 1);
+	write(pBits[1], 1);
+	write(indices[0], 3);
+	for (int i = 1; i < 16; i++)
+	{
+		write(indices[i], 4);
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		out[i] = (unsigned char)(bits[i / 8] >> ((i % 8) * 8));
+	}
+}
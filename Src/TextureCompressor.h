@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "ThreadPool.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TEXTURE_COMPRESSION_SSE
+#endif
+
+// CPU encoder of the block compressed formats, every 4x4 texels are stored in 8 or 16 bytes:
+// - BC1: RGB, 4 bits per texel
+// - BC3: RGBA, 8 bits per texel (BC1 colour + BC4 alpha)
+// - BC5: two channels, 8 bits per texel, for normal maps
+// - BC7: RGBA, 8 bits per texel, mode 6 only (one subset, 7777 + p bit endpoints, 16 indices)
+// Endpoints are the extremes of the texels along their principal axis, the texels are then projected on the
+// quantised endpoints, 4 at once with SSE.
+class TextureCompressor
+{
+public:
+	enum Format
+	{
+		FORMAT_NONE,	// uncompressed RGB8 / RGBA8
+		FORMAT_BC1,
+		FORMAT_BC3,
+		FORMAT_BC5,
+		FORMAT_BC7,
+		FORMAT_COUNT
+	};
+
+	struct Level
+	{
+		int width, height;
+		std::vector<unsigned char> data;
+	};
+
+	// Must be called on the GL thread after glewInit, check which formats the driver can sample
+	static void Init();
+	// Cooking without a GL context: assume a GL 4.2 class driver, S3TC, RGTC and BPTC are all there
+	static void InitOffline();
+	static bool IsSupported(Format format);
+	// Smallest supported format that keeps the quality of a colour texture, FORMAT_NONE if there is none
+	static Format ChooseFormat(bool alpha);
+
+	static GLenum GetInternalFormat(Format format);
+	static const char* GetFormatName(Format format);
+	static size_t GetLevelSize(Format format, int width, int height);
+
+	// rgba is width * height * 4 bytes. Build the whole mip chain down to 1x1 with a box filter and encode every level.
+	// The rows of blocks are encoded in parallel when threads is given
+	static void Compress(const unsigned char* rgba, int width, int height, Format format, ThreadPool* threads, std::vector<Level>* levels);
+
+private:
+	// 16 texels of every channel, as float so 4 of them are projected at once
+	struct Block
+	{
+		float channels[4][16];
+	};
+
+	static bool supported[FORMAT_COUNT];
+
+	static void EncodeLevel(const unsigned char* rgba, int width, int height, Format format, ThreadPool* threads, unsigned char* out);
+	static void Downsample(const unsigned char* rgba, int width, int height, std::vector<unsigned char>* result);
+
+	// Texels outside of the image repeat the last row and column
+	static void ExtractBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, Block* block);
+
+	// Extremes of the texels of channels [firstChannel, firstChannel + channelCount) along their principal axis
+	static void ComputeEndpoints(const Block& block, int firstChannel, int channelCount, float* endpoint0, float* endpoint1);
+	// Closest of levelCount evenly spaced points between endpoint0 (0) and endpoint1 (levelCount - 1) for every texel
+	static void ProjectTexels(const Block& block, int firstChannel, int channelCount, const float* endpoint0, const float* endpoint1, int levelCount, unsigned char* steps);
+
+	static void EncodeBC1(const Block& block, unsigned char* out);
+	static void EncodeBC4(const Block& block, int channel, unsigned char* out);
+	static void EncodeBC7(const Block& block, unsigned char* out);
+
+	static unsigned short PackRGB565(const float* color);
+	static void UnpackRGB565(unsigned short packed, float* color);
+};
@@ -0,0 +1,425 @@
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "CommonValues.h"
+#include "ImageDecoder.h"
+#include "MeshCache.h"
+
+// Values from the DDS and DXGI documentation
+static const unsigned int DDSD_CAPS = 0x1;
+static const unsigned int DDSD_HEIGHT = 0x2;
+static const unsigned int DDSD_WIDTH = 0x4;
+static const unsigned int DDSD_PIXELFORMAT = 0x1000;
+static const unsigned int DDSD_MIPMAPCOUNT = 0x20000;
+static const unsigned int DDSD_LINEARSIZE = 0x80000;
+static const unsigned int DDPF_FOURCC = 0x4;
+static const unsigned int DDSCAPS_COMPLEX = 0x8;
+static const unsigned int DDSCAPS_TEXTURE = 0x1000;
+static const unsigned int DDSCAPS_MIPMAP = 0x400000;
+static const unsigned int DDSCAPS2_CUBEMAP_ALLFACES = 0xFE00;
+static const unsigned int DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+static const unsigned int DDS_DIMENSION_TEXTURE2D = 3;
+static const unsigned int DXGI_FORMAT_R8G8B8A8_UNORM = 28;
+static const unsigned int DXGI_FORMAT_BC1_UNORM = 71;
+static const unsigned int DXGI_FORMAT_BC3_UNORM = 77;
+static const unsigned int DXGI_FORMAT_BC5_UNORM = 83;
+static const unsigned int DXGI_FORMAT_BC7_UNORM = 98;
+
+int TextureFile::maxTextureSize = 16384;
+
+void TextureFile::Init()
+{
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+}
+
+unsigned int TextureFile::MakeFourCC(const char* code)
+{
+	return (unsigned int)code[0] | ((unsigned int)code[1] << 8) | ((unsigned int)code[2] << 16) | ((unsigned int)code[3] << 24);
+}
+
+unsigned int TextureFile::GetDxgiFormat(TextureCompressor::Format format)
+{
+	switch (format)
+	{
+	case TextureCompressor::FORMAT_BC1:
+		return DXGI_FORMAT_BC1_UNORM;
+	case TextureCompressor::FORMAT_BC3:
+		return DXGI_FORMAT_BC3_UNORM;
+	case TextureCompressor::FORMAT_BC5:
+		return DXGI_FORMAT_BC5_UNORM;
+	case TextureCompressor::FORMAT_BC7:
+		return DXGI_FORMAT_BC7_UNORM;
+	default:
+		return DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+bool TextureFile::GetFormat(const Header& header, const HeaderDX10* headerDX10, TextureCompressor::Format* format)
+{
+	if (headerDX10)
+	{
+		switch (headerDX10->dxgiFormat)
+		{
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+			*format = TextureCompressor::FORMAT_NONE;
+			return true;
+		case DXGI_FORMAT_BC1_UNORM:
+			*format = TextureCompressor::FORMAT_BC1;
+			return true;
+		case DXGI_FORMAT_BC3_UNORM:
+			*format = TextureCompressor::FORMAT_BC3;
+			return true;
+		case DXGI_FORMAT_BC5_UNORM:
+			*format = TextureCompressor::FORMAT_BC5;
+			return true;
+		case DXGI_FORMAT_BC7_UNORM:
+			*format = TextureCompressor::FORMAT_BC7;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Files written by older tools
+	if (header.pixelFormat.flags & DDPF_FOURCC)
+	{
+		if (header.pixelFormat.fourCC == MakeFourCC("DXT1"))
+		{
+			*format = TextureCompressor::FORMAT_BC1;
+			return true;
+		}
+		if (header.pixelFormat.fourCC == MakeFourCC("DXT5"))
+		{
+			*format = TextureCompressor::FORMAT_BC3;
+			return true;
+		}
+		if (header.pixelFormat.fourCC == MakeFourCC("ATI2"))
+		{
+			*format = TextureCompressor::FORMAT_BC5;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool TextureFile::LoadLevels(const std::string& fileName, int firstLevel, int levelCount, std::vector<TextureCompressor::Level>* levels)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	Image image;
+	bool valid = ReadHeader(file, &image, 0) && image.faceCount == 1 && firstLevel + levelCount <= image.levelCount;
+
+	// Skip the levels before the first one, they are all in front of it
+	long offset = 0;
+	int width = image.width;
+	int height = image.height;
+	for (int level = 0; valid && level < firstLevel; level++)
+	{
+		offset += (long)TextureCompressor::GetLevelSize(image.format, width, height);
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	valid = valid && fseek(file, offset, SEEK_CUR) == 0;
+
+	levels->resize(valid ? levelCount : 0);
+	for (int i = 0; valid && i < levelCount; i++)
+	{
+		TextureCompressor::Level& out = (*levels)[i];
+		out.width = width;
+		out.height = height;
+		out.data.resize(TextureCompressor::GetLevelSize(image.format, width, height));
+		valid = fread(out.data.data(), out.data.size(), 1, file) == 1;
+
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+
+	fclose(file);
+
+	if (!valid)
+	{
+		levels->clear();
+	}
+	return valid;
+}
+
+size_t TextureFile::GetSize(const Image& image)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < image.levels.size(); i++)
+	{
+		size += image.levels[i].data.size();
+	}
+	return size;
+}
+
+bool TextureFile::Save(const std::string& fileName, const Image& image, unsigned long long key)
+{
+	Header header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(Header);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = image.height;
+	header.width = image.width;
+	header.pitchOrLinearSize = (unsigned int)image.levels[0].data.size();
+	header.mipMapCount = image.levelCount;
+	header.reserved1[0] = KEY_TAG;
+	header.reserved1[1] = (unsigned int)(key & 0xFFFFFFFF);
+	header.reserved1[2] = (unsigned int)(key >> 32);
+	header.pixelFormat.size = sizeof(PixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = MakeFourCC("DX10");
+	header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+	header.caps2 = image.faceCount == 6 ? DDSCAPS2_CUBEMAP_ALLFACES : 0;
+
+	HeaderDX10 headerDX10;
+	headerDX10.dxgiFormat = GetDxgiFormat(image.format);
+	headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	headerDX10.miscFlag = image.faceCount == 6 ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+	// Counted in cubes for cube maps
+	headerDX10.arraySize = 1;
+	headerDX10.miscFlags2 = 0;
+
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if (!file)
+	{
+		printf("Failed to write the cooked texture: %s\n", fileName.c_str());
+		return false;
+	}
+
+	bool written = fwrite("DDS ", 4, 1, file) == 1
+				&& fwrite(&header, sizeof(header), 1, file) == 1
+				&& fwrite(&headerDX10, sizeof(headerDX10), 1, file) == 1;
+	for (size_t i = 0; written && i < image.levels.size(); i++)
+	{
+		written = fwrite(image.levels[i].data.data(), image.levels[i].data.size(), 1, file) == 1;
+	}
+
+	fclose(file);
+
+	if (!written)
+	{
+		printf("Failed to write the cooked texture: %s\n", fileName.c_str());
+		remove(fileName.c_str());
+	}
+	return written;
+}
+
+bool TextureFile::ReadHeader(FILE* file, Image* image, unsigned long long key)
+{
+	char magic[4];
+	Header header;
+	HeaderDX10 headerDX10;
+	bool hasDX10 = false;
+
+	bool valid = fread(magic, 4, 1, file) == 1 && memcmp(magic, "DDS ", 4) == 0
+				&& fread(&header, sizeof(header), 1, file) == 1 && header.size == sizeof(Header);
+	if (valid && (header.pixelFormat.flags & DDPF_FOURCC) && header.pixelFormat.fourCC == MakeFourCC("DX10"))
+	{
+		hasDX10 = true;
+		valid = fread(&headerDX10, sizeof(headerDX10), 1, file) == 1 && headerDX10.arraySize == 1;
+	}
+	if (valid && key != 0)
+	{
+		unsigned long long fileKey = header.reserved1[1] | ((unsigned long long)header.reserved1[2] << 32);
+		valid = header.reserved1[0] == KEY_TAG && fileKey == key;
+	}
+	if (valid)
+	{
+		valid = GetFormat(header, hasDX10 ? &headerDX10 : nullptr, &image->format);
+	}
+
+	// Any file is accepted without a key, its sizes must not turn into huge allocations or invalid GL calls
+	if (!valid || header.width == 0 || header.height == 0 || header.width > (unsigned int)maxTextureSize || header.height > (unsigned int)maxTextureSize)
+	{
+		return false;
+	}
+
+	int fullChain = 1;
+	while (std::max(header.width, header.height) >> fullChain)
+	{
+		fullChain++;
+	}
+
+	bool cube = (header.caps2 & DDSCAPS2_CUBEMAP_ALLFACES) == DDSCAPS2_CUBEMAP_ALLFACES
+				|| (hasDX10 && (headerDX10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE));
+	image->width = header.width;
+	image->height = header.height;
+	image->faceCount = cube ? 6 : 1;
+	image->levelCount = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? (int)std::min(header.mipMapCount, (unsigned int)fullChain) : 1;
+	return true;
+}
+
+bool TextureFile::Load(const std::string& fileName, Image* image, unsigned long long key)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	bool valid = ReadHeader(file, image, key);
+	if (!valid)
+	{
+		fclose(file);
+		return false;
+	}
+
+	image->levels.resize(image->faceCount * image->levelCount);
+
+	// Straight into the level buffers, they go to the GPU as they are
+	for (int face = 0; face < image->faceCount && valid; face++)
+	{
+		int width = image->width;
+		int height = image->height;
+		for (int level = 0; level < image->levelCount && valid; level++)
+		{
+			TextureCompressor::Level& out = image->levels[face * image->levelCount + level];
+			out.width = width;
+			out.height = height;
+			out.data.resize(TextureCompressor::GetLevelSize(image->format, width, height));
+			valid = fread(out.data.data(), out.data.size(), 1, file) == 1;
+
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+	}
+
+	fclose(file);
+
+	if (!valid)
+	{
+		printf("Truncated texture file: %s\n", fileName.c_str());
+		image->levels.clear();
+	}
+	return valid;
+}
+
+bool TextureFile::Cook(const std::vector<std::string>& sourceFiles, const std::string& cookedFile, TextureCompressor::Format format, ThreadPool* threads, Image* image)
+{
+	// Any change in the sources or the format gives another key, a missing source accepts any cooked file
+	unsigned long long key = MeshCache::HashValue(14695981039346656037ull, format);
+	for (size_t i = 0; i < sourceFiles.size() && key != 0; i++)
+	{
+		unsigned long long sourceHash = MeshCache::HashFile(sourceFiles[i]);
+		key = sourceHash != 0 ? MeshCache::HashValue(key, sourceHash) : 0;
+	}
+
+	if (Load(cookedFile, image, key) && image->faceCount == (int)sourceFiles.size())
+	{
+		return true;
+	}
+
+	image->format = format;
+	image->faceCount = (int)sourceFiles.size();
+	image->levels.clear();
+
+	// The faces of a cube map are decoded at the same time
+	std::vector<ImageDecoder::Image> sources;
+	bool decoded = ImageDecoder::DecodeAll(sourceFiles, 4, threads, &sources);
+
+	for (size_t i = 0; i < sources.size() && decoded; i++)
+	{
+		if (i > 0 && (sources[i].width != image->width || sources[i].height != image->height))
+		{
+			printf("Cube map faces must have the same size: %s\n", sourceFiles[i].c_str());
+			decoded = false;
+			break;
+		}
+
+		std::vector<TextureCompressor::Level> faceLevels;
+		TextureCompressor::Compress(sources[i].pixels, sources[i].width, sources[i].height, format, threads, &faceLevels);
+		ImageDecoder::Free(&sources[i]);
+
+		image->width = sources[i].width;
+		image->height = sources[i].height;
+		image->levelCount = (int)faceLevels.size();
+		for (size_t level = 0; level < faceLevels.size(); level++)
+		{
+			image->levels.push_back(TextureCompressor::Level());
+			image->levels.back().width = faceLevels[level].width;
+			image->levels.back().height = faceLevels[level].height;
+			image->levels.back().data.swap(faceLevels[level].data);
+		}
+	}
+
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		ImageDecoder::Free(&sources[i]);
+	}
+	if (!decoded)
+	{
+		image->levels.clear();
+		return false;
+	}
+
+	if (key != 0)
+	{
+		Save(cookedFile, *image, key);
+	}
+	return true;
+}
+
+int TextureFile::CookDirectory(const std::string& directory, ThreadPool* threads)
+{
+	std::vector<std::string> files = ImageDecoder::ListFiles(directory);
+	int cooked = 0;
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		int width, height, channels;
+		if (!ImageDecoder::IsImageFile(files[i]) || !stbi_info(files[i].c_str(), &width, &height, &channels))
+		{
+			continue;
+		}
+
+		// Same name and format as Texture picks at runtime so the files are found on the next run
+		TextureCompressor::Format format = TextureCompressor::ChooseFormat(channels == 4);
+		Image image;
+		if (Cook(std::vector<std::string>(1, files[i]), files[i] + ".dds", format, threads, &image))
+		{
+			printf("Cooked %s: %dx%d %s, %d levels, %.2f MB\n", files[i].c_str(), image.width, image.height,
+				TextureCompressor::GetFormatName(format), image.levelCount, GetSize(image) / (1024.0f * 1024.0f));
+			cooked++;
+		}
+	}
+
+	return cooked;
+}
+
+size_t TextureFile::Upload(const Image& image, int firstLevel)
+{
+	GLenum internalFormat = TextureCompressor::GetInternalFormat(image.format);
+	size_t uploaded = 0;
+
+	for (int face = 0; face < image.faceCount; face++)
+	{
+		GLenum target = image.faceCount == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+		for (int level = 0; level < image.levelCount; level++)
+		{
+			const TextureCompressor::Level& data = image.levels[face * image.levelCount + level];
+			if (image.format == TextureCompressor::FORMAT_NONE)
+			{
+				glTexImage2D(target, firstLevel + level, GL_RGBA, data.width, data.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data.data());
+			}
+			else
+			{
+				glCompressedTexImage2D(target, firstLevel + level, internalFormat, data.width, data.height, 0, (GLsizei)data.data.size(), data.data.data());
+			}
+			uploaded += data.data.size();
+		}
+	}
+
+	GLenum textureTarget = image.faceCount == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+	glTexParameteri(textureTarget, GL_TEXTURE_BASE_LEVEL, firstLevel);
+	glTexParameteri(textureTarget, GL_TEXTURE_MAX_LEVEL, firstLevel + image.levelCount - 1);
+	return uploaded;
+}
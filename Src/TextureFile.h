@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "TextureCompressor.h"
+#include "ThreadPool.h"
+
+// DDS files holding textures ready for the GPU: every mip level and the 6 faces of cube maps are stored
+// in their final format so loading is a read and glCompressedTexImage2D, no decoding and no glGenerateMipmap.
+// We write the DX10 header (needed for BC7) and read it or the legacy DXT1/DXT5/ATI2 ones.
+class TextureFile
+{
+public:
+	struct Image
+	{
+		TextureCompressor::Format format;
+		int width, height;
+		// 1 for a 2D texture, 6 for a cube map in the +X, -X, +Y, -Y, +Z, -Z order
+		int faceCount;
+		int levelCount;
+		// faceCount * levelCount, every level of the first face then every level of the next one
+		std::vector<TextureCompressor::Level> levels;
+	};
+
+	// key is kept in the reserved words of the header, Load fails if it's different (0 accepts any file)
+	static bool Save(const std::string& fileName, const Image& image, unsigned long long key = 0);
+	static bool Load(const std::string& fileName, Image* image, unsigned long long key = 0);
+	// Only the levels [firstLevel, firstLevel + levelCount) of a 2D texture, for streaming
+	static bool LoadLevels(const std::string& fileName, int firstLevel, int levelCount, std::vector<TextureCompressor::Level>* levels);
+
+	// Load cookedFile if it was built from the same sources in the same format, or else decode the sources
+	// (1 image, or 6 for a cube map), encode them with their mip chain and save cookedFile for the next run
+	static bool Cook(const std::vector<std::string>& sourceFiles, const std::string& cookedFile, TextureCompressor::Format format, ThreadPool* threads, Image* image);
+
+	// Cook every image of a directory next to it, RGBA images get the alpha format.
+	// TextureCompressor must be initialised. Return the number of textures cooked
+	static int CookDirectory(const std::string& directory, ThreadPool* threads);
+
+	// Must be called on the GL thread with the texture bound to GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP.
+	// The levels of image start at firstLevel, the ones before are left out. Return the number of bytes uploaded
+	static size_t Upload(const Image& image, int firstLevel = 0);
+
+	static size_t GetSize(const Image& image);
+
+	// Read GL_MAX_TEXTURE_SIZE on the GL thread so the loader threads can reject bigger files.
+	// Without it the largest size of the current GPUs is assumed
+	static void Init();
+
+private:
+	struct PixelFormat
+	{
+		unsigned int size;
+		unsigned int flags;
+		unsigned int fourCC;
+		unsigned int rgbBitCount;
+		unsigned int rBitMask, gBitMask, bBitMask, aBitMask;
+	};
+
+	struct Header
+	{
+		unsigned int size;
+		unsigned int flags;
+		unsigned int height;
+		unsigned int width;
+		unsigned int pitchOrLinearSize;
+		unsigned int depth;
+		unsigned int mipMapCount;
+		unsigned int reserved1[11];
+		PixelFormat pixelFormat;
+		unsigned int caps, caps2, caps3, caps4;
+		unsigned int reserved2;
+	};
+
+	struct HeaderDX10
+	{
+		unsigned int dxgiFormat;
+		unsigned int resourceDimension;
+		unsigned int miscFlag;
+		unsigned int arraySize;
+		unsigned int miscFlags2;
+	};
+
+	// "SB3D" in reserved1[0], the key in reserved1[1] and reserved1[2]
+	static const unsigned int KEY_TAG = 0x44334253;
+
+	static int maxTextureSize;
+
+	// Fill everything but the levels, the file is left at the start of the data.
+	// False for a size of 0 or above maxTextureSize, the level count is clamped to the full mip chain
+	static bool ReadHeader(FILE* file, Image* image, unsigned long long key);
+
+	static unsigned int MakeFourCC(const char* code);
+	static unsigned int GetDxgiFormat(TextureCompressor::Format format);
+	static bool GetFormat(const Header& header, const HeaderDX10* headerDX10, TextureCompressor::Format* format);
+};
@@ -0,0 +1,261 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <stdio.h>
+
+TextureStreamer::TextureStreamer()
+{
+	textureCache = nullptr;
+	assetLoader = nullptr;
+	budget = 0;
+	frame = 0;
+	uploadedBytes = 0;
+	pendingLoads = 0;
+	stats = Stats();
+}
+
+void TextureStreamer::Init(TextureCache* cache, AssetLoader* loader, size_t budgetBytes)
+{
+	textureCache = cache;
+	assetLoader = loader;
+	budget = budgetBytes;
+}
+
+void TextureStreamer::SetBudget(size_t budgetBytes)
+{
+	budget = budgetBytes;
+}
+
+float TextureStreamer::GetPixelSize(float distance, float worldSize, float projectionScale)
+{
+	return worldSize * projectionScale / std::max(distance, 0.001f);
+}
+
+void TextureStreamer::Request(Texture* texture, float pixelSize)
+{
+	if (!texture)
+	{
+		return;
+	}
+
+	float& request = requests[texture];
+	request = std::max(request, pixelSize);
+}
+
+size_t TextureStreamer::GetMemory(Texture* texture, int baseLevel)
+{
+	size_t memory = 0;
+	for (int level = baseLevel; level < texture->GetLevelCount(); level++)
+	{
+		memory += texture->GetLevelMemory(level);
+	}
+	return memory;
+}
+
+void TextureStreamer::Update()
+{
+	frame++;
+
+	stats = Stats();
+	stats.budgetBytes = budget;
+	stats.uploadedBytes = uploadedBytes;
+	uploadedBytes = 0;
+
+	std::vector<std::shared_ptr<Texture>> textures;
+	textureCache->GetTextures(&textures);
+	stats.textureCount = textures.size();
+
+	// Forget the textures the cache released
+	std::set<Texture*> alive;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		alive.insert(textures[i].get());
+	}
+	for (std::map<Texture*, State>::iterator it = states.begin(); it != states.end();)
+	{
+		it = alive.count(it->first) ? std::next(it) : states.erase(it);
+	}
+
+	// Level each texture needs, as if there was no budget
+	std::vector<std::shared_ptr<Texture>> streamed;
+	size_t total = 0;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		Texture* texture = textures[i].get();
+		if (!texture->IsStreamed())
+		{
+			// Still counted, they just can't shrink
+			total += texture->GetMemoryUsage();
+			continue;
+		}
+
+		int tail = texture->GetTailLevel();
+		std::map<Texture*, State>::iterator found = states.find(texture);
+		if (found == states.end())
+		{
+			State state;
+			state.neededLevel = tail;
+			state.targetLevel = tail;
+			state.lastUsedFrame = 0;
+			state.loading = false;
+			found = states.insert(std::make_pair(texture, state)).first;
+		}
+		State& state = found->second;
+
+		std::map<Texture*, float>::iterator request = requests.find(texture);
+		if (request != requests.end())
+		{
+			// One texel per pixel: each level halves the size
+			float texels = (float)std::max(texture->GetWidth(), texture->GetHeight());
+			int level = request->second > 0.0f ? (int)floorf(log2f(texels / request->second)) : tail;
+			state.neededLevel = std::min(std::max(level, 0), tail);
+			state.lastUsedFrame = frame;
+
+			if (texture->GetBaseLevel() > state.neededLevel)
+			{
+				stats.misses++;
+			}
+		}
+		else if (frame - state.lastUsedFrame > UNUSED_FRAMES)
+		{
+			state.neededLevel = tail;
+		}
+
+		state.targetLevel = state.neededLevel;
+		total += GetMemory(texture, state.targetLevel);
+		streamed.push_back(textures[i]);
+	}
+	stats.streamedCount = streamed.size();
+
+	// Over the budget, the least recently used textures give their top level first, the biggest one on ties
+	while (total > budget)
+	{
+		Texture* victim = nullptr;
+		State* victimState = nullptr;
+		for (size_t i = 0; i < streamed.size(); i++)
+		{
+			Texture* texture = streamed[i].get();
+			State& state = states[texture];
+			if (state.targetLevel >= texture->GetTailLevel())
+			{
+				continue;
+			}
+
+			if (!victim || state.lastUsedFrame < victimState->lastUsedFrame
+				|| (state.lastUsedFrame == victimState->lastUsedFrame
+					&& texture->GetLevelMemory(state.targetLevel) > victim->GetLevelMemory(victimState->targetLevel)))
+			{
+				victim = texture;
+				victimState = &state;
+			}
+		}
+
+		if (!victim)
+		{
+			break;
+		}
+
+		total -= victim->GetLevelMemory(victimState->targetLevel);
+		victimState->targetLevel++;
+	}
+
+	for (size_t i = 0; i < streamed.size(); i++)
+	{
+		Texture* texture = streamed[i].get();
+		State& state = states[texture];
+
+		if (state.targetLevel > texture->GetBaseLevel())
+		{
+			stats.evictedBytes += GetMemory(texture, texture->GetBaseLevel()) - GetMemory(texture, state.targetLevel);
+			texture->DropLevels(state.targetLevel);
+		}
+		else if (state.targetLevel < texture->GetBaseLevel() && !state.loading)
+		{
+			LoadLevels(streamed[i], state.targetLevel);
+		}
+	}
+
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		stats.residentBytes += textures[i]->GetMemoryUsage();
+	}
+	stats.pendingLoads = pendingLoads;
+
+	requests.clear();
+}
+
+void TextureStreamer::LoadLevels(const std::shared_ptr<Texture>& texture, int firstLevel)
+{
+	int levelCount = texture->GetBaseLevel() - firstLevel;
+	std::string fileName = texture->GetCookedLocation();
+	std::weak_ptr<Texture> weakTexture = texture;
+	Texture* key = texture.get();
+
+	states[key].loading = true;
+	pendingLoads++;
+
+	assetLoader->LoadAsync([this, fileName, firstLevel, levelCount, weakTexture, key]()
+	{
+		std::shared_ptr<std::vector<TextureCompressor::Level>> levels = std::make_shared<std::vector<TextureCompressor::Level>>();
+		if (!TextureFile::LoadLevels(fileName, firstLevel, levelCount, levels.get()))
+		{
+			printf("Failed to stream the levels of: %s\n", fileName.c_str());
+		}
+
+		size_t bytes = 0;
+		for (size_t i = 0; i < levels->size(); i++)
+		{
+			bytes += (*levels)[i].data.size();
+		}
+
+		// Even a failed load goes through the queue, the state is only touched on the GL thread
+		assetLoader->QueueUpload(bytes, [this, levels, firstLevel, weakTexture, key, bytes]()
+		{
+			pendingLoads--;
+
+			std::map<Texture*, State>::iterator state = states.find(key);
+			if (state != states.end())
+			{
+				state->second.loading = false;
+			}
+
+			// The levels are ignored if the texture was released or evicted meanwhile
+			std::shared_ptr<Texture> texture = weakTexture.lock();
+			if (texture && !levels->empty() && firstLevel + (int)levels->size() == texture->GetBaseLevel())
+			{
+				texture->AddLevels(*levels, firstLevel);
+				uploadedBytes += bytes;
+			}
+		});
+	});
+}
+
+void TextureStreamer::PrintStats()
+{
+	printf("Texture streaming: %u of %u textures streamed, %.2f / %.2f MB, %u misses, %u loading, %.2f MB uploaded, %.2f MB evicted last frame\n",
+		stats.streamedCount, stats.textureCount, stats.residentBytes / (1024.0f * 1024.0f), stats.budgetBytes / (1024.0f * 1024.0f),
+		stats.misses, stats.pendingLoads, stats.uploadedBytes / (1024.0f * 1024.0f), stats.evictedBytes / (1024.0f * 1024.0f));
+
+	std::vector<std::shared_ptr<Texture>> textures;
+	textureCache->GetTextures(&textures);
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		Texture* texture = textures[i].get();
+		std::map<Texture*, State>::iterator state = states.find(texture);
+		if (!texture->IsStreamed() || state == states.end())
+		{
+			continue;
+		}
+
+		int base = texture->GetBaseLevel();
+		printf("  %s: level %d (%dx%d), needs %d, %.2f MB%s\n", texture->GetCookedLocation().c_str(), base,
+			std::max(1, texture->GetWidth() >> base), std::max(1, texture->GetHeight() >> base), state->second.neededLevel,
+			texture->GetMemoryUsage() / (1024.0f * 1024.0f), state->second.loading ? ", loading" : "");
+	}
+}
+
+TextureStreamer::~TextureStreamer()
+{
+}
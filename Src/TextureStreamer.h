@@ -0,0 +1,81 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "AssetLoader.h"
+#include "Texture.h"
+#include "TextureCache.h"
+
+// Keep the streamed textures of a cache at the mip level their size on screen needs, under a GPU memory budget.
+// Every frame the renderer reports how big each texture is seen, Update then drops the levels that aren't
+// needed anymore right away and reads the missing ones from the cooked files on the loader threads.
+// When everything doesn't fit, the textures used the longest time ago lose their top levels first.
+class TextureStreamer
+{
+public:
+	struct Stats
+	{
+		unsigned int textureCount;
+		unsigned int streamedCount;
+		size_t residentBytes;
+		size_t budgetBytes;
+		// Textures sampled this frame at a lower level than the one they need
+		unsigned int misses;
+		unsigned int pendingLoads;
+		size_t uploadedBytes;
+		size_t evictedBytes;
+	};
+
+	TextureStreamer();
+
+	void Init(TextureCache* cache, AssetLoader* loader, size_t budgetBytes);
+	void SetBudget(size_t budgetBytes);
+
+	// Size in pixels of the whole texture (its 0 to 1 UV range) as it's seen this frame, the biggest request wins.
+	// Must be called on the GL thread between two Update
+	void Request(Texture* texture, float pixelSize);
+	// Pixels covered on screen by worldSize units seen at distance, for Request
+	static float GetPixelSize(float distance, float worldSize, float projectionScale);
+
+	// Once per frame on the GL thread after the requests
+	void Update();
+
+	// Of the last Update
+	const Stats& GetStats() { return stats; }
+	void PrintStats();
+
+	~TextureStreamer();
+
+private:
+	struct State
+	{
+		// Level asked by the requests, kept a few frames after the last one
+		int neededLevel;
+		// Level we aim for after the budget is applied
+		int targetLevel;
+		unsigned int lastUsedFrame;
+		bool loading;
+	};
+
+	// Requests older than this let the texture go back to its tail
+	static const unsigned int UNUSED_FRAMES = 120;
+
+	size_t GetMemory(Texture* texture, int baseLevel);
+	void LoadLevels(const std::shared_ptr<Texture>& texture, int firstLevel);
+
+	TextureCache* textureCache;
+	AssetLoader* assetLoader;
+	size_t budget;
+
+	unsigned int frame;
+	std::map<Texture*, State> states;
+	std::map<Texture*, float> requests;
+
+	// Updated by the uploads queued in the loader, they run on the GL thread too
+	size_t uploadedBytes;
+	int pendingLoads;
+
+	Stats stats;
+};
@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <memory>
+
+ThreadPool::ThreadPool()
+{
+	runningTasks = 0;
+	stopping = false;
+}
+
+void ThreadPool::Start(unsigned int threadCount)
+{
+	Stop();
+
+	if (threadCount == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	stopping = false;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+void ThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	workers.clear();
+	tasks.clear();
+}
+
+void ThreadPool::Enqueue(const std::function<void()>& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(task);
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+	if (workers.empty() || count <= 1)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			body(i);
+		}
+		return;
+	}
+
+	// Every thread takes the next index until there is none left, so uneven items balance themselves
+	struct Shared
+	{
+		std::atomic<size_t> next;
+		std::atomic<size_t> done;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+	shared->next = 0;
+	shared->done = 0;
+
+	std::function<void()> run = [shared, count, &body]()
+	{
+		size_t i;
+		while ((i = shared->next++) < count)
+		{
+			body(i);
+			if (++shared->done == count)
+			{
+				std::lock_guard<std::mutex> lock(shared->mutex);
+				shared->finished.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(count - 1, workers.size());
+	for (size_t i = 0; i < helpers; i++)
+	{
+		Enqueue(run);
+	}
+	run();
+
+	// body stays valid since we don't return before every index is done
+	std::unique_lock<std::mutex> lock(shared->mutex);
+	shared->finished.wait(lock, [&]() { return shared->done == count; });
+}
+
+void ThreadPool::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this]() { return tasks.empty() && runningTasks == 0; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+
+			task = tasks.front();
+			tasks.pop_front();
+			runningTasks++;
+		}
+
+		task();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			runningTasks--;
+			if (tasks.empty() && runningTasks == 0)
+			{
+				idle.notify_all();
+			}
+		}
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
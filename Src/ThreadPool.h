@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running the tasks given to Enqueue in order.
+// The tasks must not use OpenGL, the context only exists on the main thread.
+class ThreadPool
+{
+public:
+	ThreadPool();
+
+	// 0 means one thread per core minus the main thread
+	void Start(unsigned int threadCount = 0);
+	void Stop();
+
+	unsigned int GetThreadCount() { return workers.size(); }
+
+	void Enqueue(const std::function<void()>& task);
+
+	// Call body(i) for every i in [0, count) on the workers and the calling thread, return once all of them are done.
+	// Run everything on the calling thread if the pool isn't started
+	void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+	// Block until the queue is empty and no task is running
+	void WaitIdle();
+
+	~ThreadPool();
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	std::condition_variable idle;
+	unsigned int runningTasks;
+	bool stopping;
+};
@@ -0,0 +1,270 @@
+#include "VertexFormat.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "CommonValues.h"
+
+VertexFormat::VertexFormat()
+{
+	position = POSITION_FLOAT;
+	texCoord = TEXCOORD_FLOAT;
+	normal = NORMAL_FLOAT;
+}
+
+VertexFormat::VertexFormat(PositionType positionType, TexCoordType texCoordType, NormalType normalType)
+{
+	position = positionType;
+	texCoord = texCoordType;
+	normal = normalType;
+}
+
+VertexFormat VertexFormat::Full()
+{
+	return VertexFormat(POSITION_FLOAT, TEXCOORD_FLOAT, NORMAL_FLOAT);
+}
+
+VertexFormat VertexFormat::Compressed()
+{
+	return VertexFormat(POSITION_UNORM16, TEXCOORD_HALF, NORMAL_OCT16);
+}
+
+GLsizei VertexFormat::GetPositionSize() const
+{
+	// the 16 bits formats are padded to 4 components so every attribute stay 4 bytes aligned
+	return position == POSITION_FLOAT ? sizeof(GLfloat) * 3 : sizeof(GLushort) * 4;
+}
+
+GLsizei VertexFormat::GetTexCoordSize() const
+{
+	return texCoord == TEXCOORD_FLOAT ? sizeof(GLfloat) * 2 : sizeof(GLushort) * 2;
+}
+
+GLsizei VertexFormat::GetNormalSize() const
+{
+	switch (normal)
+	{
+	case NORMAL_OCT16:
+		return sizeof(GLshort) * 2;
+	case NORMAL_OCT10:
+		return sizeof(GLuint);
+	default:
+		return sizeof(GLfloat) * 3;
+	}
+}
+
+GLsizei VertexFormat::GetStride() const
+{
+	return GetPositionSize() + GetTexCoordSize() + GetNormalSize();
+}
+
+bool VertexFormat::IsNormalOctahedral() const
+{
+	return normal != NORMAL_FLOAT;
+}
+
+unsigned int VertexFormat::GetId() const
+{
+	return position | (texCoord << 4) | (normal << 8);
+}
+
+void VertexFormat::GetPositionDecode(glm::vec3 boundsMin, glm::vec3 boundsMax, glm::vec3* scale, glm::vec3* offset) const
+{
+	// avoid dividing by 0 for flat meshes like the floor
+	glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+
+	switch (position)
+	{
+	case POSITION_HALF:
+		*scale = extent * 0.5f;
+		*offset = (boundsMin + boundsMax) * 0.5f;
+		break;
+	case POSITION_UNORM16:
+		*scale = extent;
+		*offset = boundsMin;
+		break;
+	default:
+		*scale = glm::vec3(1.0f);
+		*offset = glm::vec3(0.0f);
+		break;
+	}
+}
+
+void VertexFormat::Encode(const GLfloat* vertices, unsigned int vertexCount, glm::vec3 boundsMin, glm::vec3 boundsMax, unsigned char* out) const
+{
+	glm::vec3 scale, offset;
+	GetPositionDecode(boundsMin, boundsMax, &scale, &offset);
+
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const GLfloat* v = vertices + i * VERTEX_LENGTH;
+
+		// Position
+		if (position == POSITION_FLOAT)
+		{
+			memcpy(out, v, sizeof(GLfloat) * 3);
+		}
+		else
+		{
+			GLushort packed[4] = { 0, 0, 0, 0 };
+			for (int c = 0; c < 3; c++)
+			{
+				float relative = (v[c] - offset[c]) / scale[c];
+				if (position == POSITION_HALF)
+				{
+					packed[c] = FloatToHalf(relative);
+				}
+				else
+				{
+					packed[c] = (GLushort)(glm::clamp(relative, 0.0f, 1.0f) * 65535.0f + 0.5f);
+				}
+			}
+			memcpy(out, packed, sizeof(packed));
+		}
+		out += GetPositionSize();
+
+		// UV
+		if (texCoord == TEXCOORD_FLOAT)
+		{
+			memcpy(out, v + 3, sizeof(GLfloat) * 2);
+		}
+		else
+		{
+			GLushort packed[2] = { FloatToHalf(v[3]), FloatToHalf(v[4]) };
+			memcpy(out, packed, sizeof(packed));
+		}
+		out += GetTexCoordSize();
+
+		// Normal
+		if (normal == NORMAL_FLOAT)
+		{
+			memcpy(out, v + 5, sizeof(GLfloat) * 3);
+		}
+		else
+		{
+			glm::vec2 oct = OctahedralEncode(glm::vec3(v[5], v[6], v[7]));
+			if (normal == NORMAL_OCT16)
+			{
+				GLshort packed[2] = { (GLshort)std::round(oct.x * 32767.0f), (GLshort)std::round(oct.y * 32767.0f) };
+				memcpy(out, packed, sizeof(packed));
+			}
+			else
+			{
+				// x in bits 0-9, y in bits 10-19, z and w are unused
+				GLuint x = (GLuint)((int)std::round(oct.x * 511.0f) & 0x3FF);
+				GLuint y = (GLuint)((int)std::round(oct.y * 511.0f) & 0x3FF);
+				GLuint packed = x | (y << 10);
+				memcpy(out, &packed, sizeof(packed));
+			}
+		}
+		out += GetNormalSize();
+	}
+}
+
+void VertexFormat::SetupAttributes() const
+{
+	GLsizei stride = GetStride();
+	size_t offset = 0;
+
+	// Position
+	if (position == POSITION_FLOAT)
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+	}
+	else if (position == POSITION_HALF)
+	{
+		glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset);
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offset);
+	}
+	glEnableVertexAttribArray(0);
+	offset += GetPositionSize();
+
+	// UV
+	glVertexAttribPointer(1, 2, texCoord == TEXCOORD_FLOAT ? GL_FLOAT : GL_HALF_FLOAT, GL_FALSE, stride, (void*)offset);
+	glEnableVertexAttribArray(1);
+	offset += GetTexCoordSize();
+
+	// Normal
+	if (normal == NORMAL_FLOAT)
+	{
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+	}
+	else if (normal == NORMAL_OCT16)
+	{
+		glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (void*)offset);
+	}
+	else
+	{
+		// packed formats must be read with a size of 4
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offset);
+	}
+	glEnableVertexAttribArray(2);
+}
+
+unsigned short VertexFormat::FloatToHalf(float value)
+{
+	GLuint bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	GLuint sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	GLuint mantissa = bits & 0x007FFFFF;
+
+	if (exponent <= 0)
+	{
+		// Too small for a normal half, flush to a denormal or 0
+		if (exponent < -10)
+		{
+			return (unsigned short)sign;
+		}
+		mantissa |= 0x00800000;
+		GLuint shift = 14 - exponent;
+		GLuint half = mantissa >> shift;
+		// round to nearest
+		if ((mantissa >> (shift - 1)) & 1)
+		{
+			half++;
+		}
+		return (unsigned short)(sign | half);
+	}
+
+	if (exponent >= 31)
+	{
+		// Overflow or NaN, keep NaN as NaN
+		if (((bits >> 23) & 0xFF) == 0xFF && mantissa)
+		{
+			return (unsigned short)(sign | 0x7E00);
+		}
+		return (unsigned short)(sign | 0x7C00);
+	}
+
+	GLuint half = sign | (exponent << 10) | (mantissa >> 13);
+	// round to nearest, a carry in the exponent is still the right value
+	if (mantissa & 0x00001000)
+	{
+		half++;
+	}
+	return (unsigned short)half;
+}
+
+glm::vec2 VertexFormat::OctahedralEncode(glm::vec3 n)
+{
+	// Project on the octahedron |x| + |y| + |z| = 1 then fold the lower half on the upper one
+	float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if (sum <= 0.0f)
+	{
+		return glm::vec2(0.0f, 0.0f);
+	}
+
+	glm::vec2 oct(n.x / sum, n.y / sum);
+	if (n.z < 0.0f)
+	{
+		glm::vec2 folded((1.0f - std::fabs(oct.y)) * (oct.x >= 0.0f ? 1.0f : -1.0f),
+						(1.0f - std::fabs(oct.x)) * (oct.y >= 0.0f ? 1.0f : -1.0f));
+		oct = folded;
+	}
+	return oct;
+}
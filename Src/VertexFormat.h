@@ -0,0 +1,64 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Describe how the x, y, z, u, v, nx, ny, nz vertices given to Mesh::CreateMesh are stored on the GPU
+class VertexFormat
+{
+public:
+	enum PositionType
+	{
+		POSITION_FLOAT,		// 3 x 32 bits float
+		POSITION_HALF,		// 4 x 16 bits half float, relative to the center of the mesh bounds
+		POSITION_UNORM16	// 4 x 16 bits normalised, relative to the min corner of the mesh bounds
+	};
+
+	enum TexCoordType
+	{
+		TEXCOORD_FLOAT,		// 2 x 32 bits float
+		TEXCOORD_HALF		// 2 x 16 bits half float
+	};
+
+	enum NormalType
+	{
+		NORMAL_FLOAT,		// 3 x 32 bits float
+		NORMAL_OCT16,		// octahedral encoding in 2 x 16 bits snorm
+		NORMAL_OCT10		// octahedral encoding in the x and y of a 10:10:10:2 snorm
+	};
+
+	VertexFormat();
+	VertexFormat(PositionType positionType, TexCoordType texCoordType, NormalType normalType);
+
+	// 32 bytes per vertex
+	static VertexFormat Full();
+	// 16 bytes per vertex
+	static VertexFormat Compressed();
+
+	GLsizei GetStride() const;
+	bool IsNormalOctahedral() const;
+	// Different for every combination of types, used to key the cooked mesh cache
+	unsigned int GetId() const;
+
+	// Values the vertex shader use to get back the position: pos * scale + offset
+	void GetPositionDecode(glm::vec3 boundsMin, glm::vec3 boundsMax, glm::vec3* scale, glm::vec3* offset) const;
+
+	// vertices use the layout described by VERTEX_LENGTH, out must be vertexCount * GetStride() bytes
+	void Encode(const GLfloat* vertices, unsigned int vertexCount, glm::vec3 boundsMin, glm::vec3 boundsMax, unsigned char* out) const;
+
+	// Must be called with the VAO and VBO bound
+	void SetupAttributes() const;
+
+	static unsigned short FloatToHalf(float value);
+
+private:
+	PositionType position;
+	TexCoordType texCoord;
+	NormalType normal;
+
+	GLsizei GetPositionSize() const;
+	GLsizei GetTexCoordSize() const;
+	GLsizei GetNormalSize() const;
+
+	static glm::vec2 OctahedralEncode(glm::vec3 n);
+};
@@ -2,6 +2,8 @@
 
 #include <iostream>
 
+#include "DebugLayer.h"
+
 Window::Window()
 {
 	mainWindow = nullptr;
@@ -59,6 +61,11 @@ int Window::Initialise()
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	// Allow forard comaptibility
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, true);
+	// Some drivers only give the detailed messages to a debug context
+	if (DebugLayer::IsEnabled())
+	{
+		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+	}
 
 	mainWindow = glfwCreateWindow(width, height, "Test Window", NULL, NULL);
 	if (!mainWindow)
@@ -90,6 +97,8 @@ int Window::Initialise()
 		return 1;
 	}
 
+	DebugLayer::Init();
+
 	// Enable depth test to determine which triangle are behind other
 	glEnable(GL_DEPTH_TEST);
 
@@ -22,6 +22,10 @@ public:
 
 	void SwapBuffers() { glfwSwapBuffers(mainWindow); }
 
+	// The context is current on one thread at a time, release it before another one makes it current
+	void MakeContextCurrent() { glfwMakeContextCurrent(mainWindow); }
+	void ReleaseContext() { glfwMakeContextCurrent(NULL); }
+
 	~Window();
 
 private:
@@ -1,8 +1,11 @@
 #define STB_IMAGE_IMPLEMENTATION
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <GL/glew.h>
@@ -10,19 +13,34 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "CommonValues.h"
 
 #include "Camera.h"
+#include "DebugLayer.h"
+#include "DeferredRenderer.h"
 #include "DirectionalLight.h"
+#include "AssetLoader.h"
+#include "FileWatcher.h"
+#include "FrameQueue.h"
+#include "GeometryPool.h"
+#include "ImageDecoder.h"
+#include "JobSystem.h"
 #include "Material.h"
 #include "Mesh.h"
 #include "Model.h"
 #include "PointLight.h"
 #include "Shader.h"
+#include "ShaderCache.h"
+#include "ShaderVariants.h"
 #include "Skybox.h"
 #include "Texture.h"
+#include "TextureArray.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
 #include "Window.h"
 
 // Window dimensions
@@ -37,18 +55,58 @@ uniformDirectionalLightTransform = 0, uniformOmniLightPos = 0, uniformFarPlane =
 unsigned int pointLightCount = 0;
 unsigned int spotLightCount = 0;
 
+// 2 soft shadows, 1 hard shadows, 0 no shadow pass at all
+int shadowQuality = 2;
+bool flashLightOn = true;
+// Features of the main pass being drawn, the material adds its own with UseMaterial
+unsigned int mainPassFeatures = 0;
+bool useMaterialShaders = false;
+Shader* currentMainShader = nullptr;
+
 Window mainWindow;
 std::vector<Mesh*> meshList;
 
-std::vector<Shader> shaderList;
+// Main pass programs, specialised for the lights, the shadows and the material being drawn
+ShaderVariants mainShaders;
+ShaderVariants mainIndirectShaders;
 Shader directionalShadowShader;
 Shader omniShadowShader;
+Shader directionalShadowIndirectShader;
+Shader omniShadowIndirectShader;
+
+// Every pass is drawn with one glMultiDrawElementsIndirect when the driver support it,
+// the main pass then samples its textures from the arrays
+GeometryPool geometryPool;
+bool useIndirectDraw = false;
+int poolMeshIds[3] = { -1, -1, -1 };
+
+// G key: the main pass is shaded by tiles from a G-buffer instead of forward. The average frame time
+// of the path being left is printed on every switch to compare them
+DeferredRenderer deferredRenderer;
+bool deferredSupported = false;
+bool useDeferred = false;
+double pathFrameTime = 0.0;
+unsigned int pathFrameCount = 0;
+
+// Worker threads for the CPU side of loading, never touch GL
+ThreadPool threadPool;
+// Short jobs of the frame (culling...), the main thread runs them too while it waits
+JobSystem jobSystem;
+// Assets are loaded in the background and uploaded a few megabytes per frame
+AssetLoader assetLoader;
+const size_t uploadBytesPerFrame = 8 << 20;
 
 Camera camera;
 
-Texture brickTexture;
-Texture dirtTexture;
-Texture plainTexture;
+// Every texture comes from the cache so the models share them with the scene
+TextureCache textureCache;
+Texture* brickTexture;
+Texture* dirtTexture;
+Texture* plainTexture;
+// Keep the textures at the resolution they are seen at within this much GPU memory
+TextureStreamer textureStreamer;
+const size_t textureBudgetBytes = 32 << 20;
+TextureArray textureArrays;
 
 Material shinyMaterial;
 Material dullMaterial;
@@ -61,10 +119,37 @@ SpotLight spotLights[MAX_SPOT_LIGHTS];
 
 Skybox skybox;
 
+// Edited shaders and textures are reloaded while the app runs
+FileWatcher fileWatcher;
+
 GLfloat deltaTime = 0.0f;
 GLfloat lastTime = 0.0f;
 
+// The scene moves by fixed steps whatever the frame rate, a frame runs as many as the time elapsed holds.
+// A longer frame than maxFrameTime slows the scene down rather than running hundreds of steps to catch up
+const float simulationStep = 1.0f / 60.0f;
+const float maxFrameTime = 0.25f;
+float simulationTime = 0.0f;
+// --deterministic: exactly one step per frame and no interpolation, the same frames always show the same scene
+bool deterministic = false;
+
+// Degrees per second. The turtle used to turn 0.1 degree per scene draw, 3 draws a frame with the
+// directional and spot shadow passes, so 18 degrees per second at 60 Hz
+const float turtleSpeed = 18.0f;
 GLfloat turtuleAngle = 0.0f;
+GLfloat previousTurtleAngle = 0.0f;
+glm::vec3 previousCameraPosition;
+
+// The main thread handles the input and moves the scene, then queues a packet of what to draw. The render thread
+// owns the GL context once everything is created and draws the packets, so the two overlap.
+// The camera, turtuleAngle, shadowQuality and flashLightOn belong to the main thread, the passes only read frame
+FrameQueue frameQueue;
+const FramePacket* frame = nullptr;
+
+// LOD selection and meshlet culling of the pass being drawn, shadow passes accept a bigger error
+ViewParameters sceneView;
+const float mainPassPixelError = 1.0f;
+const float shadowPassPixelError = 4.0f;
 
 
 // Vertex Shader
@@ -139,6 +224,16 @@ void CreateObjects()
 
 	calcAverageNormals(indices, 12, vertices, 32, 8, 5);
 
+	// Every draw goes through the pool when it's used, the meshes are only uploaded there
+	if (useIndirectDraw)
+	{
+		// Both pyramids share the same geometry
+		poolMeshIds[0] = geometryPool.AddMesh(vertices, indices, 32, 12);
+		poolMeshIds[1] = poolMeshIds[0];
+		poolMeshIds[2] = geometryPool.AddMesh(floorVertices, floorIndices, 32, 6);
+		return;
+	}
+
 	Mesh* obj1 = new Mesh();
 	obj1->CreateMesh(vertices, indices, 32, 12);
 	meshList.push_back(obj1);
@@ -150,135 +245,333 @@ void CreateObjects()
 	Mesh* obj3 = new Mesh();
 	obj3->CreateMesh(floorVertices, floorIndices, 32, 6);
 	meshList.push_back(obj3);
-
 }
 
 void CreateShaders()
 {
-	Shader* shader1 = new Shader();
-	shader1->CreateFromFiles(vShader, fShader);
-	shaderList.push_back(*shader1);
+	mainShaders.Init(vShader, fShader);
 
 	directionalShadowShader.CreateFromFiles("Shaders/directional_shadow_map.vert", "Shaders/directional_shadow_map.frag");
 	omniShadowShader.CreateFromFiles("Shaders/omni_shadow_map.vert", "Shaders/omni_shadow_map.geom", "Shaders/omni_shadow_map.frag");
+
+	if (useIndirectDraw)
+	{
+		directionalShadowIndirectShader.CreateFromFiles("Shaders/directional_shadow_map_indirect.vert", "Shaders/directional_shadow_map.frag");
+		omniShadowIndirectShader.CreateFromFiles("Shaders/omni_shadow_map_indirect.vert", "Shaders/omni_shadow_map.geom", "Shaders/omni_shadow_map.frag");
+		mainIndirectShaders.Init("Shaders/shader_indirect.vert", "Shaders/shader_indirect.frag");
+	}
 }
 
-void RenderScene()
+// Both RenderScene and RenderSceneIndirect use these so every draw path place the objects the same way
+void UpdateSceneTransforms(float turtleAngle, glm::mat4* sceneTransforms)
 {
-	// Apply transformation for the firt object
 	glm::mat4 model(1.0f);
-
 	model = glm::translate(model, glm::vec3(0.0f, 0.0f, -2.5f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	brickTexture.UseTexture();
-	shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[0]->RenderMesh();
+	sceneTransforms[0] = model;
 
-	// Apply transformation for the second object
 	model = glm::mat4(1.0f);
 	model = glm::translate(model, glm::vec3(0.0f, 4.0f, -2.5f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	dirtTexture.UseTexture();
-	dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[1]->RenderMesh();
+	sceneTransforms[1] = model;
 
 	model = glm::mat4(1.0f);
 	model = glm::translate(model, glm::vec3(0.0f, -2.0f, 0.0f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	dirtTexture.UseTexture();
-	dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	meshList[2]->RenderMesh();
-
-	turtuleAngle += 0.1f;
-	if (turtuleAngle > 360.0f)
-	{
-		turtuleAngle = 0.0f;
-	}
+	sceneTransforms[2] = model;
 
 	model = glm::mat4(1.0f);
-	model = glm::rotate(model, turtuleAngle * toRadians, glm::vec3(0.0f, -1.0f, 0.0f));
+	model = glm::rotate(model, turtleAngle * toRadians, glm::vec3(0.0f, -1.0f, 0.0f));
 	model = glm::translate(model, glm::vec3(7.0f, -0.5f, 0.0f));
 	model = glm::rotate(model, 90 * toRadians, glm::vec3(-1.0f, 0.0f, 0.0f));
 	model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-	dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-	turtle.RenderModel();
+	sceneTransforms[3] = model;
+}
+
+// In the main pass the material first switches to the cheapest variant that can draw it,
+// RenderPass already set the uniforms of both. The model matrix must be set after
+void UseMaterial(Material* material)
+{
+	if (useMaterialShaders)
+	{
+		unsigned int features = mainPassFeatures | (material->GetSpecularIntensity() > 0.0f ? ShaderVariants::FEATURE_SPECULAR : 0);
+		Shader* shader = mainShaders.Get(features);
+		if (shader != currentMainShader)
+		{
+			shader->UseShader();
+			uniformModel = shader->GetModelLocation();
+			uniformSpecularIntensity = shader->GetSpecularIntensityLocation();
+			uniformShininess = shader->GetShininessLocation();
+			currentMainShader = shader;
+		}
+	}
+
+	material->UseMaterial(uniformSpecularIntensity, uniformShininess);
+}
+
+void RenderScene()
+{
+	const glm::mat4* sceneTransforms = frame->sceneTransforms;
+
+	// Apply transformation for the firt object
+	UseMaterial(&shinyMaterial);
+	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(sceneTransforms[0]));
+	brickTexture->UseTexture();
+	meshList[0]->RenderMesh();
+
+	// Apply transformation for the second object
+	UseMaterial(&dullMaterial);
+	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(sceneTransforms[1]));
+	dirtTexture->UseTexture();
+	meshList[1]->RenderMesh();
+
+	UseMaterial(&dullMaterial);
+	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(sceneTransforms[2]));
+	dirtTexture->UseTexture();
+	meshList[2]->RenderMesh();
+
+	UseMaterial(&dullMaterial);
+	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(sceneTransforms[3]));
+	turtle.RenderModel(sceneTransforms[3], sceneView);
+}
+
+// Depth only version of RenderScene for the shadow passes, no texture or material are set
+// so the whole scene goes in one glMultiDrawElementsIndirect
+void RenderSceneIndirect()
+{
+	const glm::mat4* sceneTransforms = frame->sceneTransforms;
+
+	geometryPool.BeginDraws();
+	for (size_t i = 0; i < 3; i++)
+	{
+		geometryPool.AddDraw(poolMeshIds[i], sceneTransforms[i]);
+	}
+	turtle.AddToDrawList(&geometryPool, sceneTransforms[3], sceneView);
+	geometryPool.SubmitDraws();
+}
+
+// Main pass version of RenderSceneIndirect, the texture and the material of every draw go in its per draw data.
+// The turtle keeps its meshlet culling, every visible range of its LOD 0 is a command of its own
+void RenderSceneTexturedIndirect()
+{
+	const glm::mat4* sceneTransforms = frame->sceneTransforms;
+
+	glm::vec4 shiny(shinyMaterial.GetSpecularIntensity(), shinyMaterial.GetShininess(), 0.0f, 0.0f);
+	glm::vec4 dull(dullMaterial.GetSpecularIntensity(), dullMaterial.GetShininess(), 0.0f, 0.0f);
+
+	geometryPool.BeginDraws();
+	geometryPool.AddDraw(poolMeshIds[0], sceneTransforms[0], textureArrays.GetDrawTexture(brickTexture), shiny);
+	geometryPool.AddDraw(poolMeshIds[1], sceneTransforms[1], textureArrays.GetDrawTexture(dirtTexture), dull);
+	geometryPool.AddDraw(poolMeshIds[2], sceneTransforms[2], textureArrays.GetDrawTexture(dirtTexture), dull);
+	turtle.AddToDrawList(&geometryPool, sceneTransforms[3], sceneView, &textureArrays, dull);
+	geometryPool.SubmitDraws();
+}
+
+// Recompile the programs using a changed file and upload the changed textures again, nothing else is reloaded
+void HotReload()
+{
+	std::vector<std::string> changedFiles;
+	fileWatcher.Poll(&changedFiles);
+
+	for (size_t i = 0; i < changedFiles.size(); i++)
+	{
+		const std::string& file = changedFiles[i];
+		double start = glfwGetTime();
+
+		int programs = mainShaders.Reload(file) + mainIndirectShaders.Reload(file) + (skybox.ReloadShader(file) ? 1 : 0);
+		Shader* shaders[] = { &directionalShadowShader, &omniShadowShader, &directionalShadowIndirectShader, &omniShadowIndirectShader };
+		for (size_t j = 0; j < 4; j++)
+		{
+			if (shaders[j]->UsesFile(file) && shaders[j]->Reload())
+			{
+				programs++;
+			}
+		}
+
+		programs += deferredRenderer.Reload(file);
+
+		int textures = textureCache.Reload(file, &assetLoader);
+
+		if (programs > 0 || textures > 0)
+		{
+			printf("Reloaded %s: %d programs in %.1f ms, %d textures queued\n", file.c_str(), programs, (glfwGetTime() - start) * 1000.0, textures);
+		}
+	}
+}
+
+// Report how big every texture is on screen, from the transforms of the frame
+void RequestTextureLevels()
+{
+	const glm::mat4* sceneTransforms = frame->sceneTransforms;
+	glm::vec3 viewPosition = frame->cameraPosition;
+	float projectionScale = mainWindow.GetBufferHeight() / (2.0f * tanf(glm::radians(30.0f)));
+
+	// The pyramids cover their texture once over 2 units
+	for (size_t i = 0; i < 2; i++)
+	{
+		Texture* texture = i == 0 ? brickTexture : dirtTexture;
+		float distance = glm::length(glm::vec3(sceneTransforms[i][3]) - viewPosition) - 1.0f;
+		textureStreamer.Request(texture, TextureStreamer::GetPixelSize(distance, 2.0f, projectionScale));
+	}
+
+	// The floor repeats it every 2 units, what matters is its closest point
+	glm::vec3 floorCenter = glm::vec3(sceneTransforms[2][3]);
+	glm::vec3 closest = glm::clamp(viewPosition, floorCenter - glm::vec3(10.0f, 0.0f, 10.0f), floorCenter + glm::vec3(10.0f, 0.0f, 10.0f));
+	textureStreamer.Request(dirtTexture, TextureStreamer::GetPixelSize(glm::length(closest - viewPosition), 2.0f, projectionScale));
+
+	ViewParameters view;
+	view.viewPosition = viewPosition;
+	view.projectionScale = projectionScale;
+	turtle.RequestTextureLevels(&textureStreamer, sceneTransforms[3], view);
 }
 
 // Handle rendering for the creation of the shadowmap
 void DirectionalShadowMapPass(DirectionalLight* light)
 {
-	directionalShadowShader.UseShader();
+	DebugLayer::PushGroup("Directional shadow map");
+
+	Shader* shadowShader = useIndirectDraw ? &directionalShadowIndirectShader : &directionalShadowShader;
+	shadowShader->UseShader();
 
 	glViewport(0, 0, light->GetShadowMap()->GetShadowWidth(), light->GetShadowMap()->GetShadowHeight());
 
 	light->GetShadowMap()->Write();
 	glClear(GL_DEPTH_BUFFER_BIT);
 
-	uniformModel = directionalShadowShader.GetModelLocation();
+	uniformModel = shadowShader->GetModelLocation();
 	glm::mat4 lTransform = light->CalculateLightTransform();
-	directionalShadowShader.SetDirectionalLightTransform(&lTransform);
+	shadowShader->SetDirectionalLightTransform(&lTransform);
+
+	// Orthographic projection so there is no real distance, use the camera one with the shadow bias
+	sceneView.viewPosition = frame->cameraPosition;
+	sceneView.projectionScale = light->GetShadowMap()->GetShadowHeight() / (2.0f * tanf(glm::radians(30.0f)));
+	sceneView.maxPixelError = shadowPassPixelError;
+	sceneView.viewProjection = lTransform;
+	// Back facing meshlets still cast shadows since the meshes are not always closed
+	sceneView.cullMeshlets = false;
 
-	directionalShadowShader.Validate();
+	shadowShader->Validate();
 	// Render the scene from the view from the light and write only depth
-	RenderScene();
+	if (useIndirectDraw)
+	{
+		RenderSceneIndirect();
+	}
+	else
+	{
+		RenderScene();
+	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	DebugLayer::PopGroup();
 }
 
 void OmniShadowMapPass(PointLight* light)
 {
-	omniShadowShader.UseShader();
+	DebugLayer::PushGroup("Omni shadow map");
+
+	Shader* shadowShader = useIndirectDraw ? &omniShadowIndirectShader : &omniShadowShader;
+	shadowShader->UseShader();
 
 	glViewport(0, 0, light->GetShadowMap()->GetShadowWidth(), light->GetShadowMap()->GetShadowHeight());
 
 	light->GetShadowMap()->Write();
 	glClear(GL_DEPTH_BUFFER_BIT);
 
-	uniformModel = omniShadowShader.GetModelLocation();
-	uniformOmniLightPos = omniShadowShader.GetOmniLightPosLocation();
-	uniformFarPlane = omniShadowShader.GetFarPlaneLocation();
+	uniformModel = shadowShader->GetModelLocation();
+	uniformOmniLightPos = shadowShader->GetOmniLightPosLocation();
+	uniformFarPlane = shadowShader->GetFarPlaneLocation();
 
 	glUniform3f(uniformOmniLightPos, light->GetPosition().x, light->GetPosition().y, light->GetPosition().z);
 	glUniform1f(uniformFarPlane, light->GetFarPlane());
-	omniShadowShader.SetOmniLightMatrices(light->CalculateLightTransform());
+	shadowShader->SetOmniLightMatrices(light->CalculateLightTransform());
+
+	// Every face of the cube map has a 90 degrees fov
+	sceneView.viewPosition = light->GetPosition();
+	sceneView.projectionScale = light->GetShadowMap()->GetShadowHeight() / 2.0f;
+	sceneView.maxPixelError = shadowPassPixelError;
+	sceneView.cullMeshlets = false;
 
-	omniShadowShader.Validate();
+	shadowShader->Validate();
 	// Render the scene from the view from the light and write only depth
-	RenderScene();
+	if (useIndirectDraw)
+	{
+		RenderSceneIndirect();
+	}
+	else
+	{
+		RenderScene();
+	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	DebugLayer::PopGroup();
 }
 
-void RenderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+// Features of the main pass that don't depend on the material
+unsigned int GetMainPassFeatures(int shadowQuality)
 {
-	glViewport(0, 0, 1366, 768);
-	// Clear window
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	skybox.DrawSkybox(viewMatrix, projectionMatrix);
-
-	shaderList[0].UseShader();
+	unsigned int features = 0;
+	if (shadowQuality > 0)
+	{
+		features |= ShaderVariants::FEATURE_SHADOWS;
+	}
+	if (shadowQuality > 1)
+	{
+		features |= ShaderVariants::FEATURE_SOFT_SHADOWS;
+	}
+	if (pointLightCount > 0)
+	{
+		features |= ShaderVariants::FEATURE_POINT_LIGHTS;
+	}
+	if (spotLightCount > 0)
+	{
+		features |= ShaderVariants::FEATURE_SPOT_LIGHTS;
+	}
+	return features;
+}
 
-	uniformModel = shaderList[0].GetModelLocation();
-	uniformProjection = shaderList[0].GetProjectionLocation();
-	uniformView = shaderList[0].GetViewLocation();
-	uniformEyePosition = shaderList[0].GetEyePositionLocation();
-	uniformSpecularIntensity = shaderList[0].GetSpecularIntensityLocation();
-	uniformShininess = shaderList[0].GetShininessLocation();
+// Switch to the features asked for once their variants are compiled, the previous ones are drawn meanwhile
+// so changing the shadow quality doesn't wait for the driver
+void UpdateMainPassFeatures()
+{
+	unsigned int wanted = GetMainPassFeatures(frame->shadowQuality);
+	if (wanted == mainPassFeatures)
+	{
+		return;
+	}
 
+	bool ready;
+	if (useDeferred)
+	{
+		ready = deferredRenderer.GetLightingShader(wanted)->IsReady();
+	}
+	else if (useIndirectDraw)
+	{
+		ready = mainIndirectShaders.Get(wanted | ShaderVariants::FEATURE_SPECULAR)->IsReady();
+	}
+	else
+	{
+		// Both asked for so they are compiled together
+		bool readyPlain = mainShaders.Get(wanted)->IsReady();
+		bool readySpecular = mainShaders.Get(wanted | ShaderVariants::FEATURE_SPECULAR)->IsReady();
+		ready = readyPlain && readySpecular;
+	}
 
+	if (ready)
+	{
+		mainPassFeatures = wanted;
+	}
+}
 
-	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
-	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-	glUniform3f(uniformEyePosition, camera.GetCameraPosition().x, camera.GetCameraPosition().y, camera.GetCameraPosition().z);
+// Lights and shadow maps of the program in use, shared by the forward pass and the deferred lighting
+void SetupLighting(Shader* mainShader)
+{
+	uniformEyePosition = mainShader->GetEyePositionLocation();
+	glUniform3f(uniformEyePosition, frame->cameraPosition.x, frame->cameraPosition.y, frame->cameraPosition.z);
 
-	shaderList[0].SetDirectionalLight(&mainLight);
-	shaderList[0].SetPointLights(pointLights, pointLightCount, 3, 0);
-	shaderList[0].SetSpotLights(spotLights, spotLightCount, 3 + pointLightCount, pointLightCount);
+	mainShader->SetDirectionalLight(&mainLight);
+	mainShader->SetPointLights(pointLights, pointLightCount, 3, 0);
+	mainShader->SetSpotLights(spotLights, spotLightCount, 3 + pointLightCount, pointLightCount);
 	glm::mat4 lTransform = mainLight.CalculateLightTransform();
-	shaderList[0].SetDirectionalLightTransform(&lTransform);
+	mainShader->SetDirectionalLightTransform(&lTransform);
 
 	// We need to ensure that every texture has its own teture unit AND that there is no different type of texture set up with the same texture unit.
 	// The problem is that by default the texture unit associated is 0.
@@ -287,40 +580,491 @@ void RenderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
 	// There are several way to deal with that problem but for an idiotic way we just shift everything by one
 	// So directional shadowmap 1->2
 	mainLight.GetShadowMap()->Read(GL_TEXTURE2);
-	shaderList[0].SetTexture(1);
-	shaderList[0].SetDirectionalShadowMap(2);
+	mainShader->SetDirectionalShadowMap(2);
+}
+
+// Camera, lights and shadow maps of a main pass program, every variant drawn in the frame needs them
+void SetupMainShader(Shader* mainShader, const glm::mat4& projectionMatrix, const glm::mat4& viewMatrix)
+{
+	mainShader->UseShader();
+
+	uniformModel = mainShader->GetModelLocation();
+	uniformProjection = mainShader->GetProjectionLocation();
+	uniformView = mainShader->GetViewLocation();
+	uniformSpecularIntensity = mainShader->GetSpecularIntensityLocation();
+	uniformShininess = mainShader->GetShininessLocation();
 
-	glm::vec3 lowerLight = camera.GetCameraPosition();
-	lowerLight.y -= 0.3f;
-	spotLights[0].SetFlash(lowerLight, camera.getCameraDirection());
 
-	shaderList[0].Validate();
+
+	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
+
+	SetupLighting(mainShader);
+
+	if (useIndirectDraw)
+	{
+		// The arrays go after the omni shadow maps
+		mainShader->SetTextureArrays(TEXTURE_ARRAY_UNIT);
+		textureArrays.Bind();
+	}
+	else
+	{
+		mainShader->SetTexture(1);
+	}
+
+	mainShader->Validate();
+}
+
+// Deferred version of the main pass: the scene fills the G-buffer with the same draws as the forward pass,
+// then the tiles of the screen are lit with the lights reaching them and drawn over the skybox
+void RenderDeferredPass(const glm::mat4& projectionMatrix, const glm::mat4& viewMatrix)
+{
+	Shader* geometryShader = deferredRenderer.BeginGeometryPass();
+
+	uniformModel = geometryShader->GetModelLocation();
+	uniformSpecularIntensity = geometryShader->GetSpecularIntensityLocation();
+	uniformShininess = geometryShader->GetShininessLocation();
+	glUniformMatrix4fv(geometryShader->GetProjectionLocation(), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+	glUniformMatrix4fv(geometryShader->GetViewLocation(), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+
+	if (useIndirectDraw)
+	{
+		geometryShader->SetTextureArrays(TEXTURE_ARRAY_UNIT);
+		textureArrays.Bind();
+		geometryShader->Validate();
+		RenderSceneTexturedIndirect();
+	}
+	else
+	{
+		geometryShader->SetTexture(1);
+		geometryShader->Validate();
+		RenderScene();
+	}
+
+	deferredRenderer.EndGeometryPass();
+	glViewport(0, 0, 1366, 768);
+
+	Shader* lightingShader = deferredRenderer.GetLightingShader(mainPassFeatures);
+	lightingShader->UseShader();
+	SetupLighting(lightingShader);
+	deferredRenderer.ShadeTiles(lightingShader, projectionMatrix * viewMatrix);
+
+	deferredRenderer.Composite();
+}
+
+void RenderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+{
+	DebugLayer::PushGroup("Main pass");
+
+	glViewport(0, 0, 1366, 768);
+	// Clear window
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	skybox.DrawSkybox(viewMatrix, projectionMatrix);
+
+	sceneView.viewPosition = frame->cameraPosition;
+	sceneView.projectionScale = 768 / (2.0f * tanf(glm::radians(30.0f)));
+	sceneView.maxPixelError = mainPassPixelError;
+	sceneView.viewProjection = projectionMatrix * viewMatrix;
+	sceneView.cullMeshlets = true;
+
+	UpdateMainPassFeatures();
+
 	// Render the map from the view of the camera andrender with color
-	RenderScene();
+	if (useDeferred)
+	{
+		RenderDeferredPass(projectionMatrix, viewMatrix);
+	}
+	else if (useIndirectDraw)
+	{
+		// A single draw for every material, the specular code stays in
+		SetupMainShader(mainIndirectShaders.Get(mainPassFeatures | ShaderVariants::FEATURE_SPECULAR), projectionMatrix, viewMatrix);
+		RenderSceneTexturedIndirect();
+	}
+	else
+	{
+		SetupMainShader(mainShaders.Get(mainPassFeatures), projectionMatrix, viewMatrix);
+		SetupMainShader(mainShaders.Get(mainPassFeatures | ShaderVariants::FEATURE_SPECULAR), projectionMatrix, viewMatrix);
+
+		useMaterialShaders = true;
+		currentMainShader = nullptr;
+		RenderScene();
+		useMaterialShaders = false;
+	}
+
+	DebugLayer::PopGroup();
+}
+
+// One fixed step of everything that moves with time, the previous state is kept for the interpolation
+void StepSimulation(float step)
+{
+	previousCameraPosition = camera.GetCameraPosition();
+	previousTurtleAngle = turtuleAngle;
+
+	camera.KeyControl(mainWindow.getKeys(), step);
+
+	turtuleAngle += turtleSpeed * step;
+	if (turtuleAngle > 360.0f)
+	{
+		// Both wrap so the angle between them stays the same
+		turtuleAngle -= 360.0f;
+		previousTurtleAngle -= 360.0f;
+	}
+}
+
+// Input and scene update of the main thread, the result goes in packet for the render thread
+void UpdateSimulation(FramePacket* packet)
+{
+	// The view direction follows the mouse right away, it isn't part of the steps
+	camera.MouseControl(mainWindow.getXChange(), mainWindow.getYChange());
+
+	int steps = 0;
+	if (deterministic)
+	{
+		StepSimulation(simulationStep);
+		steps = 1;
+		packet->interpolation = 1.0f;
+	}
+	else
+	{
+		simulationTime += std::min(deltaTime, maxFrameTime);
+		while (simulationTime >= simulationStep)
+		{
+			StepSimulation(simulationStep);
+			simulationTime -= simulationStep;
+			steps++;
+		}
+		packet->interpolation = simulationTime / simulationStep;
+	}
+
+	if (mainWindow.getKeys()[GLFW_KEY_L])
+	{
+		flashLightOn = !flashLightOn;
+		mainWindow.getKeys()[GLFW_KEY_L] = false;
+	}
+
+	if (mainWindow.getKeys()[GLFW_KEY_O])
+	{
+		// Soft, hard then no shadows, each one with its own variants
+		shadowQuality = (shadowQuality + 2) % 3;
+		mainWindow.getKeys()[GLFW_KEY_O] = false;
+	}
+
+	packet->switchShading = mainWindow.getKeys()[GLFW_KEY_G];
+	mainWindow.getKeys()[GLFW_KEY_G] = false;
+	packet->printStats = mainWindow.getKeys()[GLFW_KEY_T];
+	mainWindow.getKeys()[GLFW_KEY_T] = false;
+
+	UpdateSceneTransforms(turtuleAngle, packet->sceneTransforms);
+	UpdateSceneTransforms(previousTurtleAngle, packet->previousTransforms);
+
+	packet->deltaTime = steps * simulationStep;
+	packet->viewMatrix = camera.CalculateViewMatrix();
+	packet->cameraPosition = camera.GetCameraPosition();
+	packet->previousCameraPosition = previousCameraPosition;
+	packet->cameraDirection = camera.getCameraDirection();
+	packet->flashLightOn = flashLightOn;
+	packet->flashPosition = camera.GetCameraPosition();
+	packet->flashPosition.y -= 0.3f;
+	packet->shadowQuality = shadowQuality;
+}
+
+// Rotation, translation and scale blended separately, a blend of the matrices would shrink the rotating objects
+glm::mat4 InterpolateTransform(const glm::mat4& from, const glm::mat4& to, float t)
+{
+	glm::vec3 fromScale(glm::length(glm::vec3(from[0])), glm::length(glm::vec3(from[1])), glm::length(glm::vec3(from[2])));
+	glm::vec3 toScale(glm::length(glm::vec3(to[0])), glm::length(glm::vec3(to[1])), glm::length(glm::vec3(to[2])));
+
+	glm::quat fromRotation = glm::quat_cast(glm::mat3(glm::vec3(from[0]) / fromScale.x, glm::vec3(from[1]) / fromScale.y, glm::vec3(from[2]) / fromScale.z));
+	glm::quat toRotation = glm::quat_cast(glm::mat3(glm::vec3(to[0]) / toScale.x, glm::vec3(to[1]) / toScale.y, glm::vec3(to[2]) / toScale.z));
+
+	glm::mat4 model = glm::mat4_cast(glm::slerp(fromRotation, toRotation, t));
+	model[0] *= glm::mix(fromScale.x, toScale.x, t);
+	model[1] *= glm::mix(fromScale.y, toScale.y, t);
+	model[2] *= glm::mix(fromScale.z, toScale.z, t);
+	model[3] = glm::mix(from[3], to[3], t);
+	return model;
+}
+
+// Move the frame of packet back between its previous step and the last one
+void InterpolateFrame(FramePacket* packet)
+{
+	float t = packet->interpolation;
+	if (t >= 1.0f)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		packet->sceneTransforms[i] = InterpolateTransform(packet->previousTransforms[i], packet->sceneTransforms[i], t);
+	}
+
+	// The view matrix rotates then translates by -position, only the translation changes
+	glm::vec3 position = glm::mix(packet->previousCameraPosition, packet->cameraPosition, t);
+	packet->viewMatrix = packet->viewMatrix * glm::translate(glm::mat4(1.0f), packet->cameraPosition - position);
+	packet->flashPosition += position - packet->cameraPosition;
+	packet->cameraPosition = position;
+}
+
+// Draw the packets of the main thread one after the other until the queue is closed
+void RenderThread()
+{
+	mainWindow.MakeContextCurrent();
+	// The culling of the passes is split in jobs from here, so this thread gets the first queue
+	jobSystem.Start();
+
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), (GLfloat)mainWindow.GetBufferWidth() / (GLfloat)mainWindow.GetBufferHeight(), 0.01f, 100.0f);
+	double lastFrameTime = glfwGetTime();
+
+	const FramePacket* packet;
+	while ((packet = frameQueue.BeginRead()) != nullptr)
+	{
+		// The packet stays as the simulation wrote it, the frame drawn is a copy moved back in time
+		FramePacket interpolated = *packet;
+		InterpolateFrame(&interpolated);
+		frame = &interpolated;
+
+		HotReload();
+		assetLoader.ProcessUploads(uploadBytesPerFrame);
+
+		spotLights[0].SetOn(frame->flashLightOn);
+		spotLights[0].SetFlash(frame->flashPosition, frame->cameraDirection);
+
+		RequestTextureLevels();
+		textureStreamer.Update();
+		if (useIndirectDraw)
+		{
+			textureArrays.Update();
+		}
+
+		if (frame->switchShading)
+		{
+			if (deferredSupported)
+			{
+				printf("%s shading: %.2f ms per frame over %u frames\n", useDeferred ? "Tiled deferred" : "Forward",
+					pathFrameCount > 0 ? pathFrameTime * 1000.0 / pathFrameCount : 0.0, pathFrameCount);
+				useDeferred = !useDeferred;
+				pathFrameTime = 0.0;
+				pathFrameCount = 0;
+			}
+			else
+			{
+				printf("Tiled deferred shading needs OpenGL 4.3\n");
+			}
+		}
+		// Time between two frames of this thread, the simulation one can differ
+		double now = glfwGetTime();
+		pathFrameTime += now - lastFrameTime;
+		pathFrameCount++;
+		lastFrameTime = now;
+
+		if (frame->printStats)
+		{
+			textureCache.PrintStats();
+			textureStreamer.PrintStats();
+			if (useIndirectDraw)
+			{
+				textureArrays.PrintStats();
+				printf("Geometry pool: %u ring stalls, %u passes not in the ring, %u draws dropped\n",
+					geometryPool.GetStallCount(), geometryPool.GetRingFullCount(), geometryPool.GetDroppedDrawCount());
+			}
+		}
+
+		if (useIndirectDraw)
+		{
+			geometryPool.BeginFrame();
+		}
+
+		if (frame->shadowQuality > 0)
+		{
+			// Create the directionalShadowMap
+			DirectionalShadowMapPass(&mainLight);
+			// Create the omniShadowmap for each pointLights and spotLights
+			for (size_t i = 0; i < pointLightCount; i++)
+			{
+				OmniShadowMapPass(&pointLights[i]);
+			}
+			for (size_t i = 0; i < spotLightCount; i++)
+			{
+				OmniShadowMapPass(&spotLights[i]);
+			}
+		}
+		// Render from the camera
+		RenderPass(projection, frame->viewMatrix);
+
+		if (useIndirectDraw)
+		{
+			geometryPool.EndFrame();
+		}
+		
+		glUseProgram(0);
+
+		mainWindow.SwapBuffers();
+		frameQueue.EndRead();
+	}
+	frame = nullptr;
+
+	jobSystem.Stop();
+	mainWindow.ReleaseContext();
+}
+
+std::vector<std::string> GetSkyboxFaces()
+{
+	// load skybox textures
+	// beware of the order when we push them
+	std::vector<std::string> skyboxFaces;
+	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_rt.tga");
+	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_lf.tga");
+	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_up.tga");
+	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_dn.tga");
+	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_bk.tga");
+	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_ft.tga");
+	return skyboxFaces;
+}
+
+// --cook-textures: write the DDS files of every texture so the first run doesn't have to encode them
+int CookTextures()
+{
+	threadPool.Start();
+	TextureCompressor::InitOffline();
+
+	int cooked = TextureFile::CookDirectory("Textures", &threadPool);
+	if (Skybox::CookFaces(GetSkyboxFaces(), &threadPool))
+	{
+		cooked++;
+	}
+
+	threadPool.Stop();
+	printf("%d textures cooked\n", cooked);
+	return 0;
+}
+
+// --benchmark-decode: how fast the images of the scene decode with each path of ImageDecoder
+int BenchmarkDecode()
+{
+	threadPool.Start();
+
+	std::vector<std::string> files;
+	const char* directories[] = { "Textures", "Textures/Skybox" };
+	for (size_t i = 0; i < 2; i++)
+	{
+		std::vector<std::string> directoryFiles = ImageDecoder::ListFiles(directories[i]);
+		for (size_t j = 0; j < directoryFiles.size(); j++)
+		{
+			if (ImageDecoder::IsImageFile(directoryFiles[j]))
+			{
+				files.push_back(directoryFiles[j]);
+			}
+		}
+	}
+
+	ImageDecoder::Benchmark(files, &threadPool, 5);
+
+	threadPool.Stop();
+	return 0;
 }
 
-int main()
+// --benchmark-jobs: overhead of the job system and speed up of a parallel loop against the thread pool
+int BenchmarkJobs()
 {
+	threadPool.Start();
+	jobSystem.Start();
+
+	JobSystem::Benchmark(&jobSystem, &threadPool, 20);
+
+	jobSystem.Stop();
+	threadPool.Stop();
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "--cook-textures") == 0)
+	{
+		return CookTextures();
+	}
+	if (argc > 1 && strcmp(argv[1], "--benchmark-decode") == 0)
+	{
+		return BenchmarkDecode();
+	}
+	if (argc > 1 && strcmp(argv[1], "--benchmark-jobs") == 0)
+	{
+		return BenchmarkJobs();
+	}
+
+	// The debug layer is on in debug builds, --gl-debug turns it on in release
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--gl-debug") == 0)
+		{
+			DebugLayer::SetEnabled(true);
+		}
+		if (strcmp(argv[i], "--deterministic") == 0)
+		{
+			deterministic = true;
+		}
+	}
+
 	mainWindow = Window(1366, 768);
 	mainWindow.Initialise();
 
+	threadPool.Start();
+	assetLoader.Init(&threadPool);
+
+	// Textures are encoded to BCn on the loader threads, a quarter to an eighth of the memory of RGBA8
+	TextureCompressor::Init();
+	TextureFile::Init();
+	textureCache.SetCompression(true, &threadPool);
+	textureCache.SetStreaming(true);
+	textureStreamer.Init(&textureCache, &assetLoader, textureBudgetBytes);
+
+	if (GeometryPool::IsSupported())
+	{
+		// Room for a command per visible meshlet range of the turtle in every pass
+		useIndirectDraw = geometryPool.Init(1 << 20, 3 << 20, 4096);
+	}
+	if (useIndirectDraw)
+	{
+		textureArrays.Init(&textureCache, true);
+	}
+
+	// Programs compiled once are loaded from their binary on the next runs, the others are compiled by the driver threads
+	ShaderCache::Init();
+	Shader::InitParallelCompile();
+
 	CreateObjects();
 	CreateShaders();
 
+	if (DeferredRenderer::IsSupported())
+	{
+		deferredSupported = deferredRenderer.Init(mainWindow.GetBufferWidth(), mainWindow.GetBufferHeight(), useIndirectDraw);
+	}
+
+	fileWatcher.Init();
+	fileWatcher.WatchDirectory("Shaders");
+	fileWatcher.WatchDirectory("Textures");
+
 	camera = Camera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), -0.0f, 0.0f, 5.0f, 0.5f);
 
-	brickTexture = Texture("Textures/brick.png");
-	brickTexture.LoadTextureA();
-	dirtTexture = Texture("Textures/dirt.png");
-	dirtTexture.LoadTextureA();
-	plainTexture = Texture("Textures/plain.png");
-	plainTexture.LoadTextureA();
+	// Decoded on the loader threads, they bind a placeholder until uploaded
+	brickTexture = textureCache.Acquire("Textures/brick.png", true, &assetLoader);
+	dirtTexture = textureCache.Acquire("Textures/dirt.png", true, &assetLoader);
+	plainTexture = textureCache.Acquire("Textures/plain.png", true, &assetLoader);
 
 	shinyMaterial = Material(1.0f, 256);
 	dullMaterial = Material(0.0f, 1);
 
 	turtle = Model();
-	turtle.LoadModel("Models/turtle.obj");
+	turtle.SetVertexFormat(VertexFormat::Compressed());
+	turtle.SetSplitLargeMeshes(true);
+	turtle.SetLodCount(4);
+	turtle.SetBuildMeshlets(true);
+	turtle.SetThreadPool(&threadPool);
+	turtle.SetJobSystem(&jobSystem);
+	turtle.SetTextureCache(&textureCache);
+	turtle.LoadModelAsync("Models/turtle.obj", useIndirectDraw ? &geometryPool : nullptr, &assetLoader);
 
 	mainLight = DirectionalLight(2048, 2048,
 								1.0f, 0.5f, 0.3f,
@@ -361,58 +1105,55 @@ int main()
 							20.0f);
 	//spotLightCount++;
 
-	// load skybox textures
-	// beware of the order when we push them
-	std::vector<std::string> skyboxFaces;
-	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_rt.tga");
-	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_lf.tga");
-	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_up.tga");
-	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_dn.tga");
-	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_bk.tga");
-	skyboxFaces.push_back("Textures/Skybox/cupertin-lake_ft.tga");
+	skybox = Skybox(GetSkyboxFaces(), &assetLoader);
 
-	skybox = Skybox(skyboxFaces);
+	// The variants of the first frame are submitted now with the other programs, the first frame waits for them
+	mainPassFeatures = GetMainPassFeatures(shadowQuality);
+	if (useIndirectDraw)
+	{
+		mainIndirectShaders.Get(mainPassFeatures | ShaderVariants::FEATURE_SPECULAR);
+	}
+	else
+	{
+		mainShaders.Get(mainPassFeatures);
+		mainShaders.Get(mainPassFeatures | ShaderVariants::FEATURE_SPECULAR);
+	}
+	ShaderCache::PrintStats();
 
-	glm::mat4 projection = glm::perspective(glm::radians(60.0f), (GLfloat)mainWindow.GetBufferWidth() / (GLfloat)mainWindow.GetBufferHeight(), 0.01f, 100.0f);
+	frameQueue.Init(2);
+	// From now on GL is only called by the render thread
+	mainWindow.ReleaseContext();
+	std::thread renderThread(RenderThread);
+
+	lastTime = glfwGetTime();
+	previousCameraPosition = camera.GetCameraPosition();
 
 	// Loop until window closed
 	while (!mainWindow.GetShouldClose())
 	{
-		GLfloat now = glfwGetTime();
-		deltaTime = now - lastTime;
-		lastTime = now;
-
 		// Get and Handle user input events
 		glfwPollEvents();
 
-		// Get input
-		camera.KeyControl(mainWindow.getKeys(), deltaTime);
-		camera.MouseControl(mainWindow.getXChange(), mainWindow.getYChange());
+		// Waits here while the render thread is a whole frame behind
+		FramePacket* packet = frameQueue.BeginWrite();
 
-		if (mainWindow.getKeys()[GLFW_KEY_L])
-		{
-			spotLights[0].Toggle();
-			mainWindow.getKeys()[GLFW_KEY_L] = false;
-		}
-
-		// Create the directionalShadowMap
-		DirectionalShadowMapPass(&mainLight);
-		// Create the omniShadowmap for each pointLights and spotLights
-		for (size_t i = 0; i < pointLightCount; i++)
-		{
-			OmniShadowMapPass(&pointLights[i]);
-		}
-		for (size_t i = 0; i < spotLightCount; i++)
-		{
-			OmniShadowMapPass(&spotLights[i]);
-		}
-		// Render from the camera
-		RenderPass(projection, camera.CalculateViewMatrix());
-		
-		glUseProgram(0);
+		GLfloat now = glfwGetTime();
+		deltaTime = now - lastTime;
+		lastTime = now;
 
-		mainWindow.SwapBuffers();
+		UpdateSimulation(packet);
+		frameQueue.EndWrite();
 	}
 
+	frameQueue.Close();
+	renderThread.join();
+	mainWindow.MakeContextCurrent();
+
+	// The loads still running use the globals, wait for them before they are destroyed
+	threadPool.WaitIdle();
+	threadPool.Stop();
+	textureArrays.Clear();
+	textureCache.Clear();
+
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,347 @@
+// Tests of JobSystem and of its work stealing deque, built by JobSystemTests.vcxproj.
+// Only the standard library is needed, so they also build with a sanitizer outside Visual Studio:
+//   g++ -std=c++14 -g -pthread -fsanitize=thread -ISrc Tests/JobSystemTests.cpp Src/JobSystem.cpp Src/ThreadPool.cpp
+// Return 0 when every check passed
+
+#include <atomic>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+
+static int failureCount = 0;
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failureCount++; \
+		} \
+	} while (0)
+
+// The deque only stores the pointers, the jobs of these tests are never run
+static std::vector<JobSystem::Job> MakeJobs(size_t count)
+{
+	return std::vector<JobSystem::Job>(count);
+}
+
+static void TestQueueOrder()
+{
+	std::vector<JobSystem::Job> jobs = MakeJobs(3);
+	JobSystem::WorkQueue* queue = new JobSystem::WorkQueue();
+
+	CHECK(queue->Pop() == nullptr);
+	CHECK(queue->Steal() == nullptr);
+
+	// The owner takes the newest, the thieves the oldest
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		CHECK(queue->Push(&jobs[i]));
+	}
+	CHECK(queue->Pop() == &jobs[2]);
+	CHECK(queue->Steal() == &jobs[0]);
+	CHECK(queue->Pop() == &jobs[1]);
+	CHECK(queue->Pop() == nullptr);
+	CHECK(queue->Steal() == nullptr);
+
+	delete queue;
+}
+
+static void TestQueueFull()
+{
+	const size_t capacity = (size_t)JobSystem::WorkQueue::CAPACITY;
+	std::vector<JobSystem::Job> jobs = MakeJobs(capacity + 1);
+	JobSystem::WorkQueue* queue = new JobSystem::WorkQueue();
+
+	for (size_t i = 0; i < capacity; i++)
+	{
+		CHECK(queue->Push(&jobs[i]));
+	}
+	CHECK(!queue->Push(&jobs[capacity]));
+
+	// A steal frees a slot, the indices wrap around the ring
+	CHECK(queue->Steal() == &jobs[0]);
+	CHECK(queue->Push(&jobs[capacity]));
+	CHECK(queue->Pop() == &jobs[capacity]);
+
+	size_t popped = 0;
+	while (queue->Pop())
+	{
+		popped++;
+	}
+	CHECK(popped == capacity - 1);
+
+	delete queue;
+}
+
+// The owner and a thief both go for the only job left: exactly one of them gets it
+static void TestQueueLastJobRace()
+{
+	const int rounds = 20000;
+	JobSystem::Job job;
+	JobSystem::WorkQueue* queue = new JobSystem::WorkQueue();
+
+	std::atomic<int> round(-1);
+	std::atomic<int> stolen(0);
+	std::atomic<int> thiefDone(-1);
+	std::thread thief([&]()
+	{
+		for (int i = 0; i < rounds; i++)
+		{
+			while (round.load() < i)
+			{
+				std::this_thread::yield();
+			}
+			if (queue->Steal() == &job)
+			{
+				stolen++;
+			}
+			thiefDone = i;
+		}
+	});
+
+	int popped = 0;
+	for (int i = 0; i < rounds; i++)
+	{
+		CHECK(queue->Push(&job));
+		round = i;
+		if (queue->Pop() == &job)
+		{
+			popped++;
+		}
+		while (thiefDone.load() < i)
+		{
+			std::this_thread::yield();
+		}
+	}
+	thief.join();
+
+	CHECK(popped + stolen == rounds);
+	CHECK(queue->Pop() == nullptr);
+
+	delete queue;
+}
+
+// Owner pushing and popping while several thieves steal: every job is taken once
+static void TestQueueStress()
+{
+	const size_t count = 200000;
+	std::vector<JobSystem::Job> jobs = MakeJobs(count);
+	std::vector<std::atomic<int>> taken(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		taken[i] = 0;
+	}
+	JobSystem::WorkQueue* queue = new JobSystem::WorkQueue();
+
+	std::atomic<bool> pushing(true);
+	std::vector<std::thread> thieves;
+	for (int t = 0; t < 3; t++)
+	{
+		thieves.push_back(std::thread([&]()
+		{
+			while (true)
+			{
+				bool done = !pushing.load();
+				if (JobSystem::Job* job = queue->Steal())
+				{
+					taken[job - &jobs[0]]++;
+				}
+				else if (done)
+				{
+					return;
+				}
+			}
+		}));
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		while (!queue->Push(&jobs[i]))
+		{
+			std::this_thread::yield();
+		}
+		if (i % 3 == 0)
+		{
+			if (JobSystem::Job* job = queue->Pop())
+			{
+				taken[job - &jobs[0]]++;
+			}
+		}
+	}
+	while (JobSystem::Job* job = queue->Pop())
+	{
+		taken[job - &jobs[0]]++;
+	}
+	pushing = false;
+	for (size_t t = 0; t < thieves.size(); t++)
+	{
+		thieves[t].join();
+	}
+
+	size_t wrong = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		wrong += taken[i] != 1;
+	}
+	CHECK(wrong == 0);
+
+	delete queue;
+}
+
+static void TestParallelFor(JobSystem* jobs)
+{
+	const size_t counts[] = { 0, 1, 2, 7, 100, 1001, 5000 };
+	const size_t batchSizes[] = { 1, 3, 16, 64, 1000 };
+
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+	{
+		for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++)
+		{
+			size_t count = counts[c];
+			std::vector<std::atomic<int>> visits(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				visits[i] = 0;
+			}
+
+			jobs->ParallelFor(count, batchSizes[b], [&](size_t i)
+			{
+				visits[i]++;
+			});
+
+			size_t wrong = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				wrong += visits[i] != 1;
+			}
+			if (wrong != 0)
+			{
+				printf("ParallelFor of %u with batches of %u: %u indices not visited once\n", (unsigned int)count, (unsigned int)batchSizes[b], (unsigned int)wrong);
+			}
+			CHECK(wrong == 0);
+		}
+	}
+}
+
+static void TestDependencies(JobSystem* jobs)
+{
+	// A chain, each job starting once the previous one is done
+	const int chainLength = 2000;
+	std::vector<JobSystem::Counter> links(chainLength);
+	std::vector<int> order;
+	for (int i = 0; i < chainLength; i++)
+	{
+		jobs->Run([&order, i]()
+		{
+			order.push_back(i);
+		}, &links[i], i > 0 ? &links[i - 1] : nullptr);
+	}
+	jobs->Wait(&links[chainLength - 1]);
+
+	CHECK(order.size() == (size_t)chainLength);
+	bool ordered = true;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		ordered &= order[i] == (int)i;
+	}
+	CHECK(ordered);
+	for (int i = 0; i < chainLength; i++)
+	{
+		CHECK(links[i].IsDone());
+	}
+
+	// Fan in: the last job sees the work of all the ones it depends on
+	std::atomic<int> sum(0);
+	int seen = -1;
+	JobSystem::Counter first;
+	JobSystem::Counter last;
+	for (int i = 0; i < 500; i++)
+	{
+		jobs->Run([&sum]() { sum++; }, &first);
+	}
+	jobs->Run([&sum, &seen]() { seen = sum; }, &last, &first);
+	jobs->Wait(&last);
+	CHECK(first.IsDone());
+	CHECK(seen == 500);
+}
+
+// More jobs than a deque holds, queued from its owner without waiting: the ones that don't fit run in place
+static void TestFullQueueFallback(JobSystem* jobs)
+{
+	const int count = (int)JobSystem::WorkQueue::CAPACITY * 3;
+	std::atomic<int> ran(0);
+	JobSystem::Counter counter;
+	for (int i = 0; i < count; i++)
+	{
+		jobs->Run([&ran]() { ran++; }, &counter);
+	}
+	jobs->Wait(&counter);
+	CHECK(ran == count);
+	CHECK(counter.IsDone());
+}
+
+// ParallelFor keeps its counter on the stack: the last job must be done with it before Wait returns.
+// Most useful under a sanitizer
+static void TestCounterLifetime(JobSystem* jobs)
+{
+	std::atomic<int> total(0);
+	for (int i = 0; i < 20000; i++)
+	{
+		jobs->ParallelFor(4, 1, [&total](size_t)
+		{
+			total++;
+		});
+	}
+	CHECK(total == 80000);
+}
+
+// Jobs given by a thread without a deque go through the shared queue
+static void TestForeignThread(JobSystem* jobs)
+{
+	std::atomic<int> ran(0);
+	std::thread other([&]()
+	{
+		JobSystem::Counter counter;
+		for (int i = 0; i < 1000; i++)
+		{
+			jobs->Run([&ran]() { ran++; }, &counter);
+		}
+		jobs->Wait(&counter);
+	});
+	other.join();
+	CHECK(ran == 1000);
+}
+
+int main()
+{
+	TestQueueOrder();
+	TestQueueFull();
+	TestQueueLastJobRace();
+	TestQueueStress();
+
+	// Not started: everything runs in place
+	JobSystem inlineJobs;
+	TestParallelFor(&inlineJobs);
+	TestDependencies(&inlineJobs);
+
+	JobSystem jobs;
+	jobs.Start(4);
+	TestParallelFor(&jobs);
+	TestDependencies(&jobs);
+	TestFullQueueFallback(&jobs);
+	TestCounterLifetime(&jobs);
+	TestForeignThread(&jobs);
+	jobs.Stop();
+
+	if (failureCount > 0)
+	{
+		printf("%d checks failed\n", failureCount);
+		return 1;
+	}
+	printf("All job system tests passed\n");
+	return 0;
+}